@@ -103,6 +103,7 @@ BASE_SCRIPTS= [
     'disablewallet.py',
     'keypool.py',
     'getblocktemplate.py',
+    'stratum.py',
     'bip65-cltv-p2p.py',
     'bipdersig-p2p.py',
     'invalidblockrequest.py',
@@ -112,6 +113,8 @@ BASE_SCRIPTS= [
     'p2p_txexpiry_dos.py',
     'p2p_txexpiringsoon.py',
     'p2p_node_bloom.py',
+    'p2p_message_handler.py',
+    'p2p_compactblocks.py',
     'regtest_signrawtransaction.py',
     'shorter_block_times.py',
     'mining_shielded_coinbase.py',
@@ -88,6 +88,8 @@ class AddressIndexTest(BitcoinTestFramework):
                 bal = self.nodes[node_index].getaddressbalance({'addresses': address})
             else:
                 bal = self.nodes[node_index].getaddressbalance(address)
+                # the balance index counts the transactions of the address
+                assert_equal(bal['txcount'], len(self.nodes[node_index].getaddresstxids(address)))
             assert_equal(bal['balance'], expected_balance)
             if expected_received is None:
                 expected_received = expected_balance
@@ -169,6 +171,7 @@ class AddressIndexTest(BitcoinTestFramework):
         bal = self.nodes[1].getaddressbalance(addr1)
         assert_equal(bal['balance'], expected * COIN)
         assert_equal(bal['received'], expected * COIN)
+        assert_equal(bal['txcount'], len(txids_a1))
         assert_equal(sorted(self.nodes[0].getaddresstxids(addr1)), sorted(txids_a1))
         assert_equal(sorted(self.nodes[1].getaddresstxids(addr1)), sorted(txids_a1))
 
@@ -337,6 +340,39 @@ class AddressIndexTest(BitcoinTestFramework):
         block_hash = self.nodes[1].getblockhash(111)
         assert_equal(deltas_info['end']['hash'], block_hash)
 
+        # Paging through the deltas of several addresses returns all of
+        # them, in order, whatever the page size
+        all_deltas = self.nodes[1].getaddressdeltas({'addresses': [addr1, addr_p2pkh]})
+        for limit in (1, 2, 7, len(all_deltas), len(all_deltas) + 1):
+            paged, after = [], None
+            while True:
+                params = {'addresses': [addr1, addr_p2pkh], 'limit': limit}
+                if after is not None:
+                    params['after'] = after
+                page = self.nodes[1].getaddressdeltas(params)
+                assert(len(page['deltas']) <= limit)
+                paged += page['deltas']
+                after = page['next']
+                if after is None:
+                    break
+            assert_equal(paged, all_deltas)
+
+        # Paging through txids of several addresses, within a height range
+        all_txids = getaddresstxids(1, [addr1, addr_p2pkh], 1, 111)
+        for limit in (1, 2, 5, len(all_txids)):
+            paged, after = [], None
+            while True:
+                params = {'addresses': [addr1, addr_p2pkh], 'start': 1, 'end': 111, 'limit': limit}
+                if after is not None:
+                    params['after'] = after
+                page = self.nodes[1].getaddresstxids(params)
+                assert(len(page['txids']) <= limit)
+                paged += page['txids']
+                after = page['next']
+                if after is None:
+                    break
+            assert_equal(paged, all_txids)
+
         # Test getaddressutxos by comparing results with deltas
         utxos = self.nodes[3].getaddressutxos(addr1)
 
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Koto developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, check_node_log, \
+    connect_nodes_bi, start_node, start_nodes, stop_node, sync_blocks, \
+    sync_mempools
+
+
+class CompactBlocksTest(BitcoinTestFramework):
+    '''
+    Test that blocks are relayed between two nodes as compact blocks, and
+    rebuilt from the receiving node's mempool, asking for any missing
+    transactions with "getblocktxn".
+    '''
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir,
+                                 extra_args=[['-debug=net']] * self.num_nodes)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_test(self):
+        # An empty block; node 1 will now ask node 0 to announce blocks to
+        # it as compact blocks.
+        self.nodes[0].generate(1)
+        sync_blocks(self.nodes)
+
+        # Every transaction in the block is in node 1's mempool, so the block
+        # is rebuilt without another round trip.
+        for i in range(5):
+            self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1)
+        sync_mempools(self.nodes)
+        blockhash = self.nodes[0].generate(1)[0]
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[1].getbestblockhash(), blockhash)
+        check_node_log(self, 1,
+            "Successfully reconstructed block %s with 1 txn prefilled, 5 txn from mempool (incl at least 0 from extra pool) and 0 txn requested" % blockhash,
+            False)
+
+        # In blocks-only mode node 1 doesn't accept relayed transactions, so
+        # it has to fetch them with "getblocktxn".
+        stop_node(self.nodes[1], 1)
+        self.nodes[1] = start_node(1, self.options.tmpdir, ['-debug=net', '-blocksonly'])
+        connect_nodes_bi(self.nodes, 0, 1)
+        for i in range(3):
+            self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1)
+        blockhash = self.nodes[0].generate(1)[0]
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[1].getbestblockhash(), blockhash)
+        assert_equal(self.nodes[1].getblock(blockhash)['tx'], self.nodes[0].getblock(blockhash)['tx'])
+        check_node_log(self, 1,
+            "Successfully reconstructed block %s with 1 txn prefilled, 0 txn from mempool (incl at least 0 from extra pool) and 3 txn requested" % blockhash,
+            False)
+
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Koto developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+from test_framework.mininode import NodeConn, NodeConnCB, NetworkThread, \
+    CInv, msg_getdata, msg_ping, mininode_lock, SAPLING_PROTO_VERSION
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, p2p_port, start_node, \
+    stop_node
+
+import time
+
+NUM_PINGERS = 8
+NUM_PINGS = 20
+NUM_ROUNDS = 10
+NUM_BLOCKS = 50
+
+
+class TestNode(NodeConnCB):
+    def __init__(self):
+        NodeConnCB.__init__(self)
+        self.create_callback_map()
+        self.connection = None
+        self.blocks_received = 0
+        self.ping_sent = {}
+        self.ping_times = []
+
+    def add_connection(self, conn):
+        self.connection = conn
+
+    def wait_for_verack(self):
+        while True:
+            with mininode_lock:
+                if self.verack_received:
+                    return
+            time.sleep(0.05)
+
+    def send_message(self, message):
+        self.connection.send_message(message)
+
+    def send_ping(self, nonce):
+        with mininode_lock:
+            self.ping_sent[nonce] = time.time()
+        self.send_message(msg_ping(nonce))
+
+    def on_pong(self, conn, message):
+        sent = self.ping_sent.pop(message.nonce, None)
+        if sent is not None:
+            self.ping_times.append(time.time() - sent)
+
+    def on_block(self, conn, message):
+        self.blocks_received += 1
+
+    def on_close(self, conn):
+        pass
+
+
+def wait_until(predicate, timeout=60):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        with mininode_lock:
+            if predicate():
+                return
+        time.sleep(0.01)
+    raise AssertionError("Timed out waiting")
+
+
+class MessageHandlerTest(BitcoinTestFramework):
+    '''
+    Have one peer download a block many times while several others ping the
+    node, and measure the ping round trips with one and with several message
+    handler threads.
+    '''
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def setup_network(self, split=False):
+        self.nodes = [start_node(0, self.options.tmpdir)]
+        self.is_network_split = False
+
+    def measure(self, hashes):
+        downloader = TestNode()
+        pingers = [TestNode() for _ in range(NUM_PINGERS)]
+        connections = []
+        for test_node in [downloader] + pingers:
+            conn = NodeConn('127.0.0.1', p2p_port(0), self.nodes[0], test_node,
+                            "regtest", SAPLING_PROTO_VERSION)
+            test_node.add_connection(conn)
+            connections.append(conn)
+        network_thread = NetworkThread()
+        network_thread.start()
+        for test_node in [downloader] + pingers:
+            test_node.wait_for_verack()
+
+        start = time.time()
+        for _ in range(NUM_ROUNDS):
+            request = msg_getdata()
+            request.inv = [CInv(2, int(h, 16)) for h in hashes]
+            downloader.send_message(request)
+
+        for i in range(NUM_PINGS):
+            for test_node in pingers:
+                test_node.send_ping(i + 1)
+            wait_until(lambda: all(len(p.ping_sent) == 0 for p in pingers))
+
+        wait_until(lambda: downloader.blocks_received == NUM_ROUNDS * len(hashes))
+        elapsed = time.time() - start
+
+        with mininode_lock:
+            ping_times = sorted(t for p in pingers for t in p.ping_times)
+        assert_equal(len(ping_times), NUM_PINGERS * NUM_PINGS)
+
+        [c.disconnect_node() for c in connections]
+        network_thread.join()
+        return elapsed, ping_times[len(ping_times) // 2], ping_times[-1]
+
+    def run_test(self):
+        # The genesis block is requested over and over rather than mining
+        # blocks to serve, which regtest cannot do with the consensus
+        # yespower parameters; the node serves each request all the same.
+        hashes = [self.nodes[0].getblockhash(0)] * NUM_BLOCKS
+
+        for threads in [1, 4]:
+            stop_node(self.nodes[0], 0)
+            self.nodes[0] = start_node(0, self.options.tmpdir, ['-messagethreads=%d' % threads])
+            elapsed, median, worst = self.measure(hashes)
+            print("-messagethreads=%d: served %d blocks in %.3fs, ping median %.1fms, max %.1fms" %
+                  (threads, NUM_ROUNDS * len(hashes), elapsed, median * 1000, worst * 1000))
+
+
+if __name__ == '__main__':
+    MessageHandlerTest().main()
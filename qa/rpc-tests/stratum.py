@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Koto developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+import json
+import socket
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, rpc_port, start_nodes, \
+    PORT_RANGE
+
+
+def stratum_port(n):
+    return rpc_port(n) + PORT_RANGE
+
+
+class StratumClient(object):
+    '''
+    Minimal line-delimited JSON client standing in for a pool miner.
+    '''
+
+    def __init__(self, port):
+        self.sock = socket.create_connection(('127.0.0.1', port), timeout=60)
+        self.buf = b''
+        self.next_id = 1
+        self.notifications = []
+
+    def read_message(self):
+        while b'\n' not in self.buf:
+            data = self.sock.recv(4096)
+            assert(data)
+            self.buf += data
+        line, self.buf = self.buf.split(b'\n', 1)
+        return json.loads(line.decode())
+
+    def request(self, method, params):
+        request_id = self.next_id
+        self.next_id += 1
+        line = json.dumps({'id': request_id, 'method': method, 'params': params}) + '\n'
+        self.sock.sendall(line.encode())
+        while True:
+            msg = self.read_message()
+            if msg.get('method') is not None:
+                self.notifications.append(msg)
+            elif msg['id'] == request_id:
+                return msg
+
+    def wait_for_notification(self, method):
+        while True:
+            while self.notifications:
+                msg = self.notifications.pop(0)
+                if msg['method'] == method:
+                    return msg['params']
+            self.notifications.append(self.read_message())
+
+    def close(self):
+        self.sock.close()
+
+
+class StratumTest(BitcoinTestFramework):
+    '''
+    Test the Stratum work server.
+    '''
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def setup_network(self, split=False):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[[
+            '-stratum',
+            '-stratumport=%d' % stratum_port(0),
+            '-stratumpassword=secret',
+            '-debug=stratum',
+        ]])
+        self.is_network_split = False
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101) # Leave initial block download with a spendable coinbase
+
+        client = StratumClient(stratum_port(0))
+        reply = client.request('mining.subscribe', ['stratum-test'])
+        assert_equal(reply['error'], None)
+        subscriptions, extranonce1, extranonce2_size = reply['result']
+        assert_equal(subscriptions[0][0], 'mining.notify')
+        assert_equal(len(extranonce1), 2)
+        assert_equal(extranonce2_size, 3)
+        prefix = int(extranonce1, 16)
+
+        reply = client.request('mining.submit', ['worker', '0', '00000000', '00000000'])
+        assert_equal(reply['error'][0], 24) # Not authorized yet
+        reply = client.request('mining.authorize', ['worker', 'x'])
+        assert_equal(reply['error'][0], 24) # Wrong password
+        reply = client.request('mining.authorize', ['worker', 'secret'])
+        assert_equal(reply['result'], True)
+
+        target = client.wait_for_notification('mining.set_target')
+        assert_equal(len(target[0]), 64)
+
+        job_id, header, coinbase, branch, ntime, clean = client.wait_for_notification('mining.notify')
+        assert_equal(clean, True)
+        assert(len(header) in (2 * 80, 2 * 112))
+        assert_equal(header[2*68:2*72], bytes.fromhex(ntime)[::-1].hex())
+        assert_equal(header[2*76:2*80], '00000000')
+        assert_equal(branch, [])
+
+        # An unknown job id and a nonce outside the assigned range are rejected.
+        reply = client.request('mining.submit', ['worker', 'ffff', ntime, '%08x' % (prefix << 24)])
+        assert_equal(reply['error'][0], 21)
+        reply = client.request('mining.submit', ['worker', job_id, ntime, '%08x' % (((prefix + 1) % 256) << 24)])
+        assert_equal(reply['error'][0], 20)
+
+        # The regtest target is easy enough to find a block by walking the
+        # nonce range; every share meeting it is also a block.
+        start_count = node.getblockcount()
+        found = None
+        i = 0
+        while i < 4096:
+            nonce = '%08x' % ((prefix << 24) | i)
+            reply = client.request('mining.submit', ['worker', job_id, ntime, nonce])
+            if reply['result'] is True:
+                found = nonce
+                break
+            if reply['error'][0] == 20:
+                # Throttled; the share was not checked, so try it again
+                time.sleep(1)
+                continue
+            i += 1
+            if reply['error'][0] == 21:
+                # Raced with the job for the last generated block
+                job_id, _, _, _, ntime, _ = client.wait_for_notification('mining.notify')
+                continue
+            assert_equal(reply['error'][0], 23)
+        assert(found is not None)
+
+        # The block was submitted and the next job cleans out the old ones.
+        params = client.wait_for_notification('mining.notify')
+        assert(params[0] != job_id)
+        assert_equal(params[5], True)
+        assert_equal(node.getblockcount(), start_count + 1)
+
+        reply = client.request('mining.submit', ['worker', job_id, ntime, found])
+        assert_equal(reply['error'][0], 21)
+
+        # Mempool changes are picked up without clearing the current jobs.
+        node.sendtoaddress(node.getnewaddress(), 1)
+        params = client.wait_for_notification('mining.notify')
+        assert_equal(params[5], False)
+        assert_equal(len(params[3]), 1)
+
+        # Every subscribed client gets a different prefix, and subscriptions
+        # are refused once all 256 are taken.
+        others = []
+        prefixes = set([prefix])
+        for i in range(255):
+            other = StratumClient(stratum_port(0))
+            reply = other.request('mining.subscribe', ['stratum-test'])
+            assert_equal(reply['error'], None)
+            prefixes.add(int(reply['result'][1], 16))
+            others.append(other)
+        assert_equal(len(prefixes), 256)
+
+        extra = StratumClient(stratum_port(0))
+        reply = extra.request('mining.subscribe', ['stratum-test'])
+        assert_equal(reply['error'][0], 20)
+
+        # A prefix becomes free again when its client disconnects.
+        released = others.pop()
+        reply = released.request('mining.subscribe', ['stratum-test'])
+        assert_equal(reply['error'], None) # Already subscribed, keeps its prefix
+        released_prefix = reply['result'][1]
+        released.close()
+        while True:
+            reply = extra.request('mining.subscribe', ['stratum-test'])
+            if reply['error'] is None:
+                break
+            assert_equal(reply['error'][0], 20) # Disconnect not processed yet
+        assert_equal(reply['result'][1], released_prefix)
+
+        extra.close()
+        for other in others:
+            other.close()
+        client.close()
+
+
+if __name__ == '__main__':
+    StratumTest().main()
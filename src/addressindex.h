@@ -222,6 +222,37 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+// Running totals of the address index entries of an address, keyed by
+// CAddressIndexIteratorKey.
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    int64_t txCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txCount);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+    }
+
+    bool IsNull() const {
+        return balance == 0 && received == 0 && txCount == 0;
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
@@ -4,9 +4,11 @@
 
 #include "bench.h"
 
+#include "crypto/sha256.h"
 #include "fs.h"
 #include "key.h"
 #include "main.h"
+#include "script/sigcache.h"
 #include "util.h"
 
 #include "librustzcash.h"
@@ -16,10 +18,12 @@ const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
 int
 main(int argc, char** argv)
 {
+    SHA256AutoDetect();
     ECC_Start();
     auto globalVerifyHandle = new ECCVerifyHandle();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    InitSignatureCache();
 
     fs::path sapling_spend = ZC_GetParamsDir() / "sapling-spend.params";
     fs::path sapling_output = ZC_GetParamsDir() / "sapling-output.params";
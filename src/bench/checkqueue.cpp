@@ -20,7 +20,7 @@ static const size_t BATCHES = 101;
 static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const unsigned int QUEUE_BATCH_SIZE = 128;
-static void CCheckQueueSpeed(benchmark::State& state)
+static void CCheckQueueSpeedThreads(benchmark::State& state, int nThreads)
 {
     struct FakeJobNoWork {
         bool operator()()
@@ -31,7 +31,7 @@ static void CCheckQueueSpeed(benchmark::State& state)
     };
     CCheckQueue<FakeJobNoWork> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    for (auto x = 0; x < nThreads; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
@@ -58,6 +58,28 @@ static void CCheckQueueSpeed(benchmark::State& state)
     tg.join_all();
 }
 
+static void CCheckQueueSpeed(benchmark::State& state)
+{
+    CCheckQueueSpeedThreads(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+// The same with fixed numbers of workers, to see how contention grows with
+// them on a machine with enough cores.
+static void CCheckQueueSpeed4Threads(benchmark::State& state)
+{
+    CCheckQueueSpeedThreads(state, 4);
+}
+
+static void CCheckQueueSpeed16Threads(benchmark::State& state)
+{
+    CCheckQueueSpeedThreads(state, 16);
+}
+
+static void CCheckQueueSpeed64Threads(benchmark::State& state)
+{
+    CCheckQueueSpeedThreads(state, 64);
+}
+
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
@@ -100,4 +122,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeed);
+BENCHMARK(CCheckQueueSpeed4Threads);
+BENCHMARK(CCheckQueueSpeed16Threads);
+BENCHMARK(CCheckQueueSpeed64Threads);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
@@ -0,0 +1,85 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+
+#include "coins.h"
+#include "main.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/script.h"
+
+#include <vector>
+
+static const int FUNDING_TXS = 2000;
+static const int FUNDING_OUTPUTS = 10;
+static const int REPLAY_BLOCKS = 100;
+static const int TXS_PER_BLOCK = 500;
+
+// Builds a range of blocks in which every transaction spends two random
+// unspent outputs of earlier blocks and creates two new ones, preceded by a
+// block of coinbase-like transactions that fund them.
+static std::vector<std::vector<CTransaction>> BuildBlockRange()
+{
+    FastRandomContext rng(true);
+    std::vector<std::vector<CTransaction>> vBlocks(REPLAY_BLOCKS + 1);
+    std::vector<COutPoint> vUnspent;
+
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0x42) << OP_EQUALVERIFY << OP_CHECKSIG;
+    for (int i = 0; i < FUNDING_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << i << OP_0;
+        for (int n = 0; n < FUNDING_OUTPUTS; n++)
+            tx.vout.push_back(CTxOut(1000, scriptPubKey));
+        CTransaction ctx(tx);
+        for (int n = 0; n < FUNDING_OUTPUTS; n++)
+            vUnspent.push_back(COutPoint(ctx.GetHash(), n));
+        vBlocks[0].push_back(ctx);
+    }
+
+    for (int nBlock = 1; nBlock <= REPLAY_BLOCKS; nBlock++) {
+        for (int i = 0; i < TXS_PER_BLOCK; i++) {
+            CMutableTransaction tx;
+            for (int n = 0; n < 2; n++) {
+                size_t nPos = rng.randrange(vUnspent.size());
+                tx.vin.push_back(CTxIn(vUnspent[nPos]));
+                vUnspent[nPos] = vUnspent.back();
+                vUnspent.pop_back();
+            }
+            tx.vout.push_back(CTxOut(1000, scriptPubKey));
+            tx.vout.push_back(CTxOut(1000, scriptPubKey));
+            CTransaction ctx(tx);
+            vUnspent.push_back(COutPoint(ctx.GetHash(), 0));
+            vUnspent.push_back(COutPoint(ctx.GetHash(), 1));
+            vBlocks[nBlock].push_back(ctx);
+        }
+    }
+    return vBlocks;
+}
+
+// Replays the block range into an empty coins cache, looking up and
+// updating the coins of each transaction the way ConnectBlock does, with a
+// per-block cache flushed into the tip cache.
+static void CoinsCacheReplayBlocks(benchmark::State& state)
+{
+    const std::vector<std::vector<CTransaction>> vBlocks = BuildBlockRange();
+
+    while (state.KeepRunning()) {
+        CCoinsView viewDummy;
+        CCoinsViewCache viewTip(&viewDummy);
+        for (size_t nHeight = 0; nHeight < vBlocks.size(); nHeight++) {
+            CCoinsViewCache view(&viewTip);
+            for (const CTransaction& tx : vBlocks[nHeight]) {
+                bool fHaveInputs = tx.IsCoinBase() || view.HaveInputs(tx);
+                assert(fHaveInputs);
+                UpdateCoins(tx, view, nHeight);
+            }
+            bool fFlushed = view.Flush();
+            assert(fFlushed);
+        }
+    }
+}
+
+BENCHMARK(CoinsCacheReplayBlocks);
@@ -0,0 +1,86 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/upgrades.h"
+#include "fs.h"
+#include "main.h"
+#include "miner.h"
+#include "random.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <boost/shared_ptr.hpp>
+
+// Builds templates from a 50,000 transaction mempool, about half again what fits in
+// a block. The transactions spend anyone-can-spend coins written straight to
+// the UTXO set; every tenth one spends the previous transaction instead, and
+// every fiftieth one is valuable enough to qualify for the priority area.
+static void CreateNewBlock50k(benchmark::State& state)
+{
+    const int nTransactions = 50000;
+
+    SelectParams(CBaseChainParams::REGTEST);
+    const CChainParams& chainparams = Params();
+
+    ClearDatadirCache();
+    fs::path pathTemp = fs::temp_directory_path() / strprintf("bench_bitcoin_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+    fs::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    CCoinsViewDB* pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    InitBlockIndex(chainparams);
+
+    const CScript scriptTrue = CScript() << OP_TRUE;
+    uint32_t consensusBranchId = CurrentEpochBranchId(1, chainparams.GetConsensus());
+
+    CMutableTransaction funding;
+    for (int i = 0; i < nTransactions; i++) {
+        funding.vout.push_back(CTxOut((i % 50 == 0 ? 100 : 1) * COIN, scriptTrue));
+    }
+    const CTransaction txFunding(funding);
+    pcoinsTip->ModifyCoins(txFunding.GetHash())->FromTx(txFunding, 0);
+
+    {
+        LOCK(mempool.cs);
+        uint256 hashPrev;
+        for (int i = 0; i < nTransactions; i++) {
+            CAmount nFee = 1000 + (i * 7919) % 10000;
+            CMutableTransaction mtx = CreateNewContextualCMutableTransaction(chainparams.GetConsensus(), 1);
+            mtx.vin.resize(1);
+            bool fChild = (i % 10 == 9);
+            mtx.vin[0].prevout = fChild ? COutPoint(hashPrev, 0) : COutPoint(txFunding.GetHash(), i);
+            CAmount nValueIn = fChild ? mempool.mapTx.find(hashPrev)->GetTx().vout[0].nValue : txFunding.vout[i].nValue;
+            mtx.vout.push_back(CTxOut(nValueIn - nFee, scriptTrue));
+            const CTransaction tx(mtx);
+            hashPrev = tx.GetHash();
+            mempool.addUnchecked(hashPrev, CTxMemPoolEntry(tx, nFee, GetTime(), 0, 0, !fChild, false, 1, consensusBranchId));
+        }
+    }
+
+    boost::shared_ptr<CReserveScript> coinbaseScript(new CReserveScript());
+    coinbaseScript->reserveScript = scriptTrue;
+    MinerAddress minerAddress = coinbaseScript;
+
+    while (state.KeepRunning()) {
+        std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(chainparams, minerAddress));
+        assert(pblocktemplate->block.vtx.size() > 1);
+    }
+
+    mempool.clear();
+    UnloadBlockIndex();
+    delete pcoinsTip;
+    pcoinsTip = NULL;
+    delete pcoinsdbview;
+    delete pblocktree;
+    pblocktree = NULL;
+    fs::remove_all(pathTemp);
+}
+
+BENCHMARK(CreateNewBlock50k);
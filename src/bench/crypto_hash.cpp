@@ -40,6 +40,24 @@ static void SHA256(benchmark::State& state)
         CSHA256().Write(begin_ptr(in), in.size()).Finalize(hash);
 }
 
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32,0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000000; i++) {
+            CSHA256().Write(begin_ptr(in), in.size()).Finalize(&in[0]);
+        }
+    }
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(&in[0], &in[0], 1024);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -73,6 +91,8 @@ static void FastRandom_1bit(benchmark::State& state)
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
+BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
 BENCHMARK(SHA512);
 
 BENCHMARK(FastRandom_32bit);
@@ -0,0 +1,96 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "dbwrapper.h"
+#include "fs.h"
+#include "random.h"
+#include "txdb.h"
+#include "uint256.h"
+#include "utiltime.h"
+
+static const size_t DB_CACHE_SIZE = 8 << 20;
+static const int PREFILL_ENTRIES = 200000;
+static const int BATCH_ENTRIES = 1000;
+
+// Address index style keys: entries for one address sort together, and
+// addresses are spread randomly over the key space.
+static std::pair<uint256, int> MakeKey(FastRandomContext& rng, int nAddresses)
+{
+    uint256 hashAddress;
+    *(uint32_t*)hashAddress.begin() = rng.randrange(nAddresses);
+    return std::make_pair(hashAddress, (int)rng.randrange(1 << 20));
+}
+
+static fs::path GetBenchDBPath(const std::string& strName)
+{
+    return fs::temp_directory_path() / strprintf("bench_bitcoin_%s_%lu_%i", strName, (unsigned long)GetTime(), (int)GetRand(100000));
+}
+
+// Each iteration writes a batch of new entries.
+static void DBWrite(benchmark::State& state, const CDBProfile& profile)
+{
+    FastRandomContext rng(true);
+    fs::path path = GetBenchDBPath("dbwrite");
+    {
+        CDBWrapper db(path, DB_CACHE_SIZE, false, true, profile);
+        while (state.KeepRunning()) {
+            CDBBatch batch(db);
+            for (int i = 0; i < BATCH_ENTRIES; i++)
+                batch.Write(MakeKey(rng, PREFILL_ENTRIES / 10), rng.rand64());
+            db.WriteBatch(batch);
+        }
+    }
+    fs::remove_all(path);
+}
+
+// Each iteration looks up a batch of entries, most of which are present.
+static void DBRead(benchmark::State& state, const CDBProfile& profile)
+{
+    FastRandomContext rng(true);
+    fs::path path = GetBenchDBPath("dbread");
+    {
+        CDBWrapper db(path, DB_CACHE_SIZE, false, true, profile);
+        for (int n = 0; n < PREFILL_ENTRIES; n += BATCH_ENTRIES) {
+            CDBBatch batch(db);
+            for (int i = 0; i < BATCH_ENTRIES; i++)
+                batch.Write(std::make_pair(ArithToUint256(n + i), 0), rng.rand64());
+            db.WriteBatch(batch);
+        }
+
+        uint64_t value;
+        while (state.KeepRunning()) {
+            for (int i = 0; i < BATCH_ENTRIES; i++)
+                db.Read(std::make_pair(ArithToUint256(rng.randrange(PREFILL_ENTRIES * 5 / 4)), 0), value);
+        }
+    }
+    fs::remove_all(path);
+}
+
+static void DBWriteChainstateProfile(benchmark::State& state)
+{
+    DBWrite(state, GetChainstateDBProfile());
+}
+
+static void DBWriteBlockIndexProfile(benchmark::State& state)
+{
+    DBWrite(state, GetBlockIndexDBProfile());
+}
+
+static void DBReadChainstateProfile(benchmark::State& state)
+{
+    DBRead(state, GetChainstateDBProfile());
+}
+
+static void DBReadBlockIndexProfile(benchmark::State& state)
+{
+    DBRead(state, GetBlockIndexDBProfile());
+}
+
+BENCHMARK(DBWriteChainstateProfile);
+BENCHMARK(DBWriteBlockIndexProfile);
+BENCHMARK(DBReadChainstateProfile);
+BENCHMARK(DBReadBlockIndexProfile);
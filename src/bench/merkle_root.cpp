@@ -0,0 +1,45 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+#include "primitives/block.h"
+#include "script/script.h"
+
+static CBlock BlockWithTransactions(size_t nTx)
+{
+    CBlock block;
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].scriptSig = CScript() << i;
+        block.vtx.push_back(CTransaction(mtx));
+    }
+    return block;
+}
+
+// Build the whole tree, as CheckBlock does for a large block.
+static void MerkleRoot(benchmark::State& state)
+{
+    CBlock block = BlockWithTransactions(10000);
+    while (state.KeepRunning()) {
+        block.BuildMerkleTree();
+    }
+}
+
+// Replace the coinbase, as IncrementExtraNonce does for every extra nonce.
+static void MerkleRootUpdateCoinbase(benchmark::State& state)
+{
+    CBlock block = BlockWithTransactions(10000);
+    block.BuildMerkleTree();
+    CMutableTransaction coinbase(block.vtx[0]);
+    int64_t nExtraNonce = 0;
+    while (state.KeepRunning()) {
+        coinbase.vin[0].scriptSig = CScript() << ++nExtraNonce;
+        block.vtx[0] = coinbase;
+        block.UpdateMerkleTree(0);
+    }
+}
+
+BENCHMARK(MerkleRoot);
+BENCHMARK(MerkleRootUpdateCoinbase);
@@ -0,0 +1,77 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+
+#include "key.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+static const int SIGCACHE_ENTRIES = 1000;
+
+// Times cached signature lookups on the main thread while other threads hammer
+// the same cache with lookups of their own, as script check threads do when a
+// block full of already-seen transactions is connected.
+static void SigCacheLookupContention(benchmark::State& state, int nThreads)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+
+    std::vector<uint256> vSighash(SIGCACHE_ENTRIES);
+    std::vector<std::vector<unsigned char>> vSig(SIGCACHE_ENTRIES);
+    for (int i = 0; i < SIGCACHE_ENTRIES; i++) {
+        vSighash[i] = GetRandHash();
+        bool fSigned = key.Sign(vSighash[i], vSig[i]);
+        assert(fSigned);
+    }
+
+    CTransaction tx;
+    PrecomputedTransactionData txdata(tx);
+    const CachingTransactionSignatureChecker checker(&tx, 0, 0, true, txdata);
+    for (int i = 0; i < SIGCACHE_ENTRIES; i++) {
+        bool fValid = checker.VerifySignature(vSig[i], pubkey, vSighash[i]);
+        assert(fValid);
+    }
+
+    std::atomic<bool> fStop(false);
+    boost::thread_group threadGroup;
+    for (int n = 0; n < nThreads; n++) {
+        threadGroup.create_thread([&, n] {
+            for (int i = n; !fStop; i = (i + 1) % SIGCACHE_ENTRIES) {
+                checker.VerifySignature(vSig[i], pubkey, vSighash[i]);
+            }
+        });
+    }
+
+    int i = 0;
+    while (state.KeepRunning()) {
+        bool fValid = checker.VerifySignature(vSig[i], pubkey, vSighash[i]);
+        assert(fValid);
+        i = (i + 1) % SIGCACHE_ENTRIES;
+    }
+
+    fStop = true;
+    threadGroup.join_all();
+}
+
+static void SigCacheLookupContention16Threads(benchmark::State& state)
+{
+    SigCacheLookupContention(state, 16);
+}
+
+static void SigCacheLookupContention64Threads(benchmark::State& state)
+{
+    SigCacheLookupContention(state, 64);
+}
+
+BENCHMARK(SigCacheLookupContention16Threads);
+BENCHMARK(SigCacheLookupContention64Threads);
@@ -92,7 +92,7 @@ static void JoinSplitSig(benchmark::State& state)
     }
 }
 
-static void SaplingSpend(benchmark::State& state)
+static SpendDescription BenchSpend()
 {
     SpendDescription spend;
     CDataStream ss(
@@ -100,6 +100,12 @@ static void SaplingSpend(benchmark::State& state)
         SER_NETWORK,
         PROTOCOL_VERSION);
     ss >> spend;
+    return spend;
+}
+
+static void SaplingSpend(benchmark::State& state)
+{
+    SpendDescription spend = BenchSpend();
     uint256 dataToBeSigned = uint256S("0x2dbf83fe7b88a7cbd80fac0c719483906bb9a0c4fc69071e4780d5f2c76e592c");
 
     auto ctx = librustzcash_sapling_verification_ctx_init(true);
@@ -119,6 +125,33 @@ static void SaplingSpend(benchmark::State& state)
     librustzcash_sapling_verification_ctx_free(ctx);
 }
 
+// Checks the same spend as SaplingSpend, queued into a batch of 64 proofs the
+// size of a shielded-heavy block.
+static void SaplingSpendBatch64(benchmark::State& state)
+{
+    SpendDescription spend = BenchSpend();
+    uint256 dataToBeSigned = uint256S("0x2dbf83fe7b88a7cbd80fac0c719483906bb9a0c4fc69071e4780d5f2c76e592c");
+
+    while (state.KeepRunning()) {
+        auto batch = librustzcash_sapling_proof_batch_init();
+        auto ctx = librustzcash_sapling_batch_verification_ctx_init(true, batch);
+        for (int i = 0; i < 64; i++) {
+            librustzcash_sapling_check_spend(
+                ctx,
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                dataToBeSigned.begin());
+        }
+        librustzcash_sapling_verification_ctx_free(ctx);
+        librustzcash_sapling_proof_batch_validate(batch);
+        librustzcash_sapling_proof_batch_free(batch);
+    }
+}
+
 static void SaplingOutput(benchmark::State& state)
 {
     OutputDescription output;
@@ -145,4 +178,5 @@ static void SaplingOutput(benchmark::State& state)
 BENCHMARK(ECDSA);
 BENCHMARK(JoinSplitSig);
 BENCHMARK(SaplingSpend);
+BENCHMARK(SaplingSpendBatch64);
 BENCHMARK(SaplingOutput);
@@ -0,0 +1,350 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "chainparamsbase.h"
+#include "clientversion.h"
+#include "fs.h"
+#include "primitives/block.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "yespower.h"
+
+#include <univalue.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+/** Number of nonces a search thread takes at a time; progress is checkpointed in whole chunks */
+static const uint64_t GENESIS_CHUNK_SIZE = 4096;
+static const unsigned int DEFAULT_GENESIS_LANES = 1;
+static const int64_t DEFAULT_GENESIS_CHECKPOINT_INTERVAL = 60;
+
+static const int CONTINUE_EXECUTION=-1;
+
+const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
+
+/**
+ * A search covers the nonce space of nTimeStart, then that of nTimeStart + 1,
+ * and so on. Positions count nonces from the start of the search, so the
+ * time is nTimeStart + (position >> 32) and the nonce the low 32 bits.
+ */
+struct GenesisSearch
+{
+    CBlockHeader header;
+    uint32_t nTimeStart;
+    arith_uint256 hashTarget;
+    unsigned int nLanes;
+
+    std::atomic<uint64_t> nNextChunk{0};
+    //! Chunk each thread is searching, or UINT64_MAX when it is idle
+    std::vector<std::atomic<uint64_t>> vThreadChunk;
+    std::atomic<uint64_t> nHashes{0};
+    std::atomic<bool> fStop{false};
+
+    std::mutex cs;
+    bool fFound = false;
+    uint64_t nFoundPosition = 0;
+    uint256 hashPoW;
+
+    explicit GenesisSearch(int nThreads) : vThreadChunk(nThreads) {}
+
+    //! Every position below this one has been searched.
+    uint64_t GetSearchedPosition() const
+    {
+        uint64_t nChunk = nNextChunk;
+        for (const auto& chunk : vThreadChunk)
+            nChunk = std::min<uint64_t>(nChunk, chunk);
+        return nChunk * GENESIS_CHUNK_SIZE;
+    }
+};
+
+static volatile sig_atomic_t fRequestShutdown = false;
+
+static void HandleSIGTERM(int)
+{
+    fRequestShutdown = true;
+}
+
+static int AppInitGenesis(int argc, char* argv[])
+{
+    //
+    // Parameters
+    //
+    ParseParameters(argc, argv);
+
+    // Check for -testnet or -regtest parameter (Params() calls are only valid after this clause)
+    try {
+        SelectParams(ChainNameFromCommandLine());
+    } catch(std::exception &e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help"))
+    {
+        std::string strUsage = _("Koto koto-genesis utility version") + " " + FormatFullVersion() + "\n\n" +
+            _("Usage:") + "\n" +
+              "  koto-genesis [options]  " + _("Search for a genesis block nonce for the selected chain") + "\n" +
+              "\n" +
+            _("The genesis coinbase of the selected chain is kept; its time, bits and version can be overridden.") + "\n" +
+            _("When every nonce of a time has been tried, the search moves on to the next second.") + "\n" +
+            _("The result is written to standard output as a JSON object, and progress to standard error.") + "\n" +
+              "\n";
+
+        fprintf(stdout, "%s", strUsage.c_str());
+
+        strUsage = HelpMessageGroup(_("Options:"));
+        strUsage += HelpMessageOpt("-?", _("This help message"));
+        strUsage += HelpMessageOpt("-bits=<hex>", _("Compact target of the genesis block (default: that of the selected chain)"));
+        strUsage += HelpMessageOpt("-checkpoint=<file>", _("Resume the search from <file> if it exists, and record progress in it"));
+        strUsage += HelpMessageOpt("-checkpointinterval=<n>", strprintf(_("Seconds between checkpoint writes (default: %d)"), DEFAULT_GENESIS_CHECKPOINT_INTERVAL));
+        strUsage += HelpMessageOpt("-lanes=<n>", strprintf(_("Number of nonces each thread hashes together (1 to %u, default: %u)"), YESPOWER_MAX_LANES, DEFAULT_GENESIS_LANES));
+        strUsage += HelpMessageOpt("-threads=<n>", _("Number of search threads (default: number of cores)"));
+        strUsage += HelpMessageOpt("-time=<n>", _("Time to start the search at (default: that of the selected chain's genesis block)"));
+        strUsage += HelpMessageOpt("-version=<n>", _("Version of the genesis block (default: that of the selected chain)"));
+        AppendParamsHelpMessages(strUsage);
+
+        fprintf(stdout, "%s", strUsage.c_str());
+        return EXIT_SUCCESS;
+    }
+    return CONTINUE_EXECUTION;
+}
+
+static UniValue SearchParameters(const GenesisSearch& search)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("chain", Params().NetworkIDString());
+    obj.pushKV("version", search.header.nVersion);
+    obj.pushKV("merkleroot", search.header.hashMerkleRoot.GetHex());
+    obj.pushKV("bits", strprintf("%08x", search.header.nBits));
+    obj.pushKV("starttime", (uint64_t)search.nTimeStart);
+    return obj;
+}
+
+static void ReadCheckpoint(const fs::path& path, GenesisSearch& search)
+{
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file)
+        return;
+    std::string str;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        str.append(buf, n);
+    fclose(file);
+
+    UniValue checkpoint;
+    if (!checkpoint.read(str) || !checkpoint.isObject())
+        throw std::runtime_error(strprintf("Cannot parse checkpoint %s", path.string()));
+    UniValue params = SearchParameters(search);
+    for (const std::string& key : params.getKeys()) {
+        if (find_value(checkpoint, key).write() != find_value(params, key).write()) {
+            throw std::runtime_error(strprintf("Checkpoint %s was written for a different search (%s differs)",
+                path.string(), key));
+        }
+    }
+    uint64_t nPosition = find_value(checkpoint, "position").get_int64();
+    search.nNextChunk = nPosition / GENESIS_CHUNK_SIZE;
+    search.nHashes = find_value(checkpoint, "hashes").get_int64();
+    fprintf(stderr, "Resuming from time %u nonce %u\n",
+        (unsigned int)(search.nTimeStart + (nPosition >> 32)), (unsigned int)(nPosition & 0xffffffff));
+}
+
+static void WriteCheckpoint(const fs::path& path, GenesisSearch& search)
+{
+    UniValue checkpoint = SearchParameters(search);
+    uint64_t nPosition = search.GetSearchedPosition();
+    checkpoint.pushKV("position", nPosition);
+    checkpoint.pushKV("hashes", (uint64_t)search.nHashes);
+
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+    FILE* file = fsbridge::fopen(pathTmp, "wb");
+    if (!file)
+        throw std::runtime_error(strprintf("Cannot write checkpoint %s", pathTmp.string()));
+    std::string str = checkpoint.write(1) + "\n";
+    bool fWritten = fwrite(str.data(), 1, str.size(), file) == str.size();
+    if (fclose(file) != 0 || !fWritten || !RenameOver(pathTmp, path))
+        throw std::runtime_error(strprintf("Cannot write checkpoint %s", path.string()));
+}
+
+static void SearchThread(GenesisSearch& search, int nThread)
+{
+    // Reserve the hashing memory up front, on huge pages where available.
+    size_t nMemory = CPoWHeader::GetPoWMemoryUsage(search.nLanes);
+    if (nMemory > 0)
+        yespower_tls_reserve(nMemory, YESPOWER_PAGES_2M);
+
+    CPoWHeader powHeader(search.header);
+    uint32_t nTime = search.header.nTime;
+    uint256 vHashes[YESPOWER_MAX_LANES];
+
+    while (!search.fStop) {
+        // Publish the chunk before claiming it, so that GetSearchedPosition()
+        // never sees nNextChunk past a chunk that no thread reports yet.
+        uint64_t nChunk = search.nNextChunk;
+        do {
+            search.vThreadChunk[nThread] = nChunk;
+        } while (!search.nNextChunk.compare_exchange_weak(nChunk, nChunk + 1));
+        uint64_t nPosition = nChunk * GENESIS_CHUNK_SIZE;
+        if (search.nTimeStart + (nPosition >> 32) != nTime) {
+            nTime = search.nTimeStart + (nPosition >> 32);
+            powHeader.SetTime(nTime);
+        }
+        uint32_t nNonce = nPosition & 0xffffffff;
+
+        for (uint64_t i = 0; i < GENESIS_CHUNK_SIZE && !search.fStop; i += search.nLanes) {
+            // Don't run past the chunk when the lanes don't divide it.
+            size_t nBatch = std::min<uint64_t>(search.nLanes, GENESIS_CHUNK_SIZE - i);
+            powHeader.GetPoWHashes(nNonce + i, vHashes, nBatch);
+            search.nHashes += nBatch;
+            for (unsigned int l = 0; l < nBatch; l++) {
+                if (UintToArith256(vHashes[l]) <= search.hashTarget) {
+                    std::lock_guard<std::mutex> lock(search.cs);
+                    if (!search.fFound || nPosition + i + l < search.nFoundPosition) {
+                        search.fFound = true;
+                        search.nFoundPosition = nPosition + i + l;
+                        search.hashPoW = vHashes[l];
+                    }
+                    search.fStop = true;
+                    break;
+                }
+            }
+        }
+    }
+    // The last chunk may have been left part way through, so it stays in
+    // vThreadChunk and is searched again when the search is resumed.
+    yespower_tls_free();
+}
+
+static int CommandLineGenesis()
+{
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+    if (mapArgs.count("-time"))
+        header.nTime = GetArg("-time", 0);
+    if (mapArgs.count("-bits")) {
+        std::string strBits = GetArg("-bits", "");
+        if (strBits.size() != 8 || !IsHex(strBits))
+            throw std::runtime_error("-bits must be 8 hex digits");
+        header.nBits = strtoul(strBits.c_str(), NULL, 16);
+    }
+    if (mapArgs.count("-version"))
+        header.nVersion = GetArg("-version", 0);
+    header.nNonce = 0;
+
+    int nThreads = GetArg("-threads", GetNumCores());
+    if (nThreads < 1)
+        nThreads = 1;
+
+    GenesisSearch search(nThreads);
+    search.header = header;
+    search.nTimeStart = header.nTime;
+    bool fNegative, fOverflow;
+    search.hashTarget.SetCompact(header.nBits, &fNegative, &fOverflow);
+    if (fNegative || fOverflow || search.hashTarget == 0)
+        throw std::runtime_error(strprintf("Invalid target 0x%08x", header.nBits));
+    search.nLanes = std::max<int64_t>(1, std::min<int64_t>(YESPOWER_MAX_LANES,
+        GetArg("-lanes", DEFAULT_GENESIS_LANES)));
+    for (auto& chunk : search.vThreadChunk)
+        chunk = UINT64_MAX;
+
+    fs::path pathCheckpoint;
+    if (mapArgs.count("-checkpoint")) {
+        pathCheckpoint = fs::absolute(GetArg("-checkpoint", ""));
+        ReadCheckpoint(pathCheckpoint, search);
+    }
+    int64_t nCheckpointInterval = GetArg("-checkpointinterval", DEFAULT_GENESIS_CHECKPOINT_INTERVAL);
+
+    fprintf(stderr, "Searching %s genesis block from time %u, bits 0x%08x, with %d threads of %u lanes\n",
+        Params().NetworkIDString(), search.nTimeStart, header.nBits, nThreads, search.nLanes);
+
+    signal(SIGINT, HandleSIGTERM);
+    signal(SIGTERM, HandleSIGTERM);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++)
+        threads.emplace_back(SearchThread, std::ref(search), i);
+
+    auto nStart = std::chrono::steady_clock::now();
+    auto nLastCheckpoint = nStart;
+    uint64_t nHashesStart = search.nHashes;
+    while (!search.fStop) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (fRequestShutdown)
+            search.fStop = true;
+
+        auto nNow = std::chrono::steady_clock::now();
+        double nElapsed = std::chrono::duration<double>(nNow - nStart).count();
+        uint64_t nPosition = search.GetSearchedPosition();
+        fprintf(stderr, "time %u nonce %10u, %.2f H/s\n",
+            (unsigned int)(search.nTimeStart + (nPosition >> 32)), (unsigned int)(nPosition & 0xffffffff),
+            (search.nHashes - nHashesStart) / std::max(nElapsed, 1e-3));
+
+        if (!pathCheckpoint.empty() && !search.fStop &&
+            nNow - nLastCheckpoint >= std::chrono::seconds(nCheckpointInterval)) {
+            WriteCheckpoint(pathCheckpoint, search);
+            nLastCheckpoint = nNow;
+        }
+    }
+
+    for (auto& t : threads)
+        t.join();
+
+    UniValue result = SearchParameters(search);
+    result.pushKV("found", search.fFound);
+    result.pushKV("hashes", (uint64_t)search.nHashes);
+    if (search.fFound) {
+        header.nTime = search.nTimeStart + (search.nFoundPosition >> 32);
+        header.nNonce = search.nFoundPosition & 0xffffffff;
+        result.pushKV("time", (uint64_t)header.nTime);
+        result.pushKV("nonce", (uint64_t)header.nNonce);
+        result.pushKV("hash", header.GetHash().GetHex());
+        result.pushKV("powhash", search.hashPoW.GetHex());
+        if (!pathCheckpoint.empty())
+            fs::remove(pathCheckpoint);
+    } else {
+        // Interrupted; rerun with the same -checkpoint to carry on.
+        result.pushKV("position", search.GetSearchedPosition());
+        if (!pathCheckpoint.empty())
+            WriteCheckpoint(pathCheckpoint, search);
+    }
+    fprintf(stdout, "%s\n", result.write(2).c_str());
+    return search.fFound ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[])
+{
+    SetupEnvironment();
+
+    try {
+        int ret = AppInitGenesis(argc, argv);
+        if (ret != CONTINUE_EXECUTION)
+            return ret;
+    }
+    catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "AppInitGenesis()");
+        return EXIT_FAILURE;
+    } catch (...) {
+        PrintExceptionContinue(NULL, "AppInitGenesis()");
+        return EXIT_FAILURE;
+    }
+
+    int ret = EXIT_FAILURE;
+    try {
+        ret = CommandLineGenesis();
+    }
+    catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "CommandLineGenesis()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "CommandLineGenesis()");
+    }
+    return ret;
+}
@@ -0,0 +1,202 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockencodings.h"
+#include "consensus/consensus.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+#include "version.h"
+
+#include <unordered_map>
+
+/** Lower bound on the serialized size of a transaction, used to bound the
+ * number of transactions a compact block may claim to have.
+ */
+static const size_t MIN_SERIALIZABLE_TRANSACTION_SIZE = 10;
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
+        nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block.GetBlockHeader()) {
+    FillShortTxIDSelector();
+    // The coinbase is never in the receiver's mempool, so always send it.
+    prefilledtxn[0] = {0, block.vtx[0]};
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        shorttxids[i - 1] = GetShortID(block.vtx[i].GetWTxId());
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    CSHA256 hasher;
+    hasher.Write((unsigned char*)&(*stream.begin()), stream.end() - stream.begin());
+    uint256 shorttxidhash;
+    hasher.Finalize(shorttxidhash.begin());
+    shorttxidk0 = shorttxidhash.GetUint64(0);
+    shorttxidk1 = shorttxidhash.GetUint64(1);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const WTxId& wtxid) const {
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    return CSipHasher(shorttxidk0, shorttxidk1)
+        .Write(wtxid.hash.begin(), wtxid.hash.size())
+        .Write(wtxid.authDigest.begin(), wtxid.authDigest.size())
+        .Finalize() & 0xffffffffffffL;
+}
+
+
+ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<const CTransaction*>& extra_txn) {
+    if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.shorttxids.size() + cmpctblock.prefilledtxn.size() > MAX_BLOCK_SIZE / MIN_SERIALIZABLE_TRANSACTION_SIZE)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && txn_available.empty());
+    header = cmpctblock.header;
+    txn_available.resize(cmpctblock.BlockTxCount());
+
+    int32_t lastprefilledindex = -1;
+    for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
+        if (cmpctblock.prefilledtxn[i].tx.IsNull())
+            return READ_STATUS_INVALID;
+
+        lastprefilledindex += cmpctblock.prefilledtxn[i].index + 1; // index is a uint16_t, so can't overflow here
+        if (lastprefilledindex > std::numeric_limits<uint16_t>::max())
+            return READ_STATUS_INVALID;
+        if ((uint32_t)lastprefilledindex > cmpctblock.shorttxids.size() + i) {
+            // If we are inserting a tx at an index greater than our full list of shorttxids
+            // plus the number of prefilled txn we've inserted, then we have txn for which we
+            // have neither a prefilled txn or a shorttxid!
+            return READ_STATUS_INVALID;
+        }
+        txn_available[lastprefilledindex] = std::make_shared<const CTransaction>(cmpctblock.prefilledtxn[i].tx);
+    }
+    prefilled_count = cmpctblock.prefilledtxn.size();
+
+    // Calculate map of short IDs -> positions and check mempool to see what we have (or don't).
+    // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
+    // of short IDs, any highly-uneven distribution of elements can be safely treated as a
+    // READ_STATUS_FAILED.
+    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    uint16_t index_offset = 0;
+    for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
+        while (txn_available[i + index_offset])
+            index_offset++;
+        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
+        // The number of entries in a bucket is binomially distributed, so for
+        // blocks of up to 16000 transactions more than 12 in one bucket should
+        // only happen about once per million block transfers.
+        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
+            return READ_STATUS_FAILED;
+    }
+    // In the short ID collision case we could request both colliding
+    // transactions instead, but falling back to the full block is simpler.
+    if (shorttxids.size() != cmpctblock.shorttxids.size())
+        return READ_STATUS_FAILED;
+
+    std::vector<bool> have_txn(txn_available.size());
+    {
+        LOCK(pool->cs);
+        for (CTxMemPool::txiter it = pool->mapTx.begin(); it != pool->mapTx.end(); ++it) {
+            uint64_t shortid = cmpctblock.GetShortID(it->GetTx().GetWTxId());
+            std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
+            if (idit != shorttxids.end()) {
+                if (!have_txn[idit->second]) {
+                    txn_available[idit->second] = it->GetSharedTx();
+                    have_txn[idit->second] = true;
+                    mempool_count++;
+                } else {
+                    // If two mempool transactions match the short ID, just
+                    // request it, rather than risk failing in FillBlock.
+                    if (txn_available[idit->second]) {
+                        txn_available[idit->second].reset();
+                        mempool_count--;
+                    }
+                }
+            }
+            // Stop early once everything is found, at the small risk of
+            // missing a later collision.
+            if (mempool_count == shorttxids.size())
+                break;
+        }
+    }
+
+    for (const CTransaction* ptx : extra_txn) {
+        if (mempool_count == shorttxids.size())
+            break;
+        uint64_t shortid = cmpctblock.GetShortID(ptx->GetWTxId());
+        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
+        if (idit != shorttxids.end()) {
+            if (!have_txn[idit->second]) {
+                txn_available[idit->second] = std::make_shared<const CTransaction>(*ptx);
+                have_txn[idit->second] = true;
+                mempool_count++;
+                extra_count++;
+            } else if (txn_available[idit->second] &&
+                    !(txn_available[idit->second]->GetWTxId() == ptx->GetWTxId())) {
+                // As above, but a transaction that is both in the mempool and
+                // among the extra transactions is not a collision.
+                txn_available[idit->second].reset();
+                mempool_count--;
+                extra_count--;
+            }
+        }
+    }
+
+    LogPrint("net", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %lu\n",
+        cmpctblock.header.GetHash().ToString(), GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const {
+    assert(!header.IsNull());
+    assert(index < txn_available.size());
+    return txn_available[index] != nullptr;
+}
+
+ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing) {
+    assert(!header.IsNull());
+    uint256 hash = header.GetHash();
+    block = header;
+    block.vtx.resize(txn_available.size());
+
+    size_t tx_missing_offset = 0;
+    for (size_t i = 0; i < txn_available.size(); i++) {
+        if (!txn_available[i]) {
+            if (vtx_missing.size() <= tx_missing_offset)
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vtx_missing[tx_missing_offset++];
+        } else {
+            block.vtx[i] = *txn_available[i];
+        }
+    }
+
+    // Make sure we can't call FillBlock again.
+    header.SetNull();
+    txn_available.clear();
+
+    if (vtx_missing.size() != tx_missing_offset)
+        return READ_STATUS_INVALID;
+
+    // A short ID collision shows up as a merkle root mismatch. That is not
+    // the peer's fault, so the caller falls back to fetching the full block
+    // instead of treating it as invalid.
+    bool mutated;
+    if (block.BuildMerkleTree(&mutated) != block.hashMerkleRoot || mutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("net", "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool (incl at least %lu from extra pool) and %lu txn requested\n",
+        hash.ToString(), prefilled_count, mempool_count, extra_count, vtx_missing.size());
+    if (vtx_missing.size() < 5) {
+        for (const CTransaction& tx : vtx_missing)
+            LogPrint("net", "Reconstructed block %s required tx %s\n", hash.ToString(), tx.GetHash().ToString());
+    }
+
+    return READ_STATUS_OK;
+}
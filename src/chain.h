@@ -19,6 +19,7 @@ static const int SPROUT_VALUE_VERSION = 1001400;
 static const int SAPLING_VALUE_VERSION = 1010100;
 static const int CHAIN_HISTORY_ROOT_VERSION = 2010200;
 static const int NU5_DATA_VERSION = 4050000;
+static const int POW_HASH_VERSION = 4050750;
 
 /**
  * Maximum amount of time that a block timestamp is allowed to be ahead of the
@@ -177,6 +178,8 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_ACTIVATES_UPGRADE  =   128, //! block activates a network upgrade
+
+    BLOCK_VALID_POW          =   256, //! header's yespower hash was verified and is cached in hashPoW
 };
 
 //! Short-hand for the highest consensus validity we implement.
@@ -300,6 +303,9 @@ public:
     //!   once a block has been connected to the main chain, and will be null otherwise.
     uint256 hashChainHistoryRoot;
 
+    //! yespower hash of the block header. Only set if BLOCK_VALID_POW is set.
+    uint256 hashPoW;
+
     //! block header
     int nVersion;
     uint256 hashMerkleRoot;
@@ -331,6 +337,7 @@ public:
         hashFinalSaplingRoot = uint256();
         hashFinalOrchardRoot = uint256();
         hashChainHistoryRoot = uint256();
+        hashPoW = uint256();
         nSequenceId = 0;
         nSproutValue = std::nullopt;
         nChainSproutValue = std::nullopt;
@@ -403,9 +410,18 @@ public:
 
     uint256 GetBlockPoWHash() const
     {
+        if (nStatus & BLOCK_VALID_POW)
+            return hashPoW;
         return GetBlockHeader().GetPoWHash();
     }
 
+    //! Record the verified yespower hash of this block's header.
+    void SetPoWHash(const uint256& hash)
+    {
+        hashPoW = hash;
+        nStatus |= BLOCK_VALID_POW;
+    }
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -561,6 +577,18 @@ public:
             READWRITE(nOrchardValue);
         }
 
+        // Only read/write the cached PoW hash if the client version used to
+        // create this index was storing it. Older clients may have rewritten
+        // the index without the hash, in which case the flag is dropped and
+        // the PoW will be recomputed when needed.
+        if ((s.GetType() & SER_DISK) && (nStatus & BLOCK_VALID_POW)) {
+            if (nVersion >= POW_HASH_VERSION) {
+                READWRITE(hashPoW);
+            } else if (ser_action.ForRead()) {
+                nStatus &= ~BLOCK_VALID_POW;
+            }
+        }
+
         // If you have just added new serialized fields above, remember to add
         // them to CBlockTreeDB::LoadBlockIndexGuts() in txdb.cpp :)
     }
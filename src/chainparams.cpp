@@ -14,13 +14,7 @@
 #include <assert.h>
 #include <optional>
 #include <variant>
-#include <cstdio>
-#include <cstdlib>
-#include <atomic>
-#include <thread>
 #include <vector>
-#include <chrono>
-#include <ctime>
 
 #include <boost/assign/list_of.hpp>
 
@@ -155,202 +149,6 @@ public:
 	    2764,
 	    0x1f07ffff, 4, 0);
         consensus.hashGenesisBlock = genesis.GetHash();
-        
-        // Mine genesis block
-        // Can be enabled via:
-        //   1. Environment variable: MINE_GENESIS=1 (推荐)
-        //   2. Compile time: make CPPFLAGS="-DMINE_GENESIS_BLOCK=1"
-        // Note: Command line args not available yet during chainparams construction
-        bool fMineGenesis = false;
-        
-        // Check environment variable (primary method)
-        const char* envMineGenesis = getenv("MINE_GENESIS");
-        if (envMineGenesis != nullptr && atoi(envMineGenesis) != 0) {
-            fMineGenesis = true;
-        }
-        
-        // Check compile-time define
-        #ifdef MINE_GENESIS_BLOCK
-        #if MINE_GENESIS_BLOCK
-        fMineGenesis = true;
-        #endif
-        #endif
-        
-        if (true)
-        {
-            printf("Mining genesis block with yespower algorithm...\n");
-            printf("Genesis Block Parameters:\n");
-            printf("  Time: %u\n", genesis.nTime);
-            printf("  Bits: 0x%08x\n", genesis.nBits);
-            printf("  Target: %s\n", consensus.powLimit.ToString().c_str());
-            printf("\nYespower Parameters:\n");
-            printf("  N = 2048 (memory parameter - FAST MODE)\n");
-            printf("  r = 8 (block size parameter - FAST MODE)\n");
-            printf("  Memory per thread: ~2 MB\n");
-            printf("  Speed boost: ~100x faster than default config\n");
-            
-            // Multi-threading support
-            // Check environment variable for thread count
-            unsigned int nThreads = 0;
-            const char* envThreads = getenv("MINE_THREADS");
-            if (envThreads != nullptr) {
-                int userThreads = atoi(envThreads);
-                if (userThreads > 0 && userThreads <= 256) {
-                    nThreads = userThreads;
-                    printf("\nUsing user-specified thread count: %u\n", nThreads);
-                } else {
-                    printf("\nWarning: Invalid MINE_THREADS value (%d), using auto-detect\n", userThreads);
-                }
-            }
-            
-            if (nThreads == 0) {
-                nThreads = std::thread::hardware_concurrency();
-                if (nThreads == 0) nThreads = 4; // fallback
-                printf("\nAuto-detected CPU cores: %u\n", nThreads);
-            }
-            
-            printf("\nMulti-threading configuration:\n");
-            printf("  Threads: %u\n", nThreads);
-            printf("  Memory per thread: ~512 MB\n");
-            printf("  Total memory: ~%u MB\n", nThreads * 512);
-            printf("\nStarting mining...\n\n");
-            
-            arith_uint256 hashTarget = arith_uint256().SetCompact(genesis.nBits);
-            
-            // Shared variables (atomic for thread safety)
-            std::atomic<bool> found(false);
-            std::atomic<uint64_t> totalHashes(0);
-            uint32_t foundNonce = 0;
-            uint256 foundBlockHash;
-            uint256 foundPoWHash;
-            
-            auto minerThread = [&](uint32_t threadId) {
-                // Each thread works on different nonce ranges
-                uint32_t nonce = threadId;
-                const uint32_t step = nThreads;
-                
-                CBlock localGenesis = genesis;
-                uint256 hashPoW;
-                
-                while (!found.load()) {
-                    localGenesis.nNonce = nonce;
-                    hashPoW = localGenesis.GetPoWHash();
-                    
-                    totalHashes.fetch_add(1);
-                    
-                    if (UintToArith256(hashPoW) <= hashTarget) {
-                        // Found valid block!
-                        bool expected = false;
-                        if (found.compare_exchange_strong(expected, true)) {
-                            // First thread to find it
-                            foundNonce = nonce;
-                            foundBlockHash = localGenesis.GetHash();
-                            foundPoWHash = hashPoW;
-                        }
-                        break;
-                    }
-                    
-                    nonce += step;
-                    
-                    // Handle nonce overflow
-                    if (nonce < step) {
-                        // Wrapped around, increment time
-                        break;
-                    }
-                }
-            };
-            
-            // Progress reporting thread
-            auto progressThread = [&]() {
-                uint64_t lastHashes = 0;
-                auto startTime = std::chrono::steady_clock::now();
-                auto lastTime = startTime;
-                
-                while (!found.load()) {
-                    std::this_thread::sleep_for(std::chrono::seconds(1));
-                    
-                    auto now = std::chrono::steady_clock::now();
-                    uint64_t currentHashes = totalHashes.load();
-                    double elapsed = std::chrono::duration<double>(now - lastTime).count();
-                    double totalElapsed = std::chrono::duration<double>(now - startTime).count();
-                    
-                    if (elapsed > 0) {
-                        uint64_t hashDiff = currentHashes - lastHashes;
-                        double hashrate = hashDiff / elapsed;
-                        double avgHashrate = currentHashes / totalElapsed;
-                        
-                        // Get current time for timestamp
-                        auto timeNow = std::chrono::system_clock::now();
-                        std::time_t timeT = std::chrono::system_clock::to_time_t(timeNow);
-                        char timeStr[64];
-                        std::strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", std::localtime(&timeT));
-                        
-                        printf("[%s] Hashes: %8llu | Rate: %8.2f H/s | Avg: %8.2f H/s | Time: %.0fs | Threads: %u\n", 
-                               timeStr,
-                               (unsigned long long)currentHashes, 
-                               hashrate,
-                               avgHashrate,
-                               totalElapsed,
-                               nThreads);
-                        fflush(stdout);
-                        
-                        lastHashes = currentHashes;
-                        lastTime = now;
-                    }
-                }
-            };
-            
-            // Start mining threads
-            std::vector<std::thread> threads;
-            threads.reserve(nThreads + 1);
-            
-            // Start miner threads
-            for (unsigned int i = 0; i < nThreads; i++) {
-                threads.emplace_back(minerThread, i);
-            }
-            
-            // Start progress thread
-            threads.emplace_back(progressThread);
-            
-            // Wait for all threads
-            for (auto& t : threads) {
-                if (t.joinable()) {
-                    t.join();
-                }
-            }
-            
-            if (found.load()) {
-                genesis.nNonce = foundNonce;
-                
-                // Get current time for timestamp
-                auto timeNow = std::chrono::system_clock::now();
-                std::time_t timeT = std::chrono::system_clock::to_time_t(timeNow);
-                char timeStr[64];
-                std::strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", std::localtime(&timeT));
-                
-                printf("\n");
-                printf("========================================\n");
-                printf("   Genesis Block Found!\n");
-                printf("   Time: %s\n", timeStr);
-                printf("========================================\n");
-                printf("Nonce:        %u\n", foundNonce);
-                printf("Block Time:   %u (%s)\n", genesis.nTime, 
-                       std::asctime(std::localtime((const time_t*)&genesis.nTime)));
-                printf("Block Hash:   %s\n", foundBlockHash.ToString().c_str());
-                printf("PoW Hash:     %s\n", foundPoWHash.ToString().c_str());
-                printf("Merkle Root:  %s\n", genesis.hashMerkleRoot.ToString().c_str());
-                printf("Target:       %s\n", ArithToUint256(hashTarget).ToString().c_str());
-                printf("Total Hashes: %llu\n", (unsigned long long)totalHashes.load());
-                printf("========================================\n");
-                printf("\nUpdate chainparams.cpp with:\n\n");
-                printf("genesis = CreateGenesisBlock(%u, %u, 0x%08x, %d, 0);\n", 
-                       genesis.nTime, foundNonce, genesis.nBits, genesis.nVersion);
-                printf("assert(consensus.hashGenesisBlock == uint256S(\"0x%s\"));\n", foundBlockHash.ToString().c_str());
-                printf("assert(genesis.hashMerkleRoot == uint256S(\"0x%s\"));\n", genesis.hashMerkleRoot.ToString().c_str());
-                printf("\n========================================\n");
-            }
-        }
-        
         assert(consensus.hashGenesisBlock == uint256S("0x6d424c350729ae633275d51dc3496e16cd1b1d195c164da00f39c499a2e9959e"));
         assert(genesis.hashMerkleRoot == uint256S("0xe18deb20a8da8ae6a9e965a10f52873adb65f4f568a5ac4b24ab074c7c81bb72"));
 
@@ -6,6 +6,9 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -26,12 +29,37 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own deque of checks, which it takes from the back
+  * of. Added checks are spread over the workers' deques, and a worker whose
+  * deque runs dry steals half of another's from the front, so that workers
+  * only contend when they run out of work.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! The checks assigned to one worker.
+    struct alignas(64) WorkerDeque {
+        boost::mutex mutex;
+        std::deque<T> checks;
+        //! checks.size(), readable without taking the lock
+        std::atomic<unsigned int> nSize{0};
+    };
+
+    //! Workers beyond this many share deques.
+    static const unsigned int MAX_DEQUES = 128;
+
+    //! The worker deques; slot 0 belongs to the master.
+    std::unique_ptr<WorkerDeque[]> deques;
+
+    //! The number of deque slots handed out, including the master's.
+    std::atomic<unsigned int> nDeques;
+
+    //! The slot that Add() hands the next chunk of checks to.
+    unsigned int nNextDeque;
+
+    //! Mutex for workers and the master going to sleep and waking up
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -40,90 +68,116 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of checks that are in a deque, waiting to be taken.
+    //! Only changed while holding the lock of the deque concerned.
+    std::atomic<unsigned int> nQueued;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of worker threads that are asleep waiting for checks.
+    std::atomic<int> nIdle;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
-
-    //! Whether we're shutting down.
-    bool fQuit;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /**
+     * Move a batch of checks into vChecks, from the back of the worker's own
+     * deque or else from the front of another one. Returns false if every
+     * deque was empty.
+     */
+    bool Take(unsigned int nDeque, std::vector<T>& vChecks)
+    {
+        unsigned int nSlots = std::min(nDeques.load(), MAX_DEQUES);
+        for (unsigned int i = 0; i < nSlots && nQueued != 0; i++) {
+            WorkerDeque& deque = deques[(nDeque + i) % nSlots];
+            if (deque.nSize == 0)
+                continue;
+            boost::unique_lock<boost::mutex> lock(deque.mutex);
+            if (deque.checks.empty())
+                continue;
+            unsigned int nSize = deque.checks.size();
+            unsigned int nNow;
+            if (i == 0) {
+                // Work through our own checks in batches as large as the idle
+                // workers allow, leaving them something to steal.
+                nNow = std::max(1U, std::min(nBatchSize, nSize / (nIdle.load() + 1)));
+                for (unsigned int k = 0; k < nNow; k++) {
+                    vChecks.emplace_back();
+                    vChecks.back().swap(deque.checks.back());
+                    deque.checks.pop_back();
+                }
+            } else {
+                // Steal half of another worker's checks, from the end it
+                // isn't working on.
+                nNow = std::max(1U, std::min(nBatchSize, nSize / 2));
+                for (unsigned int k = 0; k < nNow; k++) {
+                    vChecks.emplace_back();
+                    vChecks.back().swap(deque.checks.front());
+                    deque.checks.pop_front();
+                }
+            }
+            deque.nSize -= nNow;
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nDeque, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
+            if (!Take(nDeque, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
+                if (fMaster) {
+                    while (nQueued == 0 && nTodo != 0)
+                        condMaster.wait(lock); // wait
+                    if (nTodo == 0) {
                         bool fRet = fAllOk;
                         // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
+                        fAllOk = true;
                         // return the current status
                         return fRet;
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                } else {
+                    while (nQueued == 0) {
+                        nIdle++;
+                        condWorker.wait(lock); // wait
+                        nIdle--;
+                    }
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
+            }
+            if (nQueued != 0 && nIdle != 0) {
+                // Wake another worker to steal what is left
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condWorker.notify_one();
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            unsigned int nNow = vChecks.size();
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -132,33 +186,59 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) :
+        deques(new WorkerDeque[MAX_DEQUES]), nDeques(1), nNextDeque(0), nQueued(0), nIdle(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nDeque = nDeques++;
+        if (nDeque >= MAX_DEQUES)
+            nDeque = 1 + (nDeque - 1) % (MAX_DEQUES - 1);
+        Loop(nDeque);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
+
+        // Spread the checks over the workers' deques in contiguous chunks of
+        // at least a batch, leaving finer balancing to stealing. The master's
+        // own deque is only used when there are no workers.
+        unsigned int nWorkers = std::min(nDeques.load(), MAX_DEQUES) - 1;
+        size_t nChunk = vChecks.size();
+        if (nWorkers)
+            nChunk = std::min(nChunk, std::max<size_t>(nBatchSize, (nChunk + nWorkers - 1) / nWorkers));
+        unsigned int nChunks = 0;
+        for (size_t i = 0; i < vChecks.size(); i += nChunk, nChunks++) {
+            WorkerDeque& deque = deques[nWorkers ? 1 + nNextDeque++ % nWorkers : 0];
+            boost::unique_lock<boost::mutex> lock(deque.mutex);
+            size_t nEnd = std::min(i + nChunk, vChecks.size());
+            for (size_t k = i; k < nEnd; k++) {
+                deque.checks.emplace_back();
+                deque.checks.back().swap(vChecks[k]);
+            }
+            // Only count the checks once they can be taken, so that workers
+            // never spin waiting for them.
+            deque.nSize += nEnd - i;
+            nQueued += nEnd - i;
+        }
+
+        // Wake a worker per chunk. Each worker that finds more work than it
+        // takes wakes another, so idle workers join in as long as there is
+        // something to steal.
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (unsigned int i = 0; i < nChunks; i++)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
@@ -17,7 +17,7 @@
 //! These need to be macros, as clientversion.cpp's and bitcoin*-res.rc's voodoo requires it
 #define CLIENT_VERSION_MAJOR 4
 #define CLIENT_VERSION_MINOR 5
-#define CLIENT_VERSION_REVISION 6
+#define CLIENT_VERSION_REVISION 7
 #define CLIENT_VERSION_BUILD 50
 
 //! Set to true for release, false for prerelease or test build
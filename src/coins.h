@@ -11,6 +11,7 @@
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "slabmap.h"
 #include "uint256.h"
 
 #include <assert.h>
@@ -247,7 +248,7 @@ class SaltedTxidHasher
 {
 private:
     /** Salt */
-    const uint64_t k0, k1;
+    uint64_t k0, k1; // not const, so that maps using this hasher can be swapped
 
 public:
     SaltedTxidHasher();
@@ -336,7 +337,12 @@ enum ShieldedType
     ORCHARD,
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, SaltedTxidHasher> CCoinsMap;
+/**
+ * The coins cache holds many small entries and is looked up for every input
+ * and output of every block, so its entries are kept in slabs rather than in
+ * a heap node each.
+ */
+typedef slabmap<uint256, CCoinsCacheEntry, SaltedTxidHasher> CCoinsMap;
 typedef boost::unordered_map<uint256, CAnchorsSproutCacheEntry, SaltedTxidHasher> CAnchorsSproutMap;
 typedef boost::unordered_map<uint256, CAnchorsSaplingCacheEntry, SaltedTxidHasher> CAnchorsSaplingMap;
 typedef boost::unordered_map<uint256, CAnchorsOrchardCacheEntry, SaltedTxidHasher> CAnchorsOrchardMap;
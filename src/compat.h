@@ -10,6 +10,12 @@
 #include "config/bitcoin-config.h"
 #endif
 
+// Use the epoll socket event loop where available. It has no limit on socket
+// numbers, unlike select() which only handles sockets below FD_SETSIZE.
+#if defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#endif
+
 #ifdef WIN32
 #ifndef NOMINMAX
 #define NOMINMAX
@@ -97,7 +103,7 @@ size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_EPOLL)
     return true;
 #else
     return (s < FD_SETSIZE);
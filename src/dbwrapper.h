@@ -26,6 +26,21 @@ public:
 
 class CDBWrapper;
 
+/** LevelDB settings that suit how a particular database is used */
+struct CDBProfile
+{
+    //! Percentage of the cache size used for each of the up to two write buffers; the rest is block cache
+    int nWriteBufferPercent;
+    //! Target size of the table files, in bytes
+    size_t nMaxFileSize;
+    //! Number of table files LevelDB may keep open
+    int nMaxOpenFiles;
+    //! Whether to compress blocks with Snappy. Has no effect unless LevelDB was built with Snappy.
+    bool fCompression;
+
+    CDBProfile() : nWriteBufferPercent(25), nMaxFileSize(2 << 20), nMaxOpenFiles(64), fCompression(false) {}
+};
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -51,6 +66,11 @@ public:
      */
     CDBBatch(const CDBWrapper &_parent) : parent(_parent) { };
 
+    void Clear()
+    {
+        batch.Clear();
+    }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -171,8 +191,9 @@ public:
      * @param[in] nCacheSize  Configures various leveldb cache settings.
      * @param[in] fMemory     If true, use leveldb's memory environment.
      * @param[in] fWipe       If true, remove all existing data.
+     * @param[in] profile     LevelDB settings for this database.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBProfile& profile = CDBProfile());
     ~CDBWrapper();
 
     template <typename K, typename V>
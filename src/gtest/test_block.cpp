@@ -1,9 +1,15 @@
 #include <gtest/gtest.h>
 
+#include "chain.h"
+#include "clientversion.h"
+#include "hash.h"
 #include "primitives/block.h"
 #include "streams.h"
+#include "utiltime.h"
 #include "version.h"
 
+#include <boost/thread.hpp>
+
 
 TEST(BlockTests, HeaderSizeIsExpected) {
     // Dummy header with an empty Equihash solution.
@@ -13,3 +19,176 @@ TEST(BlockTests, HeaderSizeIsExpected) {
 
     ASSERT_EQ(ss.size(), CBlockHeader::HEADER_SIZE);
 }
+
+TEST(BlockTests, PoWHeaderMatchesSerializedHeader) {
+    CBlockHeader header;
+    header.nVersion = CBlockHeader::CURRENT_VERSION;
+    header.hashPrevBlock = uint256S("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef");
+    header.hashMerkleRoot = uint256S("fedcba9876543210fedcba9876543210fedcba9876543210fedcba9876543210");
+    header.hashBlockCommitments = uint256S("00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff");
+    header.nTime = 1700000000;
+    header.nBits = 0x1f07ffff;
+    header.nNonce = 0x01020304;
+    CPoWHeader powHeader(header);
+
+    auto expectSerialized = [&]() {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << header;
+        EXPECT_EQ(std::vector<unsigned char>(ss.begin(), ss.end()),
+                  std::vector<unsigned char>(powHeader.begin(), powHeader.end()));
+    };
+    expectSerialized();
+
+    for (uint32_t n : {0u, 1u, 0x80000000u, 0xffffffffu}) {
+        header.nNonce = n;
+        powHeader.SetNonce(n);
+        expectSerialized();
+
+        header.nTime = n;
+        powHeader.SetTime(n);
+        expectSerialized();
+
+        header.nBits = n;
+        powHeader.SetBits(n);
+        expectSerialized();
+    }
+
+    // Headers from before Sapling have no hashBlockCommitments.
+    header.nVersion = 4;
+    powHeader = CPoWHeader(header);
+    EXPECT_EQ(powHeader.end() - powHeader.begin(), 80);
+    expectSerialized();
+    header.nNonce = 42;
+    powHeader.SetNonce(42);
+    expectSerialized();
+}
+
+TEST(BlockTests, DiskBlockIndexPoWHashRoundTrip) {
+    CBlockIndex index;
+    index.nVersion = CBlockHeader::CURRENT_VERSION;
+    index.SetPoWHash(uint256S("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    EXPECT_TRUE(diskindex.nStatus & BLOCK_VALID_POW);
+    EXPECT_EQ(diskindex.hashPoW, index.hashPoW);
+    EXPECT_EQ(diskindex.GetBlockPoWHash(), index.hashPoW);
+}
+
+TEST(BlockTests, DiskBlockIndexDropsPoWFlagFromOldVersions) {
+    // An index written by an older client may carry the flag without the hash.
+    // 4.5.6 is the last release that did not store it.
+    for (int nOldVersion : {NU5_DATA_VERSION, 4050650}) {
+        CBlockIndex index;
+        index.nVersion = CBlockHeader::CURRENT_VERSION;
+        index.SetPoWHash(uint256S("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"));
+
+        CDataStream ss(SER_DISK, nOldVersion);
+        ss << CDiskBlockIndex(&index);
+
+        CDiskBlockIndex diskindex;
+        ss >> diskindex;
+        EXPECT_FALSE(diskindex.nStatus & BLOCK_VALID_POW) << nOldVersion;
+        EXPECT_TRUE(diskindex.hashPoW.IsNull()) << nOldVersion;
+        EXPECT_TRUE(ss.empty()) << nOldVersion;
+    }
+}
+
+static CBlock BlockWithTransactions(size_t nTx)
+{
+    CBlock block;
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].scriptSig = CScript() << i;
+        block.vtx.push_back(CTransaction(mtx));
+    }
+    return block;
+}
+
+TEST(BlockTests, MerkleTreeMatchesSerialHashing) {
+    // Large enough for the leaves and lower levels to be split across threads.
+    for (size_t nTx : {0, 1, 2, 3, 5, 4097, 6001}) {
+        CBlock block = BlockWithTransactions(nTx);
+
+        std::vector<uint256> level;
+        for (const CTransaction& tx : block.vtx) {
+            level.push_back(tx.GetScriptSigHash());
+        }
+        while (level.size() > 1) {
+            std::vector<uint256> next;
+            for (size_t i = 0; i < level.size(); i += 2) {
+                const uint256& right = level[std::min(i + 1, level.size() - 1)];
+                next.push_back(Hash(level[i].begin(), level[i].end(), right.begin(), right.end()));
+            }
+            level = next;
+        }
+
+        EXPECT_EQ(block.BuildMerkleTree(), level.empty() ? uint256() : level[0]) << nTx;
+    }
+}
+
+TEST(BlockTests, MerkleTreeOnCheckThreadsMatchesSerial) {
+    std::vector<CBlock> blocks;
+    std::vector<uint256> roots;
+    std::vector<std::vector<uint256>> trees;
+    for (size_t nTx : {2047, 2048, 4097, 6001}) {
+        blocks.push_back(BlockWithTransactions(nTx));
+        roots.push_back(blocks.back().BuildMerkleTree());
+        trees.push_back(blocks.back().vMerkleTree);
+    }
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++) {
+        threadGroup.create_thread(&ThreadMerkleCheck);
+    }
+    // Give the threads time to start; the trees must be the same either way.
+    MilliSleep(100);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        EXPECT_EQ(blocks[i].BuildMerkleTree(), roots[i]) << blocks[i].vtx.size();
+        EXPECT_EQ(blocks[i].vMerkleTree, trees[i]) << blocks[i].vtx.size();
+    }
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+TEST(BlockTests, UpdateMerkleTreeKeepsLeavesInSync) {
+    // Replace one transaction after another, as the miner does with the
+    // coinbase, only updating the tree in between: the leaves must always
+    // be the hashes of the current transactions.
+    CBlock block = BlockWithTransactions(9);
+    block.BuildMerkleTree();
+    for (size_t nIndex : {0, 8, 3, 0, 4, 4, 7}) {
+        CMutableTransaction mtx(block.vtx[nIndex]);
+        mtx.vin[0].scriptSig << 0x42;
+        block.vtx[nIndex] = mtx;
+
+        uint256 root = block.UpdateMerkleTree(nIndex);
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            EXPECT_EQ(block.vMerkleTree[i], block.vtx[i].GetScriptSigHash()) << nIndex << " " << i;
+        }
+        CBlock rebuilt(block);
+        EXPECT_EQ(root, rebuilt.BuildMerkleTree()) << nIndex;
+    }
+}
+
+TEST(BlockTests, UpdateMerkleTreeMatchesRebuild) {
+    for (size_t nTx : {1, 2, 3, 7, 8, 9}) {
+        CBlock block = BlockWithTransactions(nTx);
+        block.BuildMerkleTree();
+
+        for (size_t nIndex : {(size_t)0, nTx / 2, nTx - 1}) {
+            CMutableTransaction mtx(block.vtx[nIndex]);
+            mtx.vin[0].scriptSig << 0x42;
+            block.vtx[nIndex] = mtx;
+
+            uint256 root = block.UpdateMerkleTree(nIndex);
+            std::vector<uint256> vTree = block.vMerkleTree;
+            EXPECT_EQ(root, block.BuildMerkleTree()) << nTx << " " << nIndex;
+            EXPECT_EQ(vTree, block.vMerkleTree) << nTx << " " << nIndex;
+        }
+    }
+}
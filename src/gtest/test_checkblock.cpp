@@ -4,6 +4,7 @@
 #include "consensus/validation.h"
 #include "main.h"
 #include "proof_verifier.h"
+#include "transaction_builder.h"
 #include "utiltest.h"
 #include "zcash/Proof.hpp"
 
@@ -388,3 +389,59 @@ TEST_F(ContextualCheckBlockTest, BlockBlossomRulesRejectOtherTx) {
         ExpectInvalidBlockFromTx(CTransaction(mtx), 100, "bad-sapling-tx-version-group-id");
     }
 }
+
+
+// Test that a block's Sapling proofs are verified as a batch: a valid block is
+// accepted, and a block with an invalid proof is rejected by the per-transaction
+// fallback with the reason the unbatched check gives.
+TEST_F(ContextualCheckBlockTest, BlockSaplingProofBatch) {
+    auto consensusParams = RegtestActivateNU5();
+
+    CMutableTransaction mtxCoinbase = GetFirstBlockCoinbaseTx();
+    mtxCoinbase.fOverwintered = true;
+    mtxCoinbase.nVersion = SAPLING_TX_VERSION;
+    mtxCoinbase.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtxCoinbase.vout[0].scriptPubKey = Params().GetFoundersRewardScriptAtHeight(1);
+
+    CBasicKeyStore keystore;
+    CKey tsk = AddTestCKeyToKeyStore(keystore);
+    auto scriptPubKey = GetScriptForDestination(tsk.GetPubKey().GetID());
+    auto fvk = libzcash::SaplingSpendingKey::random().full_viewing_key();
+    auto pa = *fvk.in_viewing_key().address({0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0});
+
+    // A v5 transaction with two Sapling outputs. Its signatures don't cover
+    // the proofs, so swapping them leaves only the proofs invalid.
+    auto builder = TransactionBuilder(consensusParams, 1, &keystore);
+    builder.AddTransparentInput(COutPoint(uint256S("1234"), 0), scriptPubKey, 50000);
+    builder.AddSaplingOutput(fvk.ovk, pa, 20000, {});
+    builder.AddSaplingOutput(fvk.ovk, pa, 20000, {});
+    auto tx = builder.Build().GetTxOrThrow();
+    ASSERT_EQ(tx.nVersionGroupId, ZIP225_VERSION_GROUP_ID);
+    ASSERT_EQ(tx.vShieldedOutput.size(), 2);
+
+    CBlockIndex indexPrev {Params().GenesisBlock()};
+    {
+        CBlock block;
+        block.vtx.push_back(CTransaction(mtxCoinbase));
+        block.vtx.push_back(tx);
+
+        SCOPED_TRACE("BlockSaplingProofBatchAcceptsValidProofs");
+        MockCValidationState state;
+        EXPECT_TRUE(ContextualCheckBlock(block, state, Params(), &indexPrev, true));
+    }
+
+    CMutableTransaction mtxBad(tx);
+    std::swap(mtxBad.vShieldedOutput[0].zkproof, mtxBad.vShieldedOutput[1].zkproof);
+    {
+        CBlock block;
+        block.vtx.push_back(CTransaction(mtxCoinbase));
+        block.vtx.push_back(CTransaction(mtxBad));
+
+        SCOPED_TRACE("BlockSaplingProofBatchRejectsInvalidProof");
+        MockCValidationState state;
+        EXPECT_CALL(state, DoS(100, false, REJECT_INVALID, "bad-txns-sapling-output-description-invalid", false, "")).Times(1);
+        EXPECT_FALSE(ContextualCheckBlock(block, state, Params(), &indexPrev, true));
+    }
+
+    RegtestDeactivateNU5();
+}
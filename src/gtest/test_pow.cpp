@@ -5,6 +5,9 @@
 #include "pow.h"
 #include "random.h"
 #include "utiltest.h"
+#include "yespower.h"
+
+#include <string.h>
 
 void TestDifficultyAveragingImpl(const Consensus::Params& params)
 {
@@ -126,3 +129,66 @@ TEST(PoW, MinDifficultyRules) {
               UintToArith256(params.powLimit).GetCompact());
 }
 #endif
+
+TEST(PoW, YespowerMultiMatchesYespower) {
+    // Each input is also its own personalization string, as block headers
+    // are. The consensus N = 20480 is not a power of two, so a valid N is
+    // used; the lanes code does not depend on N beyond that.
+    unsigned char vData[YESPOWER_MAX_LANES][80];
+    const uint8_t* vSrc[YESPOWER_MAX_LANES];
+    for (size_t l = 0; l < YESPOWER_MAX_LANES; l++) {
+        for (size_t i = 0; i < sizeof(vData[l]); i++) {
+            vData[l][i] = (unsigned char)(i * 7 + l * 31);
+        }
+        vSrc[l] = vData[l];
+    }
+
+    yespower_local_t local;
+    ASSERT_EQ(yespower_init_local(&local), 0);
+    for (yespower_version_t version : {YESPOWER_0_5, YESPOWER_1_0}) {
+        for (uint32_t r : {8, 32}) {
+            yespower_params_t vParams[YESPOWER_MAX_LANES];
+            yespower_binary_t vExpected[YESPOWER_MAX_LANES];
+            for (size_t l = 0; l < YESPOWER_MAX_LANES; l++) {
+                vParams[l] = {version, 2048, r, vData[l], sizeof(vData[l])};
+                ASSERT_EQ(yespower_tls(vData[l], sizeof(vData[l]), &vParams[l], &vExpected[l]), 0);
+            }
+            for (size_t nLanes = 1; nLanes <= YESPOWER_MAX_LANES; nLanes++) {
+                yespower_binary_t vHashes[YESPOWER_MAX_LANES];
+                ASSERT_EQ(yespower_multi_tls(vSrc, sizeof(vData[0]), vParams, nLanes, vHashes), 0);
+                for (size_t l = 0; l < nLanes; l++) {
+                    EXPECT_EQ(memcmp(&vHashes[l], &vExpected[l], sizeof(vHashes[l])), 0)
+                        << version << " " << r << " " << nLanes << " " << l;
+                }
+
+                memset(vHashes, 0, sizeof(vHashes));
+                ASSERT_EQ(yespower_multi(&local, vSrc, sizeof(vData[0]), vParams, nLanes, vHashes), 0);
+                for (size_t l = 0; l < nLanes; l++) {
+                    EXPECT_EQ(memcmp(&vHashes[l], &vExpected[l], sizeof(vHashes[l])), 0)
+                        << version << " " << r << " " << nLanes << " " << l;
+                }
+            }
+        }
+    }
+    EXPECT_EQ(yespower_free_local(&local), 0);
+}
+
+TEST(PoW, YespowerMultiRejectsWhatYespowerRejects) {
+    unsigned char data[80] = {};
+    const uint8_t* vSrc[2] = {data, data};
+    yespower_binary_t vHashes[2];
+
+    // The consensus N is not a power of two.
+    yespower_params_t vParams[2];
+    vParams[0] = vParams[1] = {YESPOWER_0_5, 20480, 32, data, sizeof(data)};
+    EXPECT_EQ(yespower_tls(data, sizeof(data), &vParams[0], &vHashes[0]), -1);
+    EXPECT_EQ(yespower_multi_tls(vSrc, sizeof(data), vParams, 2, vHashes), -1);
+
+    // Lanes must agree on version, N and r.
+    vParams[0].N = vParams[1].N = 2048;
+    vParams[1].r = 8;
+    EXPECT_EQ(yespower_multi_tls(vSrc, sizeof(data), vParams, 2, vHashes), -1);
+    vParams[1].r = 32;
+    EXPECT_EQ(yespower_multi_tls(vSrc, sizeof(data), vParams, 0, vHashes), -1);
+    EXPECT_EQ(yespower_multi_tls(vSrc, sizeof(data), vParams, YESPOWER_MAX_LANES + 1, vHashes), -1);
+}
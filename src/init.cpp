@@ -14,6 +14,7 @@
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "experimental_features.h"
 #include "fs.h"
 #include "httpserver.h"
@@ -33,6 +34,7 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "stratum.h"
 #include "txdb.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
@@ -44,6 +46,7 @@
 #include "wallet/walletdb.h"
 #endif
 #include "warnings.h"
+#include "yespower.h"
 #include <stdint.h>
 #include <stdio.h>
 
@@ -163,7 +166,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -174,6 +176,9 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+#ifdef ENABLE_MINING
+    InterruptStratumServer();
+#endif
     threadGroup.interrupt_all();
 }
 
@@ -203,6 +208,7 @@ void Shutdown()
         pwalletMain->Flush(false);
 #endif
 #ifdef ENABLE_MINING
+    StopStratumServer();
     GenerateBitcoins(false, 0, Params());
 #endif
     StopNode();
@@ -331,7 +337,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf(_("Write the coins cache to disk on a background thread, except at shutdown (default: %u)"), DEFAULT_BACKGROUND_FLUSH));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt("-blockprefetch=<n>", strprintf(_("Number of blocks to read from disk and check ahead of the chain tip while connecting blocks, using the -par threads (0 to disable, default: %d)"), DEFAULT_BLOCK_PREFETCH));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless '-whitelistforcerelay' is '1', in which case whitelisted peers' transactions will be relayed. RPC transactions are not affected. (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
@@ -346,12 +354,19 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-paramsdir=<dir>", _("Specify Koto network parameters directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-<db>cache=<n>", "Part of -dbcache in megabytes used by the LevelDB cache of <db>, which is chainstatedb or blockindexdb (default: a share of -dbcache)");
+        strUsage += HelpMessageOpt("-<db>compression", strprintf("Compress the table files of <db> with Snappy, if LevelDB was built with it (default: %u for chainstatedb, %u for blockindexdb)", DEFAULT_CHAINSTATE_DB_COMPRESSION, DEFAULT_BLOCKINDEX_DB_COMPRESSION));
+        strUsage += HelpMessageOpt("-<db>filesize=<n>", strprintf("Target size of the table files of <db> in megabytes (default: %d for chainstatedb, %d for blockindexdb)", DEFAULT_CHAINSTATE_DB_FILE_SIZE, DEFAULT_BLOCKINDEX_DB_FILE_SIZE));
+        strUsage += HelpMessageOpt("-<db>openfiles=<n>", strprintf("Number of table files of <db> to keep open (default: %d)", DEFAULT_DB_OPEN_FILES));
+        strUsage += HelpMessageOpt("-<db>writebuffer=<n>", strprintf("Percentage of the cache of <db> used for each of its two write buffers, 1 to 40; the rest is block cache (default: %d)", DEFAULT_DB_WRITE_BUFFER));
+    }
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file: this can be an absolute path or a path relative to the data directory (default: %s)"), DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
     strUsage += HelpMessageOpt("-ibdskiptxverification", strprintf(_("Skip transaction verification during initial block download up to the last checkpoint height. Incompatible with flags that disable checkpoints. (default = %u)"), DEFAULT_IBD_SKIP_TX_VERIFICATION));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification, header proof-of-work verification and block prefetch threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
@@ -385,6 +400,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-mempoolevictionmemoryminutes=<n>", strprintf(_("The number of minutes before allowing rejected transactions to re-enter the mempool. (default: %u)"), DEFAULT_MEMPOOL_EVICTION_MEMORY_MINUTES));
     strUsage += HelpMessageOpt("-mempooltxcostlimit=<n>",strprintf(_("An upper bound on the maximum size in bytes of all transactions in the mempool. (default: %s)"), DEFAULT_MEMPOOL_TOTAL_COST_LIMIT));
+    strUsage += HelpMessageOpt("-messagethreads=<n>", strprintf(_("Number of threads processing peer messages (1 to %d, default: %d)"), MAX_MESSAGE_HANDLER_THREADS, DEFAULT_MESSAGE_HANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -431,6 +447,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-checkpowondiskread", strprintf("Recompute the proof of work of every block read from disk, even if it was already verified (default: %u)", DEFAULT_CHECK_POW_ON_DISK_READ));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
@@ -443,7 +460,7 @@ std::string HelpMessage(HelpMessageMode mode)
                 "Use given addresses for block subsidy share paid to the funding stream with id <streamId> (regtest-only)");
     }
     std::string debugCategories = "addrman, alert, bench, coindb, db, estimatefee, http, libevent, lock, mempool, mempoolrej, net, partitioncheck, pow, proxy, prune, "
-                             "rand, receiveunsafe, reindex, rpc, selectcoins, tor, zmq, zrpc, zrpcunsafe (implies zrpc)"; // Don't translate these
+                             "rand, receiveunsafe, reindex, rpc, selectcoins, stratum, tor, zmq, zrpc, zrpcunsafe (implies zrpc)"; // Don't translate these
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
         _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + debugCategories + ". " +
         _("For multiple specific categories use -debug=<category> multiple times."));
@@ -462,8 +479,6 @@ std::string HelpMessage(HelpMessageMode mode)
         CURRENCY_UNIT, FormatMoney(DEFAULT_MIN_RELAY_TX_FEE)));
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees (in %s) to use in a single wallet transaction or raw transaction; setting this too low may abort large transactions (default: %s)"),
         CURRENCY_UNIT, FormatMoney(DEFAULT_TRANSACTION_MAXFEE)));
-    if (showDebug)
-        strUsage += HelpMessageOpt("MINE_GENESIS env", _("Mine a new genesis block - set environment variable MINE_GENESIS=1 (chainparams init happens before arg parsing, so env var is required)"));
     strUsage += HelpMessageOpt("-printtoconsole", _("Send trace/debug info to console instead of debug.log file"));
     if (showDebug)
     {
@@ -490,6 +505,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_THREADS));
     strUsage += HelpMessageOpt("-equihashsolver=<name>", _("Specify the Equihash solver to be used if enabled (default: \"default\")"));
     strUsage += HelpMessageOpt("-mineraddress=<addr>", _("Send mined coins to a specific single address"));
+    strUsage += HelpMessageOpt("-minerlanes=<n>", strprintf(_("Number of nonces each mining thread hashes together, interleaving their memory accesses (1 to %u, default: %u)"), YESPOWER_MAX_LANES, DEFAULT_MINER_LANES));
+    strUsage += HelpMessageOpt("-minerhugepages=<1g|2m|thp|none>", strprintf(_("Largest memory pages to back each mining thread's hashing memory with, falling back to smaller pages when unavailable (default: %s)"), DEFAULT_MINER_HUGEPAGES));
+    strUsage += HelpMessageOpt("-minerpinthreads", strprintf(_("Pin each mining thread to its own CPU, keeping its hashing memory on that CPU's NUMA node (default: %u)"), DEFAULT_MINER_PIN_THREADS));
     strUsage += HelpMessageOpt("-minetolocalwallet", strprintf(
             _("Require that mined blocks use a coinbase address in the local wallet (default: %u)"),
  #ifdef ENABLE_WALLET
@@ -498,6 +516,11 @@ std::string HelpMessage(HelpMessageMode mode)
             0
  #endif
             ));
+    strUsage += HelpMessageOpt("-stratum", strprintf(_("Serve mining work to external miners over the Stratum protocol (default: %u)"), DEFAULT_STRATUM_ENABLE));
+    strUsage += HelpMessageOpt("-stratumbind=<addr>", _("Bind to given address to listen for Stratum connections. Use [host]:port notation for IPv6. This option can be specified multiple times (default: bind to localhost)"));
+    strUsage += HelpMessageOpt("-stratumport=<port>", strprintf(_("Listen for Stratum connections on <port> (default: %u or testnet: %u)"), DEFAULT_STRATUM_PORT, DEFAULT_TESTNET_STRATUM_PORT));
+    strUsage += HelpMessageOpt("-stratumdifficulty=<n>", strprintf(_("Share difficulty for Stratum miners, as a divisor of the proof-of-work limit (default: %u)"), DEFAULT_STRATUM_DIFFICULTY));
+    strUsage += HelpMessageOpt("-stratumpassword=<pw>", _("Password miners must give in mining.authorize (default: accept any worker)"));
 #endif
 
     strUsage += HelpMessageGroup(_("RPC server options:"));
@@ -1000,16 +1023,23 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 
     // Make sure enough file descriptors are available
-    int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    // LevelDB table files kept open beyond the defaults need descriptors too
+    int nCoreFD = MIN_CORE_FILEDESCRIPTORS +
+        GetChainstateDBProfile().nMaxOpenFiles + GetBlockIndexDBProfile().nMaxOpenFiles - 2 * DEFAULT_DB_OPEN_FILES;
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS), 0);
-    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+#ifndef USE_EPOLL
+    // select() only handles sockets below FD_SETSIZE
+    int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
+    nMaxConnections = std::max(std::min(nMaxConnections, FD_SETSIZE - nBind - nCoreFD), 0);
+#endif
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + nCoreFD);
+    if (nFD < nCoreFD)
         return InitError(_("Not enough file descriptors available."));
-    nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS, nMaxConnections);
+    nMaxConnections = std::min(nFD - nCoreFD, nMaxConnections);
 
     if (nMaxConnections < nUserMaxConnections)
         InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, because of system limitations."), nUserMaxConnections, nMaxConnections));
@@ -1065,6 +1095,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fIBDSkipTxVerification = GetBoolArg("-ibdskiptxverification", DEFAULT_IBD_SKIP_TX_VERIFICATION);
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fCheckPoWOnDiskRead = GetBoolArg("-checkpowondiskread", DEFAULT_CHECK_POW_ON_DISK_READ);
+    fBackgroundFlush = GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH);
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
@@ -1151,6 +1183,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             }
         }
     }
+    if (ParseMinerHugepages(GetArg("-minerhugepages", DEFAULT_MINER_HUGEPAGES)) < 0)
+        return InitError(strprintf(_("Invalid value for -minerhugepages: '%s' (must be 1g, 2m, thp or none)"), mapArgs["-minerhugepages"]));
 #endif
 
     if (!mapMultiArgs["-nuparams"].empty()) {
@@ -1238,6 +1272,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1278,10 +1315,22 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    InitSignatureCache();
+
+    LogPrintf("Using %u threads for script, header PoW and merkle tree verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadHeaderPoWCheck);
+            threadGroup.create_thread(&ThreadMerkleCheck);
+        }
+        // Blocks are only prefetched once there are threads to do it, as
+        // the connect loop waits for them.
+        if (GetArg("-blockprefetch", DEFAULT_BLOCK_PREFETCH) > 0) {
+            for (int i=0; i<nScriptCheckThreads-1; i++)
+                threadGroup.create_thread(&ThreadBlockPrefetch);
+            nBlockPrefetch = GetArg("-blockprefetch", DEFAULT_BLOCK_PREFETCH);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1507,8 +1556,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         // increase cache if additional indices are needed
         nBlockTreeDBCache = nTotalCache * 3 / 4;
     }
+    // An explicit budget for a database may take at most the share that it could get by default
+    if (mapArgs.count("-blockindexdbcache"))
+        nBlockTreeDBCache = std::min(std::max(GetArg("-blockindexdbcache", 0), (int64_t)1) << 20, nTotalCache * 3 / 4);
     nTotalCache -= nBlockTreeDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
+    if (mapArgs.count("-chainstatedbcache"))
+        nCoinDBCache = std::min(std::max(GetArg("-chainstatedbcache", 0), (int64_t)1) << 20, nTotalCache / 2);
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
@@ -1820,11 +1874,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
-    StartNode(threadGroup, scheduler);
+    if (!StartNode(threadGroup, scheduler))
+        return InitError(_("Unable to start the network event loop. See debug log for details."));
 
 #ifdef ENABLE_MINING
     // Generate coins in the background
     GenerateBitcoins(GetBoolArg("-gen", DEFAULT_GENERATE), GetArg("-genproclimit", DEFAULT_GENERATE_THREADS), chainparams);
+
+    // Serve work to external miners
+    if (GetBoolArg("-stratum", DEFAULT_STRATUM_ENABLE) && !StartStratumServer())
+        return InitError(_("Unable to start Stratum server. See debug log for details."));
 #endif
 
     // ********************************************************* Step 12: finished
@@ -10,6 +10,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -39,6 +40,8 @@
 
 #include <algorithm>
 #include <atomic>
+#include <deque>
+#include <memory>
 #include <sstream>
 #include <variant>
 
@@ -82,6 +85,9 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 bool fIBDSkipTxVerification = DEFAULT_IBD_SKIP_TX_VERIFICATION;
+bool fCheckPoWOnDiskRead = DEFAULT_CHECK_POW_ON_DISK_READ;
+int nBlockPrefetch = 0; // Set by init once the prefetch threads are running
+bool fBackgroundFlush = DEFAULT_BACKGROUND_FLUSH;
 bool fCoinbaseEnforcedShieldingEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -258,9 +264,24 @@ namespace {
         int64_t nTime;           //!< Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //!< Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //!< The timeout for this block request (for disconnecting a slow peer)
+        std::unique_ptr<PartiallyDownloadedBlock> partialBlock; //!< Optional, used for compact blocks.
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+    /** Peers we asked to announce new blocks to us as compact blocks, oldest first. Protected by cs_main. */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+    /** The most recently connected block and its compact form, kept to answer
+     * "getdata" and "getblocktxn" for it, and to announce it to peers that
+     * prefer compact blocks, without going to disk. Its "block" and
+     * "cmpctblock" messages are serialized once and shared by every peer
+     * they are sent to; the "block" message only once a peer asks for it.
+     * Protected by cs_main. */
+    uint256 hashMostRecentBlock;
+    std::shared_ptr<const CBlock> pblockMostRecent;
+    CSharedNetMessage msgBlockMostRecent;
+    CSharedNetMessage msgCmpctBlockMostRecent;
+
     /** Number of blocks in flight with validated headers. */
     int nQueuedValidatedHeaders = 0;
 
@@ -273,8 +294,16 @@ namespace {
     /** Dirty block file entries. */
     set<int> setDirtyFileInfo;
 
+    /** A transaction in the relay map, and its "tx" message once a peer has
+     * asked for it, shared by all the peers that ask after that. */
+    struct CRelayTx
+    {
+        std::shared_ptr<const CTransaction> tx;
+        CSharedNetMessage msg;
+    };
+
     /** Relay map, protected by cs_main. */
-    typedef std::map<uint256, std::shared_ptr<const CTransaction>> MapRelay;
+    typedef std::map<uint256, CRelayTx> MapRelay;
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
@@ -327,6 +356,14 @@ struct CNodeState {
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer wants new blocks announced to it as compact blocks.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer will send us compact blocks if we ask for them.
+    bool fProvidesHeaderAndIDs;
+    //! Whether we want this peer to announce new blocks to us as compact blocks.
+    bool fRequestHeaderAndIDs;
+    //! Whether fRequestHeaderAndIDs changed since we last sent "sendcmpct".
+    bool fSendCmpct;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -340,6 +377,10 @@ struct CNodeState {
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
+        fRequestHeaderAndIDs = false;
+        fSendCmpct = false;
     }
 };
 
@@ -398,6 +439,7 @@ void FinalizeNode(NodeId nodeid) {
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
@@ -420,21 +462,70 @@ bool MarkBlockAsReceived(const uint256& hash) {
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
+// Returns false, still setting pit, if the block was already in flight from the same peer.
+// pit will only be valid as long as the same cs_main lock is being held.
+bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL, list<QueuedBlock>::iterator **pit = NULL) {
     CNodeState *state = State(nodeid);
     assert(state != NULL);
 
+    // Short-circuit most stuff in case it's from the same node.
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid) {
+        if (pit)
+            *pit = &itInFlight->second.second;
+        return false;
+    }
+
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
     int64_t nNow = GetTimeMicros();
     int nHeight = pindex != NULL ? pindex->nHeight : chainActive.Height(); // Help block timeout computation
-    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams, nHeight)};
+    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams, nHeight),
+                            std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)};
     nQueuedValidatedHeaders += newentry.fValidatedHeaders;
-    list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
-    state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
-    mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), std::move(newentry));
+    state->nBlocksInFlight++;
+    itInFlight = mapBlocksInFlight.insert(std::make_pair(hash, std::make_pair(nodeid, it))).first;
+    if (pit)
+        *pit = &itInFlight->second.second;
+    return true;
+}
+
+// Requires cs_main.
+// Asks the peer that just gave us a new tip to announce its next blocks to
+// us as compact blocks, in place of the longest-serving of the (at most
+// three) peers that already do.
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid) {
+    CNodeState *nodestate = State(nodeid);
+    if (nodestate == NULL || !nodestate->fProvidesHeaderAndIDs)
+        return;
+    for (list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_ANNOUNCERS) {
+        CNodeState *stateOldest = State(lNodesAnnouncingHeaderAndIDs.front());
+        if (stateOldest) {
+            stateOldest->fRequestHeaderAndIDs = false;
+            stateOldest->fSendCmpct = true;
+        }
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+    }
+    nodestate->fRequestHeaderAndIDs = true;
+    nodestate->fSendCmpct = true;
+    lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+}
+
+// Requires cs_main.
+// Whether we are close enough to the tip to fetch newly announced blocks
+// straight away, rather than through the parallel block download.
+bool CanDirectFetch(const Consensus::Params& consensusParams) {
+    return chainActive.Tip()->GetBlockTime() > GetTime() - consensusParams.PoWTargetSpacing(pindexBestHeader->nHeight) * 20;
 }
 
 /** Check whether the last unknown block a peer advertized is not yet known. */
@@ -628,6 +719,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -812,6 +904,8 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
  *    nHeight can become valid at a later height), we make the bans conditional on not
  *    being in Initial Block Download mode.
  * 4. The isInitBlockDownload argument is a function parameter to assist with testing.
+ * 5. If saplingVerifier is non-NULL, Sapling proofs are queued into it rather than
+ *    verified here; the caller must check ProofVerifier::ValidateSaplingBatch().
  */
 bool ContextualCheckTransaction(
         const CTransaction& tx,
@@ -819,7 +913,8 @@ bool ContextualCheckTransaction(
         const CChainParams& chainparams,
         const int nHeight,
         const bool isMined,
-        bool (*isInitBlockDownload)(const Consensus::Params&))
+        bool (*isInitBlockDownload)(const Consensus::Params&),
+        ProofVerifier* saplingVerifier)
 {
     const int DOS_LEVEL_BLOCK = 100;
     // DoS level set to 10 to be more forgiving.
@@ -1287,7 +1382,9 @@ bool ContextualCheckTransaction(
         //
         // - spendAuthSig in Sapling Spend descriptions
         // - bindingSigSapling
-        auto ctx = librustzcash_sapling_verification_ctx_init(nu5Active);
+        auto ctx = saplingVerifier ?
+            saplingVerifier->SaplingVerificationContext(nu5Active) :
+            librustzcash_sapling_verification_ctx_init(nu5Active);
 
         for (const SpendDescription &spend : tx.vShieldedSpend) {
             if (!librustzcash_sapling_check_spend(
@@ -1368,14 +1465,15 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state,
         }
 
         // Sapling zk-SNARK proofs are checked in librustzcash_sapling_check_{spend,output},
-        // called from ContextualCheckTransaction.
+        // called from ContextualCheckTransaction, or batched across a block by
+        // ContextualCheckBlock.
 
         // Check bundle-specific Orchard consensus rules. Since we check encoding
         // consensus rules at parse time, and signature validation is batched, all we are
         // checking here is proof validity. Once we implement batched proof verification,
         // this will move into orchardAuth.
         auto orchardBundle = tx.GetOrchardBundle();
-        if (!orchardBundle.CheckBundleSpecificConsensusRules()) {
+        if (!verifier.VerifyOrchard(orchardBundle)) {
             return state.DoS(
                 100, error("CheckTransaction(): Orchard bundle proof does not verify"),
                 REJECT_INVALID, "bad-txns-orchard-verification-failed");
@@ -2050,14 +2148,24 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     return true;
 }
 
-bool GetAddressIndex(const uint160& addressHash, int type,
-                     std::vector<CAddressIndexDbEntry>& addressIndex,
-                     int start, int end)
+bool GetAddressBalance(const uint160& addressHash, int type, CAddressBalanceValue& value)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pblocktree->ReadAddressBalance(addressHash, type, value))
+        return error("unable to get balance for address");
+
+    return true;
+}
+
+bool ScanAddressIndex(const CAddressIndexKey& keyStart, int end,
+                      const std::function<bool(const CAddressIndexKey&, CAmount)>& fn)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ScanAddressIndex(keyStart, end, fn))
         return error("unable to get txids for address");
 
     return true;
@@ -2172,7 +2280,7 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     block.SetNull();
 
@@ -2190,7 +2298,7 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     }
 
     // Check the header
-    if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+    if (fCheckPOW && !CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     return true;
@@ -2198,11 +2306,70 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
+    // If the header's PoW was already verified when it entered the block
+    // index, matching the header hash below is enough to know the PoW is
+    // still valid, so we can skip the (memory-hard) yespower computation.
+    bool fCachedPoW = pindex->nStatus & BLOCK_VALID_POW;
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, !fCachedPoW))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (fCachedPoW && fCheckPoWOnDiskRead && block.GetPoWHash() != pindex->hashPoW)
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetPoWHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    block.clear();
+
+    // Step back over the index header that WriteBlockToDisk put in front of
+    // the block, which gives us its size.
+    CDiskBlockPos pos = pindex->GetBlockPos();
+    const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < nHeaderSize)
+        return error("ReadRawBlockFromDisk: Invalid block position %s", pos.ToString());
+    pos.nPos -= nHeaderSize;
+
+    // Open history file to read
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    // Read index header and block
+    try {
+        CMessageHeader::MessageStartChars blockStart;
+        unsigned int nSize;
+        filein >> FLATDATA(blockStart) >> nSize;
+        if (memcmp(blockStart, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+            return error("ReadRawBlockFromDisk: Block magic mismatch for %s", pos.ToString());
+        if (nSize < CBlockHeader::HEADER_SIZE || nSize > MAX_BLOCK_SIZE)
+            return error("ReadRawBlockFromDisk: Invalid block size %u at %s", nSize, pos.ToString());
+        block.resize(nSize);
+        filein.read((char*)block.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    // Only the header is decoded, to check that the bytes are the block we
+    // were asked for, as ReadBlockFromDisk does.
+    CBlockHeader header;
+    try {
+        CDataStream ss((const char*)block.data(), (const char*)block.data() + CBlockHeader::HEADER_SIZE, SER_DISK, CLIENT_VERSION);
+        ss >> header;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk: GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (fCheckPoWOnDiskRead && (pindex->nStatus & BLOCK_VALID_POW) && header.GetPoWHash() != pindex->hashPoW)
+        return error("ReadRawBlockFromDisk: GetPoWHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
     return true;
 }
 
@@ -2970,11 +3137,44 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+bool CProofCheck::operator()() {
+    auto verifier = ProofVerifier::Strict();
+    for (const JSDescription &joinsplit : ptxTo->vJoinSplit) {
+        if (!verifier.VerifySprout(joinsplit, ptxTo->joinSplitPubKey)) {
+            *pstrRejectReason = "bad-txns-joinsplit-verification-failed";
+            return false;
+        }
+    }
+    if (!verifier.VerifyOrchard(ptxTo->GetOrchardBundle())) {
+        *pstrRejectReason = "bad-txns-orchard-verification-failed";
+        return false;
+    }
+    return true;
+}
+
+bool CBlockCheck::operator()() {
+    return std::visit([](auto& check) { return check(); }, check);
+}
+
+// Batches adapt to the number of idle threads; this only caps them.
+static CCheckQueue<CBlockCheck> blockcheckqueue(128);
 
 void ThreadScriptCheck() {
     RenameThread("koto-scriptch");
-    scriptcheckqueue.Thread();
+    blockcheckqueue.Thread();
+}
+
+// Each yespower hash takes milliseconds, so hand out one header at a time.
+static CCheckQueue<CHeaderPoWCheck> headerpowcheckqueue(1);
+
+void ThreadHeaderPoWCheck() {
+    RenameThread("koto-powcheck");
+    headerpowcheckqueue.Thread();
+}
+
+bool CHeaderPoWCheck::operator()() {
+    *phashPoW = pheader->GetPoWHash();
+    return CheckProofOfWork(*phashPoW, pheader->nBits, *pconsensusParams);
 }
 
 static int64_t nTimeVerify = 0;
@@ -2998,33 +3198,207 @@ static bool ShouldCheckTransactions(const CChainParams& chainparams, const CBloc
              && Checkpoints::IsAncestorOfLastCheckpoint(chainparams.Checkpoints(), pindex));
 }
 
+/**
+ * Determine whether to verify proofs and signatures when connecting a block.
+ * Blocks that are ancestors of the latest checkpoint skip these checks.
+ */
+static bool ShouldRunExpensiveChecks(const CChainParams& chainparams, const CBlockIndex* pindex) {
+    return !(fCheckpointsEnabled && Checkpoints::IsAncestorOfLastCheckpoint(chainparams.Checkpoints(), pindex));
+}
+
+/**
+ * A block read from disk ahead of the chain tip by the block prefetch
+ * threads, together with the outcome of its context-free checks. Everything
+ * the threads need from the block index is copied in while cs_main is held,
+ * so they never take it.
+ */
+struct CBlockPrefetch
+{
+    const CBlockIndex* pindex;
+    CDiskBlockPos pos;
+    uint256 hash;
+    uint256 hashPoW;
+    bool fCachedPoW;
+
+    // Flags CheckBlock() is run with, as ConnectBlock() would choose them
+    bool fExpensiveChecks;
+    bool fCheckTransactions;
+    bool fCheckPOW;
+
+    bool fDone = false;
+    //! The block was read and matches the index
+    bool fRead = false;
+    //! CheckBlock() passed, including Orchard signature validation
+    bool fChecked = false;
+    CBlock block;
+
+    void Run(const CChainParams& chainparams);
+};
+
+void CBlockPrefetch::Run(const CChainParams& chainparams)
+{
+    // Leave the PoW to CheckBlock(), so that it is computed at most once.
+    if (!ReadBlockFromDisk(block, pos, chainparams.GetConsensus(), false))
+        return;
+    if (block.GetHash() != hash)
+        return;
+    if (fCachedPoW && fCheckPoWOnDiskRead && block.GetPoWHash() != hashPoW)
+        return;
+    fRead = true;
+
+    auto verifier = fExpensiveChecks ? ProofVerifier::Strict() : ProofVerifier::Disabled();
+    auto orchardAuth = fExpensiveChecks ?
+        orchard::AuthValidator::Batch() : orchard::AuthValidator::Disabled();
+    CValidationState state;
+    fChecked = CheckBlock(block, state, chainparams, verifier, orchardAuth,
+        fCheckPOW, true, fCheckTransactions) && orchardAuth.Validate();
+}
+
+/**
+ * Queue of blocks to read and check ahead of the chain tip while
+ * ActivateBestChainStep() connects blocks, which is the only part that has
+ * to run serially under cs_main. Each prefetch thread takes the lowest queued
+ * block, so disk reads of some blocks overlap with the proof verification of
+ * others, and blocks finish roughly in the order they are connected.
+ */
+class CBlockPrefetchQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDone;
+
+    //! Blocks waiting for a prefetch thread, in height order
+    std::deque<std::shared_ptr<CBlockPrefetch>> queue;
+    //! Blocks queued or prefetched that have not been taken yet
+    std::map<const CBlockIndex*, std::shared_ptr<CBlockPrefetch>> mapPrefetch;
+
+public:
+    void Thread(const CChainParams& chainparams)
+    {
+        while (true) {
+            std::shared_ptr<CBlockPrefetch> prefetch;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty())
+                    condWorker.wait(lock);
+                prefetch = queue.front();
+                queue.pop_front();
+            }
+            prefetch->Run(chainparams);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                prefetch->fDone = true;
+            }
+            condDone.notify_all();
+        }
+    }
+
+    /**
+     * Queue up to nBlockPrefetch blocks following pindexFrom on the way to
+     * pindexTo, and forget blocks that are not on that path.
+     */
+    void Prefetch(const CChainParams& chainparams, const CBlockIndex* pindexFrom, CBlockIndex* pindexTo)
+    {
+        AssertLockHeld(cs_main);
+        int nHeightFrom = pindexFrom ? pindexFrom->nHeight : -1;
+        int nHeightTo = std::min(nHeightFrom + nBlockPrefetch, pindexTo->nHeight);
+
+        std::vector<std::shared_ptr<CBlockPrefetch>> vNew;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (auto it = mapPrefetch.begin(); it != mapPrefetch.end(); ) {
+            const CBlockIndex* pindex = it->first;
+            if (pindex->nHeight <= nHeightFrom || pindex->nHeight > nHeightTo ||
+                pindexTo->GetAncestor(pindex->nHeight) != pindex) {
+                queue.erase(std::remove(queue.begin(), queue.end(), it->second), queue.end());
+                it = mapPrefetch.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (int nHeight = nHeightFrom + 1; nHeight <= nHeightTo; nHeight++) {
+            CBlockIndex* pindex = pindexTo->GetAncestor(nHeight);
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                break;
+            if (mapPrefetch.count(pindex))
+                continue;
+            auto prefetch = std::make_shared<CBlockPrefetch>();
+            prefetch->pindex = pindex;
+            prefetch->pos = pindex->GetBlockPos();
+            prefetch->hash = pindex->GetBlockHash();
+            prefetch->hashPoW = pindex->hashPoW;
+            prefetch->fCachedPoW = pindex->nStatus & BLOCK_VALID_POW;
+            prefetch->fExpensiveChecks = ShouldRunExpensiveChecks(chainparams, pindex);
+            prefetch->fCheckTransactions = ShouldCheckTransactions(chainparams, pindex);
+            prefetch->fCheckPOW = !prefetch->fCachedPoW;
+            mapPrefetch.emplace(pindex, prefetch);
+            vNew.push_back(prefetch);
+        }
+        if (vNew.empty())
+            return;
+        queue.insert(queue.end(), vNew.begin(), vNew.end());
+        std::sort(queue.begin(), queue.end(), [](const std::shared_ptr<CBlockPrefetch>& a, const std::shared_ptr<CBlockPrefetch>& b) {
+            return a->pindex->nHeight < b->pindex->nHeight;
+        });
+        lock.unlock();
+        condWorker.notify_all();
+    }
+
+    /**
+     * Take the prefetched block for pindex, waiting for it to be read and
+     * checked if necessary. Returns NULL if pindex was not queued.
+     */
+    std::shared_ptr<CBlockPrefetch> Take(const CBlockIndex* pindex)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        auto it = mapPrefetch.find(pindex);
+        if (it == mapPrefetch.end())
+            return nullptr;
+        std::shared_ptr<CBlockPrefetch> prefetch = it->second;
+        mapPrefetch.erase(it);
+        while (!prefetch->fDone)
+            condDone.wait(lock);
+        return prefetch;
+    }
+
+};
+
+static CBlockPrefetchQueue blockprefetchqueue;
+
+void ThreadBlockPrefetch() {
+    RenameThread("koto-prefetch");
+    blockprefetchqueue.Thread(Params());
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
                   CCoinsViewCache& view, const CChainParams& chainparams,
-                  bool fJustCheck, bool fCheckAuthDataRoot)
+                  bool fJustCheck, bool fCheckAuthDataRoot, bool fCheckedContextFree)
 {
     AssertLockHeld(cs_main);
 
-    bool fExpensiveChecks = true;
-
     // If this block is an ancestor of a checkpoint, disable expensive checks
-    if (fCheckpointsEnabled && Checkpoints::IsAncestorOfLastCheckpoint(chainparams.Checkpoints(), pindex)) {
-        fExpensiveChecks = false;
-    }
+    bool fExpensiveChecks = ShouldRunExpensiveChecks(chainparams, pindex);
 
-    // proof verification is expensive, disable if possible
-    auto verifier = fExpensiveChecks ? ProofVerifier::Strict() : ProofVerifier::Disabled();
+    // proof verification is expensive, disable if possible. With script check
+    // threads, Sprout and Orchard proofs are queued on them below instead.
+    bool fQueueProofs = fExpensiveChecks && !fCheckedContextFree && nScriptCheckThreads;
+    auto verifier = fExpensiveChecks && !fCheckedContextFree && !fQueueProofs ?
+        ProofVerifier::Strict() : ProofVerifier::Disabled();
 
     // Disable Orchard batch signature validation if possible.
-    auto orchardAuth = fExpensiveChecks ?
+    auto orchardAuth = fExpensiveChecks && !fCheckedContextFree ?
         orchard::AuthValidator::Batch() : orchard::AuthValidator::Disabled();
 
     // If in initial block download, and this block is an ancestor of a checkpoint,
     // and -ibdskiptxverification is set, disable all transaction checks.
     bool fCheckTransactions = ShouldCheckTransactions(chainparams, pindex);
 
-    // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in
-    if (!CheckBlock(block, state, chainparams, verifier, orchardAuth,
-        !fJustCheck, !fJustCheck, fCheckTransactions))
+    // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in.
+    // The PoW doesn't need to be rechecked if it was verified when the header was accepted.
+    // Blocks prefetched during connection have had these checks done already.
+    bool fCheckPOW = !fJustCheck && !(pindex->nStatus & BLOCK_VALID_POW);
+    if (!fCheckedContextFree && !CheckBlock(block, state, chainparams, verifier, orchardAuth,
+        fCheckPOW, !fJustCheck, fCheckTransactions))
     {
         return false;
     }
@@ -3105,7 +3479,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // One slot per transaction for the reason its queued proof check
+    // failed. It has to outlive control, which waits for the checks when it
+    // goes out of scope.
+    std::vector<std::string> vProofRejectReasons;
+    CCheckQueueControl<CBlockCheck> control(fExpensiveChecks && nScriptCheckThreads ? &blockcheckqueue : NULL);
+
+    if (fQueueProofs && fCheckTransactions) {
+        std::vector<CBlockCheck> vProofChecks;
+        vProofRejectReasons.resize(block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = block.vtx[i];
+            if (!tx.vJoinSplit.empty() || tx.GetOrchardBundle().IsPresent()) {
+                vProofChecks.emplace_back(CProofCheck(tx, vProofRejectReasons[i]));
+            }
+        }
+        control.Add(vProofChecks);
+    }
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -3233,7 +3623,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, flags, fCacheResults, txdata[i], chainparams.GetConsensus(), consensusBranchId, nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
+            std::vector<CBlockCheck> vBlockChecks;
+            vBlockChecks.reserve(vChecks.size());
+            for (CScriptCheck& check : vChecks) {
+                vBlockChecks.emplace_back(std::move(check));
+            }
+            control.Add(vBlockChecks);
         }
 
         // insightexplorer
@@ -3454,8 +3849,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             REJECT_INVALID, "bad-orchard-bundle-authorization");
     }
 
-    if (!control.Wait())
+    if (!control.Wait()) {
+        // Failed script checks leave no reason behind, failed proof checks do.
+        for (const std::string& strRejectReason : vProofRejectReasons) {
+            if (!strRejectReason.empty()) {
+                return state.DoS(100, error("ConnectBlock(): a Sprout or Orchard proof within the block does not verify"),
+                                 REJECT_INVALID, strRejectReason);
+            }
+        }
         return state.DoS(100, false);
+    }
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
 
@@ -3572,6 +3975,9 @@ bool static FlushStateToDisk(
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
+    // An earlier flush that was being written in the background has failed.
+    if (pcoinsdbview && pcoinsdbview->BackgroundFlushFailed())
+        return AbortNode(state, "Failed to write to coin database");
     if (fPruneMode && fCheckForPruning && !fReindex) {
         FindFilesToPrune(setFilesToPrune, chainparams.PruneAfterHeight());
         fCheckForPruning = false;
@@ -3642,6 +4048,10 @@ bool static FlushStateToDisk(
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
+        // Unless this is the final flush, or blocks are about to be pruned,
+        // let the database write it in the background while we continue.
+        if (fBackgroundFlush && pcoinsdbview && mode != FLUSH_STATE_ALWAYS && !fFlushForPrune)
+            pcoinsdbview->FlushInBackground();
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
@@ -3862,9 +4272,10 @@ uint64_t nNotifiedSequence = 0;
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
+ * fCheckedContextFree is set if pblock already passed CheckBlock() on a prefetch thread.
  * You probably want to call mempool.removeWithoutBranchId after this, with cs_main held.
  */
-bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock)
+bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock, bool fCheckedContextFree = false)
 {
     assert(pblock && pindexNew->pprev == chainActive.Tip());
     // Apply the block atomically to the chain state.
@@ -3872,13 +4283,22 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime3;
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams);
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams, false, true, fCheckedContextFree);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state, chainparams);
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
+        if (!IsInitialBlockDownload(chainparams.GetConsensus())) {
+            std::map<uint256, NodeId>::iterator it = mapBlockSource.find(pindexNew->GetBlockHash());
+            if (it != mapBlockSource.end())
+                MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second);
+            hashMostRecentBlock = pindexNew->GetBlockHash();
+            pblockMostRecent = std::make_shared<const CBlock>(*pblock);
+            msgBlockMostRecent.reset();
+            msgCmpctBlockMostRecent = CNode::MakeSharedMessage("cmpctblock", CBlockHeaderAndShortTxIDs(*pblock));
+        }
         mapBlockSource.erase(pindexNew->GetBlockHash());
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
@@ -4079,18 +4499,33 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
             int64_t nTime1 = GetTimeMicros();
             const CBlock* pconnectBlock;
             CBlock block;
+            std::shared_ptr<CBlockPrefetch> prefetch;
+            bool fCheckedContextFree = false;
             if (pblock && pindexConnect == pindexMostWork) {
                 pconnectBlock = pblock;
             } else {
-                // read the block to be connected from disk
-                if (!ReadBlockFromDisk(block, pindexConnect, chainparams.GetConsensus()))
-                    return AbortNode(state, "Failed to read block");
-                pconnectBlock = &block;
+                // Have the prefetch threads read and check the blocks that
+                // follow while this one is connected.
+                if (nBlockPrefetch > 0)
+                    blockprefetchqueue.Prefetch(chainparams, pindexConnect->pprev, pindexMostWork);
+                prefetch = blockprefetchqueue.Take(pindexConnect);
+                if (prefetch && prefetch->fRead) {
+                    pconnectBlock = &prefetch->block;
+                    // Only skip the checks if ConnectBlock() would still run them the same way.
+                    fCheckedContextFree = prefetch->fChecked &&
+                        prefetch->fExpensiveChecks == ShouldRunExpensiveChecks(chainparams, pindexConnect) &&
+                        prefetch->fCheckTransactions == ShouldCheckTransactions(chainparams, pindexConnect);
+                } else {
+                    // read the block to be connected from disk
+                    if (!ReadBlockFromDisk(block, pindexConnect, chainparams.GetConsensus()))
+                        return AbortNode(state, "Failed to read block");
+                    pconnectBlock = &block;
+                }
             }
             int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
             LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
 
-            if (!ConnectTip(state, chainparams, pindexConnect, pconnectBlock)) {
+            if (!ConnectTip(state, chainparams, pindexConnect, pconnectBlock, fCheckedContextFree)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -4583,7 +5018,8 @@ bool CheckBlockHeader(
     const CBlockHeader& block,
     CValidationState& state,
     const CChainParams& chainparams,
-    bool fCheckPOW)
+    bool fCheckPOW,
+    uint256* phashPoW)
 {
     // Check block version
     if (block.nVersion < MIN_BLOCK_VERSION)
@@ -4591,9 +5027,14 @@ bool CheckBlockHeader(
                          REJECT_INVALID, "version-too-low");
 
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetPoWHash(), block.nBits, chainparams.GetConsensus()))
-        return state.DoS(50, error("CheckBlockHeader(): proof of work failed"),
-                         REJECT_INVALID, "high-hash");
+    if (fCheckPOW) {
+        uint256 hashPoW = block.GetPoWHash();
+        if (!CheckProofOfWork(hashPoW, block.nBits, chainparams.GetConsensus()))
+            return state.DoS(50, error("CheckBlockHeader(): proof of work failed"),
+                             REJECT_INVALID, "high-hash");
+        if (phashPoW)
+            *phashPoW = hashPoW;
+    }
 
     return true;
 }
@@ -4745,11 +5186,16 @@ bool ContextualCheckBlock(
     const Consensus::Params& consensusParams = chainparams.GetConsensus();
 
     if (fCheckTransactions) {
+        // Sapling proofs from every transaction are verified together once all
+        // the other checks have passed.
+        auto saplingVerifier = ProofVerifier::Batch();
+
         // Check that all transactions are finalized
         for (const CTransaction& tx : block.vtx) {
 
             // Check transaction contextually against consensus rules at block height
-            if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true)) {
+            if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true,
+                                            IsInitialBlockDownload, &saplingVerifier)) {
                 return false; // Failure reason has been set in validation state object
             }
 
@@ -4762,6 +5208,21 @@ bool ContextualCheckBlock(
                                  REJECT_INVALID, "bad-txns-nonfinal");
             }
         }
+
+        if (!saplingVerifier.ValidateSaplingBatch()) {
+            // The batch only says that some proof is invalid; verify the
+            // shielded transactions one at a time to find the culprit.
+            for (const CTransaction& tx : block.vtx) {
+                if (tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty()) {
+                    continue;
+                }
+                if (!ContextualCheckTransaction(tx, state, chainparams, nHeight, true)) {
+                    return false;
+                }
+            }
+            return state.DoS(100, error("%s: Sapling proof batch does not verify", __func__),
+                             REJECT_INVALID, "bad-txns-sapling-batch-verification-failed");
+        }
     }
 
     // Enforce BIP 34 rule that the coinbase starts with serialized block height.
@@ -4806,7 +5267,12 @@ bool ContextualCheckBlock(
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+/**
+ * Add a header to the block index.
+ * If phashPoW is non-NULL, it is the already computed yespower hash of the
+ * header, and only needs to be checked against the target.
+ */
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, const uint256* phashPoW=NULL)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -4823,8 +5289,17 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
         return true;
     }
 
-    if (!CheckBlockHeader(block, state, chainparams))
+    uint256 hashPoW;
+    if (phashPoW) {
+        hashPoW = *phashPoW;
+        if (!CheckBlockHeader(block, state, chainparams, false))
+            return false;
+        if (!CheckProofOfWork(hashPoW, block.nBits, chainparams.GetConsensus()))
+            return state.DoS(50, error("%s: proof of work failed", __func__),
+                             REJECT_INVALID, "high-hash");
+    } else if (!CheckBlockHeader(block, state, chainparams, true, &hashPoW)) {
         return false;
+    }
 
     // Get prev block index
     CBlockIndex* pindexPrev = NULL;
@@ -4843,6 +5318,10 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     if (pindex == NULL)
         pindex = AddToBlockIndex(block, chainparams.GetConsensus());
 
+    // Remember the verified PoW hash so that later checks and disk reads of
+    // this block don't need to recompute it.
+    pindex->SetPoWHash(hashPoW);
+
     if (ppindex)
         *ppindex = pindex;
 
@@ -4892,8 +5371,10 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     auto verifier = ProofVerifier::Disabled();
     auto orchardAuth = orchard::AuthValidator::Disabled();
 
+    // The header's PoW has already been checked by AcceptBlockHeader.
+    bool fCheckPOW = !(pindex->nStatus & BLOCK_VALID_POW);
     bool fCheckTransactions = ShouldCheckTransactions(chainparams, pindex);
-    if ((!CheckBlock(block, state, chainparams, verifier, orchardAuth, true, true, fCheckTransactions)) ||
+    if ((!CheckBlock(block, state, chainparams, verifier, orchardAuth, fCheckPOW, true, fCheckTransactions)) ||
          !ContextualCheckBlock(block, state, chainparams, pindex->pprev, fCheckTransactions)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -4940,6 +5421,56 @@ static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned
 }
 
 
+/**
+ * Compute the yespower hashes of a batch of headers received from the network
+ * on the header PoW checking threads, before cs_main is taken to accept them.
+ *
+ * vHashPoW[i] is set to the hash of headers[i], or left null if that header
+ * was not hashed (it is already known, or hashing stopped early because some
+ * header failed its PoW check). Headers are only hashed if the batch is a
+ * continuous sequence that connects to a block we know about, so that a peer
+ * cannot make us do more PoW work than the serial path would.
+ */
+static void PrevalidateHeadersPoW(const std::vector<CBlockHeader>& headers, std::vector<uint256>& vHashPoW, const Consensus::Params& consensusParams)
+{
+    vHashPoW.assign(headers.size(), uint256());
+    if (nScriptCheckThreads == 0 || headers.size() < 2)
+        return;
+
+    std::vector<uint256> vHash;
+    vHash.reserve(headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (i > 0 && headers[i].hashPrevBlock != vHash.back())
+            return;
+        vHash.push_back(headers[i].GetHash());
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<CHeaderPoWCheck> vChecks;
+    vChecks.reserve(headers.size());
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(headers[0].hashPrevBlock) == 0)
+            return;
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (mapBlockIndex.count(vHash[i]) == 0)
+                vChecks.emplace_back(headers[i], vHashPoW[i], consensusParams);
+        }
+    }
+    if (vChecks.empty())
+        return;
+
+    size_t nChecks = vChecks.size();
+    CCheckQueueControl<CHeaderPoWCheck> control(&headerpowcheckqueue);
+    control.Add(vChecks);
+    // Failures are reported with the appropriate DoS score by AcceptBlockHeader.
+    control.Wait();
+
+    int64_t nTime = GetTimeMicros() - nTimeStart;
+    LogPrint("bench", "- Verify %u header PoW hashes: %.2fms (%.3fms/header) using %d threads\n",
+        (unsigned)nChecks, 0.001 * nTime, 0.001 * nTime / nChecks, nScriptCheckThreads);
+}
+
 bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, const CNode* pfrom, const CBlock* pblock, bool fForceProcessing, const CDiskBlockPos* dbp)
 {
     auto span = TracingSpan("info", "main", "ProcessNewBlock");
@@ -5327,6 +5858,18 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         fAddressIndex = true;
     }
 
+    // Address indexes created before the address balance index was added
+    // don't have one yet.
+    if (fAddressIndex && !fReindex) {
+        bool fAddressBalanceIndex = false;
+        pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+        if (!fAddressBalanceIndex) {
+            LogPrintf("%s: building the address balance index\n", __func__);
+            if (!pblocktree->RebuildAddressBalanceIndex() || !pblocktree->WriteFlag("addressbalanceindex", true))
+                return error("%s: failed to build the address balance index", __func__);
+        }
+    }
+
     // Fill in-memory data
     for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
     {
@@ -5700,6 +6243,8 @@ bool InitBlockIndex(const CChainParams& chainparams)
     else if (fExperimentalLightWalletd) {
         fAddressIndex = true;
     }
+    // The address balance index is kept up to date from the start
+    pblocktree->WriteFlag("addressbalanceindex", fAddressIndex);
 
     LogPrintf("Initializing databases...\n");
 
@@ -6091,8 +6636,6 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -6103,55 +6646,123 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                // Decide whether to send the block under cs_main, but read and
+                // serialize it without, so that serving blocks does not hold up
+                // validation or other peers' messages.
+                bool fHaveData = false;
+                CBlockIndex indexSend;
+                uint256 hashContinueTip;
+                bool fSendCompact = false;
+                std::shared_ptr<const CBlock> pblock;
+                CSharedNetMessage msgBlock;
+                CSharedNetMessage msgCmpctBlock;
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                    LOCK(cs_main);
+                    bool send = false;
+                    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+                    if (mi != mapBlockIndex.end())
+                    {
+                        if (chainActive.Contains(mi->second)) {
+                            send = true;
+                        } else {
+                            static const int nOneMonth = 30 * 24 * 60 * 60;
+                            // To prevent fingerprinting attacks, only send blocks outside of the active
+                            // chain if they are valid, and no more than a month older (both in time, and in
+                            // best equivalent proof of work) than the best header chain we know about.
+                            send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                                (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                                (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
+                            if (!send) {
+                                LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                            }
                         }
                     }
-                }
-                // disconnect node in case we have reached the outbound limit for serving historical blocks
-                // never disconnect whitelisted nodes
-                static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
-                if (send && CNode::OutboundTargetReached(consensusParams.PoWTargetSpacing(currentHeight), true) && (
-                        (
-                            (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)
-                        ) || inv.type == MSG_FILTERED_BLOCK
-                    ) && !pfrom->fWhitelisted)
-                {
-                    LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+                    // disconnect node in case we have reached the outbound limit for serving historical blocks
+                    // never disconnect whitelisted nodes
+                    static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
+                    if (send && CNode::OutboundTargetReached(consensusParams.PoWTargetSpacing(currentHeight), true) && (
+                            (
+                                (pindexBestHeader != NULL) &&
+                                (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)
+                            ) || inv.type == MSG_FILTERED_BLOCK
+                        ) && !pfrom->fWhitelisted)
+                    {
+                        LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
-                    //disconnect node
-                    pfrom->fDisconnect = true;
-                    send = false;
+                        //disconnect node
+                        pfrom->fDisconnect = true;
+                        send = false;
+                    }
+                    // Pruned nodes may have deleted the block, so check whether
+                    // it's available before trying to send.
+                    if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                    {
+                        fHaveData = true;
+                        // A copy, as the entry's file position may change once cs_main is released
+                        indexSend = *mi->second;
+                        if (inv.hash == pfrom->hashContinue)
+                            hashContinueTip = chainActive.Tip()->GetBlockHash();
+                        // Our mempool is unlikely to help a peer rebuild an
+                        // older block, so send those in full.
+                        if (inv.type == MSG_CMPCT_BLOCK && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH)
+                            fSendCompact = true;
+                        if (inv.hash == hashMostRecentBlock) {
+                            pblock = pblockMostRecent;
+                            msgBlock = msgBlockMostRecent;
+                            msgCmpctBlock = msgCmpctBlockMostRecent;
+                        }
+                    }
                 }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+
+                if (fHaveData)
                 {
                     // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
+                    if ((inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fSendCompact)) && pblock)
+                    {
+                        // A new tip is asked for by many peers at about the
+                        // same time, so they all get the same buffer.
+                        if (!msgBlock) {
+                            msgBlock = CNode::MakeSharedMessage("block", *pblock);
+                            LOCK(cs_main);
+                            if (hashMostRecentBlock == inv.hash)
+                                msgBlockMostRecent = msgBlock;
+                        }
+                        pfrom->PushSharedMessage("block", msgBlock);
+                    }
+                    else if (inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fSendCompact))
+                    {
+                        // The block is sent exactly as it is stored, so there
+                        // is no need to decode and re-encode its transactions.
+                        std::vector<unsigned char> vchBlock;
+                        if (!ReadRawBlockFromDisk(vchBlock, &indexSend, Params().MessageStart())) {
+                            // Only expected if the block was pruned after cs_main was released.
+                            LogPrintf("%s: cannot load block %s from disk for peer=%d\n", __func__, inv.hash.ToString(), pfrom->GetId());
+                            break;
+                        }
+                        pfrom->PushMessage("block", CFlatData(vchBlock));
+                    }
+                    else if (inv.type == MSG_CMPCT_BLOCK)
+                    {
+                        if (msgCmpctBlock) {
+                            pfrom->PushSharedMessage("cmpctblock", msgCmpctBlock);
+                        } else {
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, &indexSend, consensusParams)) {
+                                LogPrintf("%s: cannot load block %s from disk for peer=%d\n", __func__, inv.hash.ToString(), pfrom->GetId());
+                                break;
+                            }
+                            pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block));
+                        }
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, &indexSend, consensusParams)) {
+                            LogPrintf("%s: cannot load block %s from disk for peer=%d\n", __func__, inv.hash.ToString(), pfrom->GetId());
+                            break;
+                        }
                         bool send = false;
                         CMerkleBlock merkleBlock;
                         {
@@ -6178,13 +6789,13 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     }
 
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue)
+                    if (!hashContinueTip.IsNull())
                     {
                         // Bypass PushBlockInventory, this must send even if redundant,
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
                         vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        vInv.push_back(CInv(MSG_BLOCK, hashContinueTip));
                         pfrom->PushMessage("inv", vInv);
                         pfrom->hashContinue.SetNull();
                     }
@@ -6192,14 +6803,15 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             }
             else if (inv.type == MSG_TX || inv.type == MSG_WTX)
             {
+                LOCK(cs_main);
                 // Send stream from relay memory
                 bool push = false;
                 auto mi = mapRelay.find(inv.hash);
-                if (mi != mapRelay.end() && !IsExpiringSoonTx(*mi->second, currentHeight + 1)) {
+                if (mi != mapRelay.end() && !IsExpiringSoonTx(*mi->second.tx, currentHeight + 1)) {
                     // ZIP 239: MSG_TX should be used if and only if the tx is v4 or earlier.
-                    if ((mi->second->nVersion <= 4) != (inv.type == MSG_TX)) {
+                    if ((mi->second.tx->nVersion <= 4) != (inv.type == MSG_TX)) {
                         Misbehaving(pfrom->GetId(), 100);
-                        LogPrint("net", "Wrong INV message type used for v%d tx", mi->second->nVersion);
+                        LogPrint("net", "Wrong INV message type used for v%d tx", mi->second.tx->nVersion);
                         // Break so that this inv mesage will be erased from the queue
                         // (otherwise the peer would repeatedly hit this case until its
                         // Misbehaving level rises above -banscore, no matter what the
@@ -6208,8 +6820,10 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     }
                     // Ensure we only reply with a transaction if it is exactly what the
                     // peer requested from us. Otherwise we add it to vNotFound below.
-                    if (inv.hashAux == mi->second->GetAuthDigest()) {
-                        pfrom->PushMessage("tx", *mi->second);
+                    if (inv.hashAux == mi->second.tx->GetAuthDigest()) {
+                        if (!mi->second.msg)
+                            mi->second.msg = CNode::MakeSharedMessage("tx", *mi->second.tx);
+                        pfrom->PushSharedMessage("tx", mi->second.msg);
                         push = true;
                     }
                 } else if (pfrom->timeLastMempoolReq) {
@@ -6241,7 +6855,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -6260,6 +6874,27 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+/** Process a block rebuilt from a compact block as if it came in a "block" message. */
+static void ProcessReconstructedBlock(const CChainParams& chainparams, CNode* pfrom, CBlock& block)
+{
+    LogPrint("net", "reconstructed block %s peer=%d\n", block.GetHash().ToString(), pfrom->id);
+
+    CValidationState state;
+    // We either asked for this block or were sent it as a new tip that
+    // extends our chain, so it gets the same treatment as a requested one.
+    ProcessNewBlock(state, chainparams, pfrom, &block, true, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+        pfrom->PushMessage("reject", std::string("block"), (unsigned char)state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
 bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
@@ -6446,6 +7081,13 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             LOCK(cs_main);
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
+
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell the peer we can serve compact blocks, but don't ask it to
+            // announce new blocks with them until it has given us a new tip.
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, CMPCTBLOCKS_VERSION);
+        }
     }
 
 
@@ -6577,9 +7219,15 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
                     pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
                     CNodeState *nodestate = State(pfrom->GetId());
 
-                    if (chainActive.Tip()->GetBlockTime() > GetTime() - chainparams.GetConsensus().PoWTargetSpacing(pindexBestHeader->nHeight) * 20 &&
+                    if (CanDirectFetch(chainparams.GetConsensus()) &&
                         nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                        vToFetch.push_back(inv);
+                        // A new block at the tip is most likely made of
+                        // transactions we already have, so ask for it in
+                        // compact form if the peer can send that.
+                        if (nodestate->fProvidesHeaderAndIDs)
+                            vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                        else
+                            vToFetch.push_back(inv);
                         // Mark block as in flight already, even though the actual "getdata" message only goes out
                         // later (within the same cs_main lock, though).
                         MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -6891,6 +7539,10 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Do the expensive PoW hashing in parallel, without holding cs_main.
+        std::vector<uint256> vHashPoW;
+        PrevalidateHeadersPoW(headers, vHashPoW, chainparams.GetConsensus());
+
         {
         LOCK(cs_main);
 
@@ -6912,13 +7564,15 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         }
 
         CBlockIndex *pindexLast = NULL;
-        for (const CBlockHeader& header : headers) {
+        for (size_t n = 0; n < headers.size(); n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
-            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast)) {
+            const uint256* phashPoW = vHashPoW[n].IsNull() ? NULL : &vHashPoW[n];
+            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast, phashPoW)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -6978,6 +7632,267 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
     }
 
 
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION && pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+            State(pfrom->GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> pblock;
+        CBlockIndex indexSend;
+        bool fSendBlock = false;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+            if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrintf("Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+
+            if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                // Answer requests for older blocks, which an honest peer has
+                // no reason to make, with the whole block. That way a peer
+                // can't make us read lots of blocks from disk without having
+                // to download them.
+                LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+                fSendBlock = true;
+            } else if (req.blockhash == hashMostRecentBlock) {
+                pblock = pblockMostRecent;
+            } else {
+                indexSend = *it->second;
+            }
+        }
+        if (fSendBlock) {
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom, chainparams.GetConsensus());
+            return true;
+        }
+
+        if (!pblock) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, &indexSend, chainparams.GetConsensus())) {
+                LogPrintf("%s: cannot load block %s from disk for peer=%d\n", __func__, req.blockhash.ToString(), pfrom->id);
+                return true;
+            }
+            pblock = std::make_shared<const CBlock>(std::move(block));
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= pblock->vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->id);
+                return true;
+            }
+            resp.txn[i] = pblock->vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        const uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("net", "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+
+        // Do the expensive PoW hashing without holding cs_main, and only for
+        // headers that connect to one we know.
+        bool fKnownHeader;
+        {
+            LOCK(cs_main);
+            if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+                // Doesn't connect (or is genesis), so rather than penalizing the
+                // peer in AcceptBlockHeader, ask for the headers in between.
+                if (!IsInitialBlockDownload(chainparams.GetConsensus()))
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+                return true;
+            }
+            fKnownHeader = mapBlockIndex.count(hashBlock);
+        }
+        uint256 hashPoW;
+        if (!fKnownHeader)
+            hashPoW = cmpctblock.header.GetPoWHash();
+
+        CBlock block;
+        bool fBlockReconstructed = false;
+        {
+        LOCK(cs_main);
+
+        CBlockIndex *pindex = NULL;
+        CValidationState state;
+        if (!AcceptBlockHeader(cmpctblock.header, state, chainparams, &pindex, hashPoW.IsNull() ? NULL : &hashPoW)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                LogPrintf("Peer %d sent us invalid header via cmpctblock\n", pfrom->id);
+                return true;
+            }
+        }
+        // If AcceptBlockHeader returned true, it set pindex
+        assert(pindex);
+        UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator blockInFlightIt = mapBlocksInFlight.find(pindex->GetBlockHash());
+        bool fAlreadyInFlight = blockInFlightIt != mapBlocksInFlight.end();
+
+        if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
+            return true;
+
+        if (pindex->nChainWork <= chainActive.Tip()->nChainWork || // We know something better
+                pindex->nTx != 0) { // We had this block at some point, but pruned it
+            if (fAlreadyInFlight) {
+                // We requested this block for some reason, but our mempool
+                // will probably be useless, so just fetch the whole block.
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                pfrom->PushMessage("getdata", vInv);
+            }
+            return true;
+        }
+
+        // If we're not close to tip yet, give up and let parallel block fetch work its magic
+        if (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))
+            return true;
+
+        // Only rebuild blocks close to our tip: for anything further ahead
+        // our mempool is unlikely to help.
+        if (pindex->nHeight > chainActive.Height() + 2) {
+            if (fAlreadyInFlight) {
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                pfrom->PushMessage("getdata", vInv);
+            }
+            return true;
+        }
+
+        CNodeState *nodestate = State(pfrom->GetId());
+
+        // Transactions that spend other unconfirmed ones may be waiting among
+        // the orphans, so look there too.
+        std::vector<const CTransaction*> vExtraTxn;
+        vExtraTxn.reserve(mapOrphanTransactions.size());
+        for (const std::pair<const uint256, COrphanTx>& orphan : mapOrphanTransactions)
+            vExtraTxn.push_back(&orphan.second.tx);
+
+        if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+                (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
+            list<QueuedBlock>::iterator *queuedBlockIt = NULL;
+            if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex, &queuedBlockIt)) {
+                if (!(*queuedBlockIt)->partialBlock) {
+                    (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                } else {
+                    // The block was already in flight using compact blocks from the same peer
+                    LogPrint("net", "Peer sent us compact block we were already syncing!\n");
+                    return true;
+                }
+            }
+
+            PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
+            ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxn);
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block\n", pfrom->id);
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Duplicate short IDs; the block is now in flight, so just request it
+                (*queuedBlockIt)->partialBlock.reset();
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                pfrom->PushMessage("getdata", vInv);
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                if (!partialBlock.IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (req.indexes.empty()) {
+                status = partialBlock.FillBlock(block, std::vector<CTransaction>());
+                (*queuedBlockIt)->partialBlock.reset();
+                if (status == READ_STATUS_OK) {
+                    fBlockReconstructed = true;
+                } else {
+                    // Most likely a short ID collision; fall back to the full block.
+                    vector<CInv> vInv(1, CInv(MSG_BLOCK, hashBlock));
+                    pfrom->PushMessage("getdata", vInv);
+                    return true;
+                }
+            } else {
+                req.blockhash = pindex->GetBlockHash();
+                pfrom->PushMessage("getblocktxn", req);
+            }
+        } else {
+            // This block is either already in flight from a different peer,
+            // or this peer has too many blocks outstanding to download from.
+            // Try to reconstruct it anyway, since we might be able to without
+            // any round trips.
+            PartiallyDownloadedBlock tempBlock(&mempool);
+            if (tempBlock.InitData(cmpctblock, vExtraTxn) != READ_STATUS_OK)
+                return true;
+            fBlockReconstructed = tempBlock.FillBlock(block, std::vector<CTransaction>()) == READ_STATUS_OK;
+        }
+        } // cs_main
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(chainparams, pfrom, block);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        bool fBlockRead = false;
+        {
+            LOCK(cs_main);
+
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+            if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                    it->second.first != pfrom->GetId()) {
+                LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+
+            PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+            ReadStatus status = partialBlock.FillBlock(block, resp.txn);
+            it->second.second->partialBlock.reset();
+            if (status == READ_STATUS_INVALID) {
+                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to getdata now :(
+                vector<CInv> vInv(1, CInv(MSG_BLOCK, resp.blockhash));
+                pfrom->PushMessage("getdata", vInv);
+            } else {
+                fBlockRead = true;
+            }
+        }
+
+        if (fBlockRead)
+            ProcessReconstructedBlock(chainparams, pfrom, block);
+    }
+
+
     // This asymmetric behavior for inbound and outbound connections was introduced
     // to prevent a fingerprinting attack: an attacker can send specific fake addresses
     // to users' AddrMan and later request them by sending getaddr messages.
@@ -6993,7 +7908,10 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr)
@@ -7230,7 +8148,8 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         // message would be undesirable as we transmit it ourselves.
     }
 
-    else if (!(strCommand == "tx" || strCommand == "block" || strCommand == "headers" || strCommand == "alert")) {
+    else if (!(strCommand == "tx" || strCommand == "block" || strCommand == "headers" || strCommand == "alert" ||
+               strCommand == "cmpctblock" || strCommand == "blocktxn")) {
         // Ignore unknown commands for extensibility
         LogPrint("net", "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
     }
@@ -7241,6 +8160,26 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
 }
 
 // requires LOCK(cs_vRecvMsg)
+/**
+ * Messages that only touch peer and address state, or take cs_main briefly,
+ * and so may be processed for several peers at once by the message handler
+ * threads. All other messages may run validation, and are processed one at
+ * a time under cs_validationMessages.
+ */
+static bool IsNetworkOnlyMessage(const std::string& strCommand)
+{
+    return strCommand == "ping" || strCommand == "pong" ||
+        strCommand == "addr" || strCommand == "getaddr" ||
+        strCommand == "inv" || strCommand == "getdata" || strCommand == "mempool" ||
+        strCommand == "filterload" || strCommand == "filteradd" || strCommand == "filterclear" ||
+        strCommand == "reject" || strCommand == "notfound" ||
+        strCommand == "sendcmpct" || strCommand == "getblocktxn";
+}
+
+static CCriticalSection cs_validationMessages;
+/** Set when a message handler thread finds cs_validationMessages taken */
+static std::atomic<bool> fValidationWaiting(false);
+
 bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
 {
     //if (fDebug)
@@ -7255,6 +8194,8 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
     //  (x) data
     //
     bool fOk = true;
+    bool fValidated = false;
+    pfrom->fWaitValidation = false;
 
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom, chainparams.GetConsensus());
@@ -7280,6 +8221,17 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // Leave the message (and the ones queued behind it) for later if it
+        // needs validation while another thread is validating.
+        bool fNetworkOnly = IsNetworkOnlyMessage(msg.hdr.GetCommand());
+        CCriticalBlock lockValidation(fNetworkOnly ? NULL : &cs_validationMessages, "cs_validationMessages", __FILE__, __LINE__, true);
+        if (!fNetworkOnly && !lockValidation) {
+            pfrom->fWaitValidation = true;
+            fValidationWaiting = true;
+            break;
+        }
+        fValidated = !fNetworkOnly;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -7358,6 +8310,9 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
     if (!pfrom->fDisconnect)
         pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
 
+    if (fValidated && fValidationWaiting.exchange(false))
+        WakeMessageHandler();
+
     return fOk;
 }
 
@@ -7430,23 +8385,31 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
-            vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            for (const CAddress& addr : pto->vAddrToSend)
+            vector<CAddress> vAddrToSend;
             {
-                if (!pto->addrKnown.contains(addr.GetKey()))
+                LOCK(pto->cs_vAddrToSend);
+                vAddrToSend.reserve(pto->vAddrToSend.size());
+                for (const CAddress& addr : pto->vAddrToSend)
                 {
-                    pto->addrKnown.insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
+                    if (!pto->addrKnown.contains(addr.GetKey()))
                     {
-                        pto->PushMessage("addr", vAddr);
-                        vAddr.clear();
+                        pto->addrKnown.insert(addr.GetKey());
+                        vAddrToSend.push_back(addr);
                     }
                 }
+                pto->vAddrToSend.clear();
+            }
+            vector<CAddress> vAddr;
+            for (const CAddress& addr : vAddrToSend)
+            {
+                vAddr.push_back(addr);
+                // receiver rejects addr messages larger than 1000
+                if (vAddr.size() >= 1000)
+                {
+                    pto->PushMessage("addr", vAddr);
+                    vAddr.clear();
+                }
             }
-            pto->vAddrToSend.clear();
             if (!vAddr.empty())
                 pto->PushMessage("addr", vAddr);
         }
@@ -7471,6 +8434,12 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
             pto->PushMessage("reject", (string)"block", reject.chRejectCode, reject.strRejectReason, reject.hashBlock);
         state.rejects.clear();
 
+        // Ask the peer to start or stop announcing new blocks to us as compact blocks
+        if (state.fSendCmpct) {
+            pto->PushMessage("sendcmpct", state.fRequestHeaderAndIDs, CMPCTBLOCKS_VERSION);
+            state.fSendCmpct = false;
+        }
+
         // Start block sync
         if (pindexBestHeader == NULL)
             pindexBestHeader = chainActive.Tip();
@@ -7511,6 +8480,16 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
             LOCK(pto->cs_inventory);
             vInv.reserve(std::max<size_t>(pto->vInventoryBlockToSend.size(), INVENTORY_BROADCAST_MAX));
 
+            // A peer that prefers compact blocks gets a single new tip as one
+            // straight away, saving it the "getdata" round trip.
+            if (state.fPreferHeaderAndIDs && pto->vInventoryBlockToSend.size() == 1 &&
+                    pto->vInventoryBlockToSend.back() == hashMostRecentBlock &&
+                    hashMostRecentBlock == chainActive.Tip()->GetBlockHash()) {
+                LogPrint("net", "%s sending header-and-ids %s to peer=%d\n", __func__, hashMostRecentBlock.ToString(), pto->id);
+                pto->PushSharedMessage("cmpctblock", msgCmpctBlockMostRecent);
+                pto->vInventoryBlockToSend.clear();
+            }
+
             // Add blocks
             for (const uint256& hash : pto->vInventoryBlockToSend) {
                 vInv.push_back(CInv(MSG_BLOCK, hash));
@@ -7617,7 +8596,7 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
                             vRelayExpiration.pop_front();
                         }
 
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                        auto ret = mapRelay.insert(std::make_pair(hash, CRelayTx{std::move(txinfo.tx), nullptr}));
                         if (ret.second) {
                             vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
                         }
@@ -40,6 +40,7 @@
 #include <stdint.h>
 #include <string>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include <rust/orchard.h>
@@ -92,6 +93,8 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -blockprefetch default (number of blocks read and checked ahead of the tip while connecting) */
+static const int DEFAULT_BLOCK_PREFETCH = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -104,6 +107,13 @@ static const unsigned int MAX_HEADERS_RESULTS = 160;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Maximum number of peers we ask to announce new blocks to us as compact blocks. */
+static const unsigned int MAX_CMPCTBLOCK_ANNOUNCERS = 3;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers
+ *  when requested. For older blocks, a regular "block" response will be sent. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to "getblocktxn" requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -133,6 +143,8 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_IBD_SKIP_TX_VERIFICATION = false;
+static const bool DEFAULT_CHECK_POW_ON_DISK_READ = false;
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 static const bool DEFAULT_TXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
@@ -181,6 +193,12 @@ extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern bool fIBDSkipTxVerification;
+/** Recompute yespower for blocks read from disk even if their PoW is cached in the index */
+extern bool fCheckPoWOnDiskRead;
+/** Number of blocks the block prefetch threads read and check ahead of the tip; 0 unless they were started */
+extern int nBlockPrefetch;
+/** Write non-shutdown coins flushes to the database on a background thread */
+extern bool fBackgroundFlush;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
 extern bool fCoinbaseEnforcedShieldingEnabled;
@@ -267,6 +285,10 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom);
 bool SendMessages(const Consensus::Params& params, CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header proof-of-work checking thread */
+void ThreadHeaderPoWCheck();
+/** Run an instance of the block prefetch thread */
+void ThreadBlockPrefetch();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload(const Consensus::Params& params);
 /** testing-only, set or reset initial block down (IBD) state, return previous */
@@ -357,10 +379,14 @@ bool ContextualCheckInputs(const CTransaction& tx, CValidationState &state, cons
                            const Consensus::Params& consensusParams, uint32_t consensusBranchId,
                            std::vector<CScriptCheck> *pvChecks = NULL);
 
-/** Check a transaction contextually against a set of consensus rules */
+/**
+ * Check a transaction contextually against a set of consensus rules. If
+ * saplingVerifier is non-NULL, Sapling proofs are queued into its batch.
+ */
 bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state,
                                 const CChainParams& chainparams, int nHeight, bool isMined,
-                                bool (*isInitBlockDownload)(const Consensus::Params&) = IsInitialBlockDownload);
+                                bool (*isInitBlockDownload)(const Consensus::Params&) = IsInitialBlockDownload,
+                                ProofVerifier* saplingVerifier = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -450,10 +476,83 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the verification of the Sprout and Orchard proofs of
+ * one transaction. If they don't verify, the reject reason is written to the
+ * referenced string, which the queue would otherwise have no way to return.
+ */
+class CProofCheck
+{
+private:
+    const CTransaction *ptxTo;
+    std::string *pstrRejectReason;
+
+public:
+    CProofCheck(): ptxTo(NULL), pstrRejectReason(NULL) {}
+    CProofCheck(const CTransaction& txToIn, std::string& strRejectReasonOut) :
+        ptxTo(&txToIn), pstrRejectReason(&strRejectReasonOut) { }
+
+    bool operator()();
+
+    void swap(CProofCheck &check) {
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(pstrRejectReason, check.pstrRejectReason);
+    }
+};
+
+/**
+ * A check run by the block verification threads: either a script check of one
+ * input or the proof checks of one transaction, so that one pool of threads
+ * does both.
+ */
+class CBlockCheck
+{
+private:
+    std::variant<CScriptCheck, CProofCheck> check;
+
+public:
+    CBlockCheck() {}
+    explicit CBlockCheck(CScriptCheck&& checkIn) : check(std::move(checkIn)) { }
+    explicit CBlockCheck(const CProofCheck& checkIn) : check(checkIn) { }
+
+    bool operator()();
+
+    void swap(CBlockCheck &x) {
+        check.swap(x.check);
+    }
+};
+
+/**
+ * Closure representing the proof-of-work verification of one block header.
+ * The computed yespower hash is written to the referenced slot so that it can
+ * be reused when the header is later accepted under cs_main.
+ */
+class CHeaderPoWCheck
+{
+private:
+    const CBlockHeader *pheader;
+    uint256 *phashPoW;
+    const Consensus::Params *pconsensusParams;
+
+public:
+    CHeaderPoWCheck(): pheader(NULL), phashPoW(NULL), pconsensusParams(NULL) {}
+    CHeaderPoWCheck(const CBlockHeader& headerIn, uint256& hashPoWOut, const Consensus::Params& consensusParamsIn) :
+        pheader(&headerIn), phashPoW(&hashPoWOut), pconsensusParams(&consensusParamsIn) { }
+
+    bool operator()();
+
+    void swap(CHeaderPoWCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(phashPoW, check.phashPoW);
+        std::swap(pconsensusParams, check.pconsensusParams);
+    }
+};
+
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-bool GetAddressIndex(const uint160& addressHash, int type,
-        std::vector<CAddressIndexDbEntry> &addressIndex,
-        int start = 0, int end = 0);
+bool GetAddressBalance(const uint160& addressHash, int type, CAddressBalanceValue& value);
+/** Pass address index entries to fn without collecting them; see CBlockTreeDB::ScanAddressIndex */
+bool ScanAddressIndex(const CAddressIndexKey& keyStart, int end,
+        const std::function<bool(const CAddressIndexKey&, CAmount)>& fn);
 bool GetAddressUnspent(const uint160& addressHash, int type,
         std::vector<CAddressUnspentDbEntry>& unspentOutputs);
 bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
@@ -461,8 +560,10 @@ bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the serialized bytes of a block as stored on disk, without decoding its transactions */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -470,7 +571,8 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
     const CChainParams& chainparams,
-    bool fCheckPOW = true);
+    bool fCheckPOW = true,
+    uint256* phashPoW = nullptr);
 
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 const CChainParams& chainparams,
@@ -492,10 +594,13 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state,
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons).
+ *  If fCheckedContextFree is set, the block has already passed CheckBlock()
+ *  with the flags ConnectBlock() would use, and it is not run again. */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins,
                   const CChainParams& chainparams,
-                  bool fJustCheck = false, bool fCheckAuthDataRoot = true);
+                  bool fJustCheck = false, bool fCheckAuthDataRoot = true,
+                  bool fCheckedContextFree = false);
 
 /**
  * Check a block is completely valid from start to finish (only works on top
@@ -540,6 +645,9 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the coin database below pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
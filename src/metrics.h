@@ -22,6 +22,10 @@ struct AtomicCounter {
         ++value;
     }
 
+    void increment(uint64_t n){
+        value += n;
+    }
+
     void decrement(){
         --value;
     }
@@ -14,6 +14,7 @@
 #include "consensus/funding.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "fs.h"
 #include "hash.h"
 #include "key_io.h"
 #include "main.h"
@@ -30,13 +31,20 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
+#include "yespower.h"
 
 #include <librustzcash.h>
 
+#include <algorithm>
+
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #ifdef ENABLE_MINING
 #include <functional>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #endif
 #include <mutex>
 
@@ -68,6 +76,10 @@ public:
     }
 };
 
+// Number of transactions in a row that may fail to fit before CreateNewBlock
+// gives up on filling a nearly full block
+static const int MAX_CONSECUTIVE_FAILURES = 1000;
+
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
@@ -380,105 +392,39 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const MinerAddre
         SaplingMerkleTree sapling_tree;
         assert(view.GetSaplingAnchorAt(view.GetBestAnchor(SAPLING), sapling_tree));
 
-        // Priority order to process transactions
+        // Transactions are taken from the mempool's priority index while the
+        // priority area is being filled, and from its mining score index after
+        // that. The mempool keeps both in order as transactions come and go, so
+        // only the transactions considered for this block are visited. A
+        // transaction spending an output of a pool transaction that is not in the
+        // block yet waits in mapDependers until all of its parents are added, and
+        // then competes with the index through vecPriority.
         list<COrphan> vOrphan; // list memory doesn't move
         map<uint256, vector<COrphan*> > mapDependers;
+        set<uint256> setConsidered;
+        set<uint256> setIncluded;
         bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
 
         // This vector will be sorted into a priority queue:
         vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-
-        // If we're given a coinbase tx, it's been precomputed, its fees are zero,
-        // so we can't include any mempool transactions; this will be an empty block.
-        if (!next_cb_mtx) {
-            for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-                mi != mempool.mapTx.end(); ++mi)
-            {
-                const CTransaction& tx = mi->GetTx();
-
-                int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
-                                        ? nMedianTimePast
-                                        : pblock->GetBlockTime();
-
-                if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight, nLockTimeCutoff) || IsExpiredTx(tx, nHeight))
-                    continue;
-
-                COrphan* porphan = NULL;
-                double dPriority = 0;
-                CAmount nTotalIn = 0;
-                bool fMissingInputs = false;
-                for (const CTxIn& txin : tx.vin)
-                {
-                    // Read prev transaction
-                    if (!view.HaveCoins(txin.prevout.hash))
-                    {
-                        // This should never happen; all transactions in the memory
-                        // pool should connect to either transactions in the chain
-                        // or other transactions in the memory pool.
-                        if (!mempool.mapTx.count(txin.prevout.hash))
-                        {
-                            LogPrintf("ERROR: mempool transaction missing input\n");
-                            if (fDebug) assert("mempool transaction missing input" == 0);
-                            fMissingInputs = true;
-                            if (porphan)
-                                vOrphan.pop_back();
-                            break;
-                        }
-
-                        // Has to wait for dependencies
-                        if (!porphan)
-                        {
-                            // Use list for automatic deletion
-                            vOrphan.push_back(COrphan(&tx));
-                            porphan = &vOrphan.back();
-                        }
-                        mapDependers[txin.prevout.hash].push_back(porphan);
-                        porphan->setDependsOn.insert(txin.prevout.hash);
-                        nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
-                        continue;
-                    }
-                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                    assert(coins);
-
-                    CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                    nTotalIn += nValueIn;
-
-                    int nConf = nHeight - coins->nHeight;
-
-                    dPriority += (double)nValueIn * nConf;
-                }
-                nTotalIn += tx.GetShieldedValueIn();
-
-                if (fMissingInputs) continue;
-
-                // Priority is sum(valuein * age) / modified_txsize
-                unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-                dPriority = tx.ComputePriority(dPriority, nTxSize);
 
-                uint256 hash = tx.GetHash();
-                mempool.ApplyDeltas(hash, dPriority, nTotalIn);
+        const CTxMemPool::priority_index& priorityIndex = mempool.GetPriorityIndex(nHeight);
+        CTxMemPool::priority_index::const_iterator itPriority = priorityIndex.begin();
+        const auto& scoreIndex = mempool.mapTx.get<2>();
+        auto itScore = scoreIndex.begin();
 
-                CFeeRate feeRate(nTotalIn-tx.GetValueOut(), nTxSize);
-
-                if (porphan)
-                {
-                    porphan->dPriority = dPriority;
-                    porphan->feeRate = feeRate;
-                }
-                else
-                    vecPriority.push_back(TxPriority(dPriority, feeRate, &(mi->GetTx())));
-            }
-        }
+        int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                                ? nMedianTimePast
+                                : pblock->GetBlockTime();
 
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
         uint64_t nBlockTx = 0;
         int nBlockSigOps = 100;
+        int nConsecutiveFailed = 0;
         bool fSortedByFee = (nBlockPrioritySize <= 0);
 
         TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 
         // We want to track the value pool, but if the miner gets
         // invoked on an old block before the hardcoded fallback
@@ -508,20 +454,92 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const MinerAddre
             }
         }
 
-        while (!vecPriority.empty())
+        // If we're given a coinbase tx, it's been precomputed, its fees are zero,
+        // so we can't include any mempool transactions; this will be an empty block.
+        while (!next_cb_mtx)
         {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
+            // Find the best transaction in the index for the current ordering
+            // that hasn't been considered yet.
+            const CTxMemPoolEntry* pentry = NULL;
+            if (!fSortedByFee) {
+                while (itPriority != priorityIndex.end() && setConsidered.count(itPriority->second))
+                    ++itPriority;
+                if (itPriority != priorityIndex.end())
+                    pentry = &*mempool.mapTx.find(itPriority->second);
+            } else {
+                while (itScore != scoreIndex.end() && setConsidered.count(itScore->GetTx().GetHash()))
+                    ++itScore;
+                if (itScore != scoreIndex.end())
+                    pentry = &*itScore;
+            }
 
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
+            if (!pentry && vecPriority.empty()) {
+                if (fSortedByFee)
+                    break;
+                // Out of high-priority transactions
+                fSortedByFee = true;
+                comparer = TxPriorityCompare(fSortedByFee);
+                continue;
+            }
+
+            TxPriority candidate;
+            if (pentry) {
+                double dPriorityDelta = 0;
+                CAmount nFeeDelta = 0;
+                mempool.ApplyDeltas(pentry->GetTx().GetHash(), dPriorityDelta, nFeeDelta);
+                candidate = TxPriority(pentry->GetPriority(nHeight) + dPriorityDelta,
+                                       CFeeRate(pentry->GetModifiedFee(), pentry->GetTxSize()),
+                                       &pentry->GetTx());
+            }
+
+            // Take the highest priority transaction from the index or the queue:
+            bool fFromIndex = pentry && (vecPriority.empty() || !comparer(candidate, vecPriority.front()));
+            if (!fFromIndex) {
+                candidate = vecPriority.front();
+                std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.pop_back();
+            }
+            double dPriority = candidate.get<0>();
+            CFeeRate feeRate = candidate.get<1>();
+            const CTransaction& tx = *(candidate.get<2>());
+            const uint256& hash = tx.GetHash();
+
+            if (fFromIndex) {
+                setConsidered.insert(hash);
+
+                if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight, nLockTimeCutoff) || IsExpiredTx(tx, nHeight))
+                    continue;
+
+                // Has to wait for dependencies
+                COrphan* porphan = NULL;
+                for (const CTxIn& txin : tx.vin)
+                {
+                    const uint256& hashParent = txin.prevout.hash;
+                    if (setIncluded.count(hashParent) || !mempool.mapTx.count(hashParent))
+                        continue;
+                    if (!porphan)
+                    {
+                        // Use list for automatic deletion
+                        vOrphan.push_back(COrphan(&tx));
+                        porphan = &vOrphan.back();
+                        porphan->dPriority = dPriority;
+                        porphan->feeRate = feeRate;
+                    }
+                    if (porphan->setDependsOn.insert(hashParent).second)
+                        mapDependers[hashParent].push_back(porphan);
+                }
+                if (porphan)
+                    continue;
+            }
 
             // Size limits
             unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
+            if (nBlockSize + nTxSize >= nBlockMaxSize) {
+                // Give up once the block is nearly full and nothing has fit for a while
+                if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 4000)
+                    break;
                 continue;
+            }
 
             // Legacy limits on sigOps:
             unsigned int nTxSigOps = GetLegacySigOpCount(tx);
@@ -529,12 +547,17 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const MinerAddre
                 continue;
 
             // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
             double dPriorityDelta = 0;
             CAmount nFeeDelta = 0;
             mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
             if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
+            {
+                // Everything left pays no more than this, so unless something
+                // has been prioritised it would all be skipped too.
+                if (mempool.mapDeltas.empty() && nBlockSize >= nBlockMinSize)
+                    break;
                 continue;
+            }
 
             // Prioritise by fee once past the priority size or we run out of high-priority
             // transactions:
@@ -599,6 +622,8 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const MinerAddre
             UpdateCoins(tx, view, nHeight);
 
             // Added
+            setIncluded.insert(hash);
+            nConsecutiveFailed = 0;
             pblock->vtx.push_back(tx);
             pblocktemplate->vTxFees.push_back(nTxFees);
             pblocktemplate->vTxSigOps.push_back(nTxSigOps);
@@ -739,7 +764,7 @@ void IncrementExtraNonce(
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = txCoinbase;
-    pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+    pblock->hashMerkleRoot = pblock->UpdateMerkleTree(0);
     if (consensusParams.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_NU5)) {
         pblock->hashBlockCommitments = DeriveBlockCommitmentsHash(
             pblocktemplate->hashChainHistoryRoot,
@@ -772,26 +797,148 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-void static BitcoinMiner(const CChainParams& chainparams)
+static CCriticalSection cs_minerThreadInfo;
+static std::vector<MinerThreadInfo> vMinerThreadInfo;
+
+int ParseMinerHugepages(const std::string& str)
+{
+    if (str == "1g")
+        return YESPOWER_PAGES_1G;
+    if (str == "2m")
+        return YESPOWER_PAGES_2M;
+    if (str == "thp")
+        return YESPOWER_PAGES_THP;
+    if (str == "none")
+        return YESPOWER_PAGES_SMALL;
+    return -1;
+}
+
+static std::string MinerPagesName(int nPages)
+{
+    switch (nPages) {
+    case YESPOWER_PAGES_1G: return "1G";
+    case YESPOWER_PAGES_2M: return "2M";
+    case YESPOWER_PAGES_THP: return "THP";
+    case YESPOWER_PAGES_SMALL: return "4K";
+    default: return "failed";
+    }
+}
+
+/** Pin the calling thread to the nThread'th CPU it is allowed to run on. Returns the CPU, or -1. */
+static int PinMinerThread(int nThread)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return -1;
+    int nSkip = nThread % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || nSkip-- > 0)
+            continue;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            return -1;
+        return cpu;
+    }
+#endif
+    return -1;
+}
+
+/** Return the NUMA node a CPU belongs to, or -1 if unknown. */
+static int GetCPUNode(int cpu)
+{
+#ifdef __linux__
+    try {
+        fs::path dir = strprintf("/sys/devices/system/cpu/cpu%d", cpu);
+        for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+            std::string name = it->path().filename().string();
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0)
+                return atoi(name.substr(4));
+        }
+    } catch (const fs::filesystem_error&) {
+    }
+#endif
+    return -1;
+}
+
+/** Free a miner thread's hashing memory and forget its placement. */
+static void ReleaseMinerThread(int nThread)
+{
+    yespower_tls_free();
+    LOCK(cs_minerThreadInfo);
+    for (auto it = vMinerThreadInfo.begin(); it != vMinerThreadInfo.end(); ++it) {
+        if (it->nThread == nThread) {
+            vMinerThreadInfo.erase(it);
+            break;
+        }
+    }
+}
+
+std::vector<MinerThreadInfo> GetMinerThreadInfo()
+{
+    LOCK(cs_minerThreadInfo);
+    std::vector<MinerThreadInfo> vInfo = vMinerThreadInfo;
+    std::sort(vInfo.begin(), vInfo.end(), [](const MinerThreadInfo& a, const MinerThreadInfo& b) {
+        return a.nThread < b.nThread;
+    });
+    return vInfo;
+}
+
+void static BitcoinMiner(const CChainParams& chainparams, int nThread)
 {
     LogPrintf("KotoMiner started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
     RenameThread("koto-miner");
 
+    // Pin the thread before its hashing memory is first written, so that the
+    // memory is allocated on the NUMA node of the CPU that will read it.
+    MinerThreadInfo info;
+    info.nThread = nThread;
+    info.nCPU = GetBoolArg("-minerpinthreads", DEFAULT_MINER_PIN_THREADS) ? PinMinerThread(nThread) : -1;
+    info.nNode = info.nCPU >= 0 ? GetCPUNode(info.nCPU) : -1;
+
     // Each thread has its own counter
     unsigned int nExtraNonce = 0;
 
     MinerAddress minerAddress;
     GetMainSignals().AddressForMining(minerAddress);
 
-    std::mutex m_cs;
-    bool cancelSolver = false;
+    // Bumped whenever the tip changes, so that the search loop can notice a
+    // new block without polling chainActive.
+    std::atomic<uint64_t> nTipGeneration{0};
     boost::signals2::connection c = uiInterface.NotifyBlockTip.connect(
-        [&m_cs, &cancelSolver](bool, const CBlockIndex *) mutable {
-            std::lock_guard<std::mutex> lock{m_cs};
-            cancelSolver = true;
+        [&nTipGeneration](bool, const CBlockIndex *) {
+            nTipGeneration++;
         }
     );
+
+    // Number of nonces to hash between checks for new work, retuned after
+    // every batch so that the checks run about every MINER_CHECK_INTERVAL_MICROS.
+    unsigned int nBatchSize = 1;
+
+    // Number of nonces hashed together, interleaving their memory accesses.
+    const unsigned int nLanes = std::max<int64_t>(1, std::min<int64_t>(YESPOWER_MAX_LANES,
+        GetArg("-minerlanes", DEFAULT_MINER_LANES)));
+    uint256 vHashes[YESPOWER_MAX_LANES];
+
+    // Reserve all of the memory the lanes hash in up front, on the largest
+    // pages available, rather than letting the first hash allocate it. With
+    // the consensus N and r that is 83906560 bytes (about 84 MB) per lane.
+    int nMaxPages = ParseMinerHugepages(GetArg("-minerhugepages", DEFAULT_MINER_HUGEPAGES));
+    size_t nMemory = CPoWHeader::GetPoWMemoryUsage(nLanes);
+    int nPages = -1;
+    if (nMemory > 0 && nMaxPages >= 0)
+        nPages = yespower_tls_reserve(nMemory, (yespower_pages_t)nMaxPages);
+    info.strPages = MinerPagesName(nPages);
+    LogPrintf("KotoMiner thread %d: cpu %d, node %d, %u bytes, pages %s\n",
+        nThread, info.nCPU, info.nNode, nMemory, info.strPages);
+    {
+        LOCK(cs_minerThreadInfo);
+        vMinerThreadInfo.push_back(info);
+    }
+
     miningTimer.start();
 
     try {
@@ -822,6 +969,7 @@ void static BitcoinMiner(const CChainParams& chainparams)
             // Create new block
             //
             unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+            uint64_t nTipGenerationLast = nTipGeneration;
             CBlockIndex* pindexPrev = chainActive.Tip();
 
             unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(chainparams, minerAddress));
@@ -833,6 +981,7 @@ void static BitcoinMiner(const CChainParams& chainparams)
                     // Should never reach here, because -mineraddress validity is checked in init.cpp
                     LogPrintf("Error in KotoMiner: Invalid -mineraddress\n");
                 }
+                ReleaseMinerThread(nThread);
                 return;
             }
             CBlock *pblock = &pblocktemplate->block;
@@ -849,11 +998,34 @@ void static BitcoinMiner(const CChainParams& chainparams)
 
             uint256 hash;
             pblock->nNonce = 0;
+            CPoWHeader powHeader(*pblock);
 
             while (true) {
-                hash = pblock->GetPoWHash();
-                solutionTargetChecks.increment();
-                if (UintToArith256(hash) <= hashTarget)
+                // Hash a batch of nonces, only stopping early for a solution or a new tip.
+                int64_t nBatchStart = GetTimeMicros();
+                unsigned int nHashes = 0;
+                bool fFound = false;
+                while (nHashes < nBatchSize) {
+                    powHeader.GetPoWHashes(pblock->nNonce, vHashes, nLanes);
+                    nHashes += nLanes;
+                    for (unsigned int i = 0; i < nLanes; i++) {
+                        if (UintToArith256(vHashes[i]) <= hashTarget) {
+                            hash = vHashes[i];
+                            pblock->nNonce += i;
+                            fFound = true;
+                            break;
+                        }
+                    }
+                    if (fFound)
+                        break;
+                    pblock->nNonce += nLanes;
+                    if (nTipGeneration != nTipGenerationLast)
+                        break;
+                }
+                int64_t nBatchTime = GetTimeMicros() - nBatchStart;
+                solutionTargetChecks.increment(nHashes);
+
+                if (fFound)
                 {
                     // Found a solution
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
@@ -869,25 +1041,34 @@ void static BitcoinMiner(const CChainParams& chainparams)
  
                     break;
                 }
-                pblock->nNonce++;
+
                 // Check for stop or if block needs to be rebuilt
                 boost::this_thread::interruption_point();
-                // Regtest mode doesn't require peers
-                if (vNodes.empty() && chainparams.MiningRequiresPeers())
+                if (nTipGeneration != nTipGenerationLast)
                     break;
+                // Regtest mode doesn't require peers
+                if (chainparams.MiningRequiresPeers()) {
+                    LOCK(cs_vNodes);
+                    if (vNodes.empty())
+                        break;
+                }
                 if (pblock->nNonce >= 0xffff0000)
                     break;
                 if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
                     break;
-                if (pindexPrev != chainActive.Tip())
-                    break;
 
                 UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+                powHeader.SetTime(pblock->nTime);
                 if (chainparams.GetConsensus().nPowAllowMinDifficultyBlocksAfterHeight != std::nullopt)
                 {
                     // Changing pblock->nTime can change work required on testnet:
                     hashTarget.SetCompact(pblock->nBits);
+                    powHeader.SetBits(pblock->nBits);
                 }
+
+                // Aim for the next batch to take MINER_CHECK_INTERVAL_MICROS.
+                nBatchSize = std::max<int64_t>(nLanes, std::min<int64_t>(MAX_MINER_BATCH_SIZE,
+                    nHashes * MINER_CHECK_INTERVAL_MICROS / std::max<int64_t>(1, nBatchTime)));
             }
         }
     }
@@ -895,6 +1076,7 @@ void static BitcoinMiner(const CChainParams& chainparams)
     {
         miningTimer.stop();
         c.disconnect();
+        ReleaseMinerThread(nThread);
         LogPrintf("KotoMiner terminated\n");
         throw;
     }
@@ -902,11 +1084,13 @@ void static BitcoinMiner(const CChainParams& chainparams)
     {
         miningTimer.stop();
         c.disconnect();
+        ReleaseMinerThread(nThread);
         LogPrintf("KotoMiner runtime error: %s\n", e.what());
         return;
     }
     miningTimer.stop();
     c.disconnect();
+    ReleaseMinerThread(nThread);
 }
 
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams)
@@ -929,7 +1113,7 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
 
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++) {
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams)));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), i));
     }
 }
 
@@ -9,7 +9,9 @@
 #include "primitives/block.h"
 
 #include <stdint.h>
+#include <string>
 #include <variant>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
@@ -21,6 +23,17 @@ namespace Consensus { struct Params; };
 static const bool DEFAULT_GENERATE = false;
 static const int DEFAULT_GENERATE_THREADS = 1;
 
+/** How often the miner checks for new work between batches of nonces */
+static const int64_t MINER_CHECK_INTERVAL_MICROS = 100 * 1000;
+/** Upper bound on the number of nonces hashed between checks */
+static const unsigned int MAX_MINER_BATCH_SIZE = 4096;
+/** Default number of nonces each miner thread hashes together (see -minerlanes) */
+static const unsigned int DEFAULT_MINER_LANES = 1;
+/** Largest pages miner threads try to back their hashing memory with (see -minerhugepages) */
+static const char* const DEFAULT_MINER_HUGEPAGES = "2m";
+/** Whether miner threads are pinned to separate CPUs (see -minerpinthreads) */
+static const bool DEFAULT_MINER_PIN_THREADS = true;
+
 static const bool DEFAULT_PRINTPRIORITY = false;
 
 class InvalidMinerAddress {
@@ -130,6 +143,19 @@ void IncrementExtraNonce(
     const Consensus::Params& consensusParams);
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams);
+
+/** Placement of a running miner thread and the memory it hashes in */
+struct MinerThreadInfo
+{
+    int nThread;
+    int nCPU;           //!< CPU the thread is pinned to, or -1 if not pinned
+    int nNode;          //!< NUMA node of that CPU, or -1 if unknown
+    std::string strPages; //!< Pages backing its yespower memory ("1G", "2M", "THP" or "4K")
+};
+/** Parse a -minerhugepages value into a yespower_pages_t, or return -1 */
+int ParseMinerHugepages(const std::string& str);
+/** Get the placement of the running miner threads */
+std::vector<MinerThreadInfo> GetMinerThreadInfo();
 #endif
 
 void UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
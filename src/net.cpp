@@ -27,6 +27,10 @@
 #else
 #include <fcntl.h>
 #endif
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 #include <boost/thread.hpp>
 
@@ -37,6 +41,9 @@
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
 
+// Most queued messages handed to the kernel by a single sendmsg() call
+static const size_t MAX_SEND_IOVECS = 64;
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -89,6 +96,55 @@ CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
 static boost::condition_variable messageHandlerCondition;
+/** Counts WakeMessageHandler() calls, so a thread about to sleep can tell it missed one */
+static std::atomic<uint64_t> nMessageHandlerWakeups(0);
+
+#ifdef USE_EPOLL
+/** Maximum number of socket events handled per epoll_wait() call */
+static const int MAX_SOCKET_EVENTS = 256;
+/** Interval (in milliseconds) between sweeps for disconnected nodes */
+static const int SOCKET_SWEEP_INTERVAL = 100;
+/** Interval (in milliseconds) before retrying a node whose buffers were locked */
+static const int SOCKET_RETRY_INTERVAL = 10;
+/** Number of receive buffers read from one node before moving on to the next */
+static const int MAX_RECV_PER_SERVICE = 4;
+
+/** Edge-triggered epoll set holding the listening and peer sockets */
+static int epollfd = -1;
+/** eventfd used to wake the socket handler out of epoll_wait() */
+static int wakeupfd = -1;
+#endif
+
+/** Add a newly connected node's socket to the socket handler's event set. Requires cs_vNodes. */
+static void RegisterNodeSocket(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    bool fRegistered;
+    {
+        LOCK(pnode->cs_hSocket);
+        fRegistered = pnode->hSocket == INVALID_SOCKET ||
+            epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) == 0;
+    }
+    if (!fRegistered) {
+        LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+        pnode->CloseSocketDisconnect();
+    }
+#endif
+}
+
+/** Wake the socket handler to recheck nodes whose receive buffer was full */
+static void WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    uint64_t n = 1;
+    if (write(wakeupfd, &n, sizeof(n)) != sizeof(n)) {
+        // Only fails when the counter would overflow, i.e. a wakeup is pending.
+    }
+#endif
+}
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -397,6 +453,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            RegisterNodeSocket(pnode);
         }
 
         return pnode;
@@ -436,6 +493,11 @@ void CNode::CloseSocketDisconnect()
         LOCK(cs_hSocket);
         if (hSocket != INVALID_SOCKET) {
             LogPrint("net", "disconnecting peer=%d\n", id);
+#ifdef USE_EPOLL
+            // Remove the socket explicitly, as a copy inherited by a child
+            // process would keep it in the epoll set after closing.
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, hSocket, NULL);
+#endif
             CloseSocket(hSocket);
         }
     }
@@ -806,17 +868,33 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSharedNetMessage>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
+#ifdef WIN32
+            const CSerializeData &data = **it;
             nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand the kernel as many queued messages as we can in one call,
+            // straight from their (possibly shared) buffers.
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            for (std::deque<CSharedNetMessage>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++itIov, ++nIov) {
+                size_t nOffset = itIov == it ? pnode->nSendOffset : 0;
+                iov[nIov].iov_base = const_cast<char*>(&(**itIov)[nOffset]);
+                iov[nIov].iov_len = (*itIov)->size() - nOffset;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
@@ -824,13 +902,20 @@ void SocketSendData(CNode *pnode)
                 LOCK(pnode->cs_vSend);
                 pnode->nSendBytes += nBytes;
             }
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                size_t nUnsent = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nUnsent) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nUnsent;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
+            }
+            if (pnode->nSendOffset != 0) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -1077,84 +1162,364 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterNodeSocket(pnode);
     }
 }
 
-void ThreadSocketHandler()
+// requires LOCK(cs_vRecvMsg)
+static bool IsRecvFlooded(CNode* pnode)
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true)
+    // Stop reading once a complete message is waiting and the receive buffer
+    // is full; the message handler drains it.
+    return !pnode->vRecvMsg.empty() && pnode->vRecvMsg.front().complete() &&
+        pnode->GetTotalRecvSize() > ReceiveFloodSize();
+}
+
+// requires LOCK(cs_vRecvMsg)
+// Returns whether the socket may have more data to read.
+static bool SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = 0;
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return false;
+        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            vector<CNode*> vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
+            LOCK(pnode->cs_vRecv);
+            pnode->nRecvBytes += nBytes;
+        }
+        pnode->RecordBytesRecv(nBytes);
+        return nBytes == sizeof(pchBuf);
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
+static void DisconnectNodes()
+{
+    {
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        vector<CNode*> vNodesCopy = vNodes;
+        for (CNode* pnode : vNodesCopy)
+        {
+            if (pnode->fDisconnect ||
+                (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
             {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
-                {
-                    auto spanGuard = pnode->span.Enter();
+                auto spanGuard = pnode->span.Enter();
 
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                if (pnode->fNetworkNode || pnode->fInbound)
+                    pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+    {
+        // Delete disconnected nodes
+        list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        for (CNode* pnode : vNodesDisconnectedCopy)
         {
-            // Delete disconnected nodes
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            for (CNode* pnode : vNodesDisconnectedCopy)
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0)
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                bool fDelete = false;
                 {
-                    bool fDelete = false;
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend)
                     {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend)
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv)
                         {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv)
-                            {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
+                            TRY_LOCK(pnode->cs_inventory, lockInv);
+                            if (lockInv)
+                                fDelete = true;
                         }
                     }
-                    if (fDelete)
-                    {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
-                    }
+                }
+                if (fDelete)
+                {
+                    vNodesDisconnected.remove(pnode);
+                    delete pnode;
                 }
             }
         }
-        size_t vNodesSize;
+    }
+}
+
+static void NotifyNumConnectionsChanged(unsigned int& nPrevNodeCount)
+{
+    size_t vNodesSize;
+    {
+        LOCK(cs_vNodes);
+        vNodesSize = vNodes.size();
+    }
+    if (vNodesSize != nPrevNodeCount) {
+        nPrevNodeCount = vNodesSize;
+        MetricsGauge("zcash.net.peers", nPrevNodeCount);
+        uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+}
+
+static void InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
         {
-            LOCK(cs_vNodes);
-            vNodesSize = vNodes.size();
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
         }
-        if (vNodesSize != nPrevNodeCount) {
-            nPrevNodeCount = vNodesSize;
-            MetricsGauge("zcash.net.peers", nPrevNodeCount);
-            uiInterface.NotifyNumConnectionsChanged(nPrevNodeCount);
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
         }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+#ifdef USE_EPOLL
+static bool InitSocketEvents()
+{
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        LogPrintf("Error: epoll_create1 failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupfd == -1) {
+        LogPrintf("Error: eventfd failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &wakeupfd;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupfd, &event) != 0) {
+        LogPrintf("Error: epoll_ctl failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    // Listening sockets are level-triggered; one connection is accepted per event.
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("Error: epoll_ctl failed: %s\n", NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Act on the socket readiness epoll reported for a node. Returns whether
+ * anything is left to do for it; fRetrySoon is set when that is blocked on
+ * a buffer lock (or a read limit) rather than on the next socket event.
+ */
+static bool ServiceNodeSocket(CNode* pnode, bool& fRetrySoon)
+{
+    if (pnode->fDisconnect)
+        return false;
+
+    auto spanGuard = pnode->span.Enter();
+
+    //
+    // Send
+    //
+    if (pnode->fSendReady)
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend) {
+            if (!pnode->vSendMsg.empty())
+                SocketSendData(pnode);
+            // Anything left over is sent on the next EPOLLOUT edge.
+            pnode->fSendReady = false;
+        } else {
+            fRetrySoon = true;
+        }
+    }
+
+    //
+    // Receive
+    //
+    if (pnode->fRecvReady)
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (!lockRecv) {
+            fRetrySoon = true;
+        } else if (IsRecvFlooded(pnode)) {
+            // Resumed by WakeSocketHandler() once the message handler catches up.
+            pnode->fPauseRecv = true;
+        } else {
+            pnode->fPauseRecv = false;
+            for (int i = 0; i < MAX_RECV_PER_SERVICE && pnode->fRecvReady; i++)
+                pnode->fRecvReady = SocketRecvData(pnode);
+            if (pnode->fRecvReady)
+                fRetrySoon = true;
+        }
+    }
+
+    return pnode->fRecvReady || pnode->fSendReady;
+}
+
+void ThreadSocketHandler()
+{
+    unsigned int nPrevNodeCount = 0;
+    int64_t nLastSweep = 0;
+    int64_t nLastInactivityCheck = 0;
+    bool fRetrySoon = false;
+    // Nodes with readiness left to act on, each holding a reference.
+    set<CNode*> setPending;
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+
+    while (true)
+    {
+        //
+        // Disconnect nodes
+        //
+        int64_t nNow = GetTimeMillis();
+        if (nNow - nLastSweep >= SOCKET_SWEEP_INTERVAL)
+        {
+            nLastSweep = nNow;
+            DisconnectNodes();
+            NotifyNumConnectionsChanged(nPrevNodeCount);
+
+            //
+            // Inactivity checking
+            //
+            if (nNow - nLastInactivityCheck >= 1000)
+            {
+                nLastInactivityCheck = nNow;
+                LOCK(cs_vNodes);
+                for (CNode* pnode : vNodes)
+                    InactivityCheck(pnode);
+            }
+        }
+
+        //
+        // Wait for socket events
+        //
+        int nTimeout = fRetrySoon ? SOCKET_RETRY_INTERVAL : std::max<int64_t>(0, nLastSweep + SOCKET_SWEEP_INTERVAL - GetTimeMillis());
+        int nEvents = epoll_wait(epollfd, events, MAX_SOCKET_EVENTS, nTimeout);
+        boost::this_thread::interruption_point();
+
+        if (nEvents == SOCKET_ERROR)
+        {
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR) {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                MilliSleep(SOCKET_SWEEP_INTERVAL);
+            }
+            nEvents = 0;
+        }
+
+        for (int i = 0; i < nEvents; i++)
+        {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &wakeupfd) {
+                uint64_t n;
+                if (read(wakeupfd, &n, sizeof(n)) != sizeof(n)) {
+                    // Nothing to drain
+                }
+                continue;
+            }
+
+            //
+            // Accept new connections
+            //
+            bool fAccepted = false;
+            for (const ListenSocket& hListenSocket : vhListenSocket) {
+                if (ptr == &hListenSocket) {
+                    AcceptConnection(hListenSocket);
+                    fAccepted = true;
+                    break;
+                }
+            }
+            if (fAccepted)
+                continue;
+
+            // Peer sockets are removed from the set before their node can be
+            // deleted, which only happens on this thread in DisconnectNodes().
+            CNode* pnode = static_cast<CNode*>(ptr);
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fRecvReady = true;
+            if (events[i].events & EPOLLOUT)
+                pnode->fSendReady = true;
+            if (setPending.insert(pnode).second)
+                pnode->AddRef();
+        }
+
+        //
+        // Service each ready socket
+        //
+        fRetrySoon = false;
+        for (set<CNode*>::iterator it = setPending.begin(); it != setPending.end(); )
+        {
+            CNode* pnode = *it;
+            if (ServiceNodeSocket(pnode, fRetrySoon)) {
+                ++it;
+            } else {
+                pnode->Release();
+                it = setPending.erase(it);
+            }
+        }
+    }
+}
+#else
+void ThreadSocketHandler()
+{
+    unsigned int nPrevNodeCount = 0;
+    while (true)
+    {
+        //
+        // Disconnect nodes
+        //
+        DisconnectNodes();
+        NotifyNumConnectionsChanged(nPrevNodeCount);
 
         //
         // Find which sockets have data to receive
@@ -1207,9 +1572,7 @@ void ThreadSocketHandler()
                 bool select_recv;
                 {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    select_recv = lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize());
+                    select_recv = lockRecv && !IsRecvFlooded(pnode);
                 }
 
                 LOCK(pnode->cs_hSocket);
@@ -1293,48 +1656,7 @@ void ThreadSocketHandler()
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
-                {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = 0;
-                        {
-                            LOCK(pnode->cs_hSocket);
-                            if (pnode->hSocket == INVALID_SOCKET)
-                                continue;
-                            nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        }
-                        if (nBytes > 0)
-                        {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            {
-                                LOCK(pnode->cs_vRecv);
-                                pnode->nRecvBytes += nBytes;
-                            }
-                            pnode->RecordBytesRecv(nBytes);
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                    SocketRecvData(pnode);
             }
 
             //
@@ -1350,30 +1672,7 @@ void ThreadSocketHandler()
             //
             // Inactivity checking
             //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
-            }
+            InactivityCheck(pnode);
         }
         {
             LOCK(cs_vNodes);
@@ -1382,6 +1681,7 @@ void ThreadSocketHandler()
         }
     }
 }
+#endif
 
 
 void ThreadDNSAddressSeed()
@@ -1673,7 +1973,17 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+void WakeMessageHandler()
+{
+    nMessageHandlerWakeups++;
+    messageHandlerCondition.notify_all();
+}
+
+// Each message handler thread walks the peers starting from its own offset.
+// A peer is worked on by one thread at a time (cs_process), which keeps its
+// messages in order; messages that need validation are further serialized
+// across peers by ProcessMessages.
+void ThreadMessageHandler(int nThread, int nThreads)
 {
     const CChainParams& chainparams = Params();
     boost::mutex condition_mutex;
@@ -1682,6 +1992,8 @@ void ThreadMessageHandler()
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true)
     {
+        uint64_t nWakeups = nMessageHandlerWakeups;
+
         vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
@@ -1693,11 +2005,17 @@ void ThreadMessageHandler()
 
         bool fSleep = true;
 
-        for (CNode* pnode : vNodesCopy)
+        size_t nStart = vNodesCopy.size() * nThread / nThreads;
+        for (size_t i = 0; i < vNodesCopy.size(); i++)
         {
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
             if (pnode->fDisconnect)
                 continue;
 
+            TRY_LOCK(pnode->cs_process, lockProcess);
+            if (!lockProcess)
+                continue;
+
             auto spanGuard = pnode->span.Enter();
 
             // Receive messages
@@ -1708,7 +2026,10 @@ void ThreadMessageHandler()
                     if (!g_signals.ProcessMessages(chainparams, pnode))
                         pnode->CloseSocketDisconnect();
 
-                    if (pnode->nSendSize < SendBufferSize())
+                    if (pnode->fPauseRecv && !IsRecvFlooded(pnode))
+                        WakeSocketHandler();
+
+                    if (pnode->nSendSize < SendBufferSize() && !pnode->fWaitValidation)
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                         {
@@ -1734,7 +2055,7 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
-        if (fSleep)
+        if (fSleep && nWakeups == nMessageHandlerWakeups)
             messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
     }
 }
@@ -1893,7 +2214,7 @@ void static Discover(boost::thread_group& threadGroup)
 #endif
 }
 
-void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
+bool StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 {
     uiInterface.InitMessage(_("Loading addresses..."));
     // Load addresses from peers.dat
@@ -1942,6 +2263,11 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     Discover(threadGroup);
 
+#ifdef USE_EPOLL
+    if (!InitSocketEvents())
+        return false;
+#endif
+
     //
     // Start threads
     //
@@ -1962,10 +2288,18 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageThreads = std::max(1, std::min((int)GetArg("-messagethreads", DEFAULT_MESSAGE_HANDLER_THREADS), MAX_MESSAGE_HANDLER_THREADS));
+    for (int i = 0; i < nMessageThreads; i++) {
+        boost::function<void()> threadmessagehandler = boost::bind(&ThreadMessageHandler, i, nMessageThreads);
+        threadGroup.create_thread(
+            boost::bind(&TraceThread<boost::function<void()>>, "msghand", threadmessagehandler)
+        );
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
+
+    return true;
 }
 
 bool StopNode()
@@ -2015,6 +2349,13 @@ public:
         delete pnodeLocalHost;
         pnodeLocalHost = NULL;
 
+#ifdef USE_EPOLL
+        if (wakeupfd != -1)
+            close(wakeupfd);
+        if (epollfd != -1)
+            close(epollfd);
+#endif
+
 #ifdef WIN32
         // Shutdown Windows Sockets
         WSACleanup();
@@ -2214,6 +2555,10 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fNetworkNode = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fRecvReady = false;
+    fSendReady = false;
+    fPauseRecv = false;
+    fWaitValidation = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
@@ -2350,32 +2695,59 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
         LEAVE_CRITICAL_SECTION(cs_vSend);
         return;
     }
-    // Set the size
-    unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-    WriteLE32((uint8_t*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+    CSharedNetMessage msg = FinishSharedMessage(ssSend);
 
-    // Set the checksum
-    uint256 hash = Hash(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-    assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + CMessageHeader::CHECKSUM_SIZE);
-    memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    LogPrint("net", "(%d bytes) peer=%d\n", msg->size() - CMessageHeader::HEADER_SIZE, id);
 
-    LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
-
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
-    nSendSize += (*it).size();
+    nSendSize += msg->size();
     MetricsCounter(
-        "zcash.net.out.bytes", (*it).size(),
+        "zcash.net.out.bytes", msg->size(),
         "command", strSendCommand.c_str());
     strSendCommand.clear();
+    vSendMsg.push_back(std::move(msg));
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (vSendMsg.size() == 1)
         SocketSendData(this);
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+/* static */ CSharedNetMessage CNode::FinishSharedMessage(CDataStream& ss)
+{
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    WriteLE32((uint8_t*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], nSize);
+
+    // Set the checksum
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    assert(ss.size() >= CMessageHeader::CHECKSUM_OFFSET + CMessageHeader::CHECKSUM_SIZE);
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+
+    std::shared_ptr<CSerializeData> msg = std::make_shared<CSerializeData>();
+    ss.GetAndClear(*msg);
+    return msg;
+}
+
+void CNode::PushSharedMessage(const char* pszCommand, const CSharedNetMessage& msg)
+{
+    std::string strCommand = SanitizeString(pszCommand);
+    MetricsIncrementCounter("zcash.net.out.messages", "command", strCommand.c_str());
+
+    LOCK(cs_vSend);
+    LogPrint("net", "sending: %s (%d bytes) peer=%d\n", strCommand, msg->size() - CMessageHeader::HEADER_SIZE, id);
+
+    nSendSize += msg->size();
+    MetricsCounter(
+        "zcash.net.out.bytes", msg->size(),
+        "command", strCommand.c_str());
+    vSendMsg.push_back(msg);
+
+    // If write queue empty, attempt "optimistic write"
+    if (vSendMsg.size() == 1)
+        SocketSendData(this);
+}
+
 /* static */ uint64_t CNode::CalculateKeyedNetGroup(const CAddress& ad)
 {
     static const uint64_t k0 = GetRand(std::numeric_limits<uint64_t>::max());
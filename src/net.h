@@ -22,6 +22,7 @@
 
 #include <atomic>
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -63,6 +64,10 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** The default number of message handler threads (-messagethreads) */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
+/** The maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 /** The default for -maxuploadtarget. 0 = Unlimited */
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 /** Default for blocks only*/
@@ -93,9 +98,11 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest = NULL);
 bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOutbound = NULL, const char *strDest = NULL, bool fOneShot = false);
 unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
-void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
+bool StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Wake the message handler threads, e.g. once a message they were waiting on can be processed */
+void WakeMessageHandler();
 
 typedef int NodeId;
 
@@ -249,6 +256,11 @@ public:
     int readData(const char *pch, unsigned int nBytes);
 };
 
+/** A complete serialized message, header included. Queued messages are never
+ * modified, so one buffer can sit in the send queues of many peers at once.
+ */
+typedef std::shared_ptr<const CSerializeData> CSharedNetMessage;
+
 
 /** Information about a peer */
 class CNode
@@ -262,7 +274,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSharedNetMessage> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -270,6 +282,7 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    CCriticalSection cs_process; // held by the message handler thread working on this peer
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -292,6 +305,16 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     std::atomic_bool fDisconnect;
+    // Socket readiness reported by the epoll socket handler and not yet
+    // acted on; only used by that thread.
+    bool fRecvReady;
+    bool fSendReady;
+    // Set by the socket handler while it holds off reading because the
+    // receive buffer is full.
+    std::atomic_bool fPauseRecv;
+    // Set by ProcessMessages when the next message waits for another peer's
+    // validation; only used by the message handler thread holding cs_process.
+    bool fWaitValidation;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
     // b) the peer may tell us in its version message that we should not relay tx invs
@@ -331,6 +354,7 @@ public:
     std::atomic<int> nStartingHeight;
 
     // flood relay
+    CCriticalSection cs_vAddrToSend; // also guards addrKnown, as other peers' threads relay addresses
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -450,6 +474,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(addr.GetKey());
     }
 
@@ -458,6 +483,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_vAddrToSend);
         if (addr.IsValid() && !addrKnown.contains(addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] = addr;
@@ -503,6 +529,26 @@ public:
 
     void PushVersion();
 
+    /**
+     * Serialize a message once, to be queued on any number of peers with
+     * PushSharedMessage instead of being serialized again for each of them.
+     * The message is encoded at PROTOCOL_VERSION, so this is only for
+     * messages whose encoding does not depend on the peer's version.
+     */
+    template<typename T1>
+    static CSharedNetMessage MakeSharedMessage(const char* pszCommand, const T1& a1)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << CMessageHeader(Params().MessageStart(), pszCommand, 0);
+        ss << a1;
+        return FinishSharedMessage(ss);
+    }
+
+    static CSharedNetMessage FinishSharedMessage(CDataStream& ss);
+
+    /** Queue a message built by MakeSharedMessage, without copying it */
+    void PushSharedMessage(const char* pszCommand, const CSharedNetMessage& msg);
+
 
     void PushMessage(const char* pszCommand)
     {
@@ -5,12 +5,20 @@
 
 #include "primitives/block.h"
 
+#include "checkqueue.h"
 #include "hash.h"
 #include "tinyformat.h"
+#include "util.h"
 #include "utilstrencodings.h"
 #include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "streams.h"
+#include "version.h"
+#include "yespower.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 
 const unsigned char ZCASH_AUTH_DATA_HASH_PERSONALIZATION[BLAKE2bPersonalBytes] =
     {'Z','c','a','s','h','A','u','t','h','D','a','t','H','a','s','h'};
@@ -34,6 +42,182 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+// The yespower parameters for a serialized block header, which is also used
+// as the personalization string.
+static yespower_params_t YespowerParams(const unsigned char* pheader, size_t nSize)
+{
+    yespower_params_t params = {
+            .version = YESPOWER_0_5,
+            .N = 20480,    // Fast mining: 2048 (original value)
+            .r = 32,       // Fast mining: 8 (original value)
+            // Fast configuration for quick genesis block mining
+            // Memory requirement: 128 × 8 × 2048 = ~2 MB per thread
+            // Speed: ~100x faster than N=131072, r=32
+            .pers = pheader,
+            .perslen = nSize
+    };
+    return params;
+}
+
+// Compute the yespower hash of a serialized block header.
+static uint256 YespowerHash(const unsigned char* pheader, size_t nSize)
+{
+    uint256 thash;
+    yespower_params_t params = YespowerParams(pheader, nSize);
+    if (yespower_tls(pheader, nSize, &params, (yespower_binary_t *)&thash)) {
+        abort();
+    }
+    return thash;
+}
+
+uint256 CBlockHeader::GetPoWHash() const
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << *this;
+    return YespowerHash((const unsigned char *)&ss[0], ss.size());
+}
+
+CPoWHeader::CPoWHeader(const CBlockHeader& header)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    assert(ss.size() <= sizeof(data));
+    nSize = ss.size();
+    memcpy(data, &ss[0], nSize);
+}
+
+void CPoWHeader::SetTime(uint32_t nTime)
+{
+    WriteLE32(data + TIME_OFFSET, nTime);
+}
+
+void CPoWHeader::SetBits(uint32_t nBits)
+{
+    WriteLE32(data + BITS_OFFSET, nBits);
+}
+
+void CPoWHeader::SetNonce(uint32_t nNonce)
+{
+    WriteLE32(data + NONCE_OFFSET, nNonce);
+}
+
+uint256 CPoWHeader::GetPoWHash() const
+{
+    return YespowerHash(data, nSize);
+}
+
+void CPoWHeader::GetPoWHashes(uint32_t nNonce, uint256* phashes, size_t nLanes) const
+{
+    assert(nLanes >= 1 && nLanes <= YESPOWER_MAX_LANES);
+    if (nLanes == 1) {
+        CPoWHeader header(*this);
+        header.SetNonce(nNonce);
+        phashes[0] = header.GetPoWHash();
+        return;
+    }
+
+    unsigned char vData[YESPOWER_MAX_LANES][CBlockHeader::HEADER_SIZE];
+    const uint8_t* vSrc[YESPOWER_MAX_LANES];
+    yespower_params_t vParams[YESPOWER_MAX_LANES];
+    for (size_t i = 0; i < nLanes; i++) {
+        memcpy(vData[i], data, nSize);
+        WriteLE32(vData[i] + NONCE_OFFSET, nNonce + i);
+        vSrc[i] = vData[i];
+        vParams[i] = YespowerParams(vData[i], nSize);
+    }
+    static_assert(sizeof(uint256) == sizeof(yespower_binary_t), "uint256 must match yespower_binary_t");
+    if (yespower_multi_tls(vSrc, nSize, vParams, nLanes, (yespower_binary_t *)phashes)) {
+        abort();
+    }
+}
+
+size_t CPoWHeader::GetPoWMemoryUsage(size_t nLanes)
+{
+    yespower_params_t params = YespowerParams(NULL, 0);
+    return yespower_local_size(&params, nLanes);
+}
+
+/** Number of leaves or pairs from which merkle tree work is split across threads. */
+static const size_t MERKLE_PARALLEL_THRESHOLD = 2048;
+/** Maximum number of threads used to build one merkle tree. */
+static const unsigned int MAX_MERKLE_THREADS = 8;
+
+/** Closure hashing one range of a level of a merkle tree. */
+class CMerkleCheck
+{
+private:
+    const std::function<void(size_t, size_t)> *pf;
+    size_t nBegin;
+    size_t nEnd;
+
+public:
+    CMerkleCheck(): pf(NULL), nBegin(0), nEnd(0) {}
+    CMerkleCheck(const std::function<void(size_t, size_t)>& f, size_t nBeginIn, size_t nEndIn) :
+        pf(&f), nBegin(nBeginIn), nEnd(nEndIn) { }
+
+    bool operator()() {
+        (*pf)(nBegin, nEnd);
+        return true;
+    }
+
+    void swap(CMerkleCheck &check) {
+        std::swap(pf, check.pf);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+    }
+};
+
+// Every range is a sizeable piece of work, so hand them out one at a time.
+static CCheckQueue<CMerkleCheck> merklecheckqueue(1);
+static std::atomic<unsigned int> nMerkleCheckThreads{0};
+
+void ThreadMerkleCheck() {
+    RenameThread("koto-merkle");
+    nMerkleCheckThreads++;
+    try {
+        merklecheckqueue.Thread();
+    } catch (...) {
+        // Interrupted on shutdown
+        nMerkleCheckThreads--;
+        throw;
+    }
+}
+
+// Call f(begin, end) over ranges covering [0, n), spreading them across the
+// merkle check threads if n is large enough for that to pay off. If another
+// tree is being built on them, the caller does all of the work itself rather
+// than wait.
+static void MerkleParallelFor(size_t n, const std::function<void(size_t, size_t)>& f)
+{
+    unsigned int nThreads = 1;
+    if (n >= MERKLE_PARALLEL_THRESHOLD) {
+        nThreads = std::min(MAX_MERKLE_THREADS, nMerkleCheckThreads.load() + 1);
+    }
+    boost::unique_lock<boost::mutex> lock(merklecheckqueue.ControlMutex, boost::defer_lock);
+    if (nThreads == 1 || !lock.try_lock()) {
+        f(0, n);
+        return;
+    }
+
+    size_t nChunk = (n + nThreads - 1) / nThreads;
+    std::vector<CMerkleCheck> vChecks;
+    for (size_t begin = 0; begin < n; begin += nChunk) {
+        vChecks.emplace_back(f, begin, std::min(n, begin + nChunk));
+    }
+    merklecheckqueue.Add(vChecks);
+    merklecheckqueue.Wait();
+}
+
+// The number of nodes in the merkle tree of nLeaves leaves.
+static size_t MerkleTreeSize(size_t nLeaves)
+{
+    size_t nNodes = nLeaves;
+    for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2) {
+        nNodes += (nSize + 1) / 2;
+    }
+    return nNodes;
+}
+
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
 {
     /* WARNING! If you're reading this because you're learning about crypto
@@ -73,21 +257,31 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     */
     vMerkleTree.clear();
     vMerkleTree.reserve(vtx.size() * 2 + 16); // Safe upper bound for the number of total nodes.
-    for (std::vector<CTransaction>::const_iterator it(vtx.begin()); it != vtx.end(); ++it)
-        vMerkleTree.push_back(it->GetScriptSigHash());
+    vMerkleTree.resize(vtx.size());
+    MerkleParallelFor(vtx.size(), [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            vMerkleTree[i] = vtx[i].GetScriptSigHash();
+        }
+    });
     int j = 0;
     bool mutated = false;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+        if (nSize % 2 == 0 && vMerkleTree[j+nSize-2] == vMerkleTree[j+nSize-1]) {
+            // Two identical hashes at the end of the list at a particular level.
+            mutated = true;
+        }
+        // Adjacent pairs of nodes are contiguous 64-byte inputs, so hash them
+        // in batches, then pair an odd last node with itself. The reserve()
+        // above guarantees that resizing does not move the nodes being read.
+        size_t nNext = vMerkleTree.size();
+        vMerkleTree.resize(nNext + (nSize + 1) / 2);
+        MerkleParallelFor(nSize / 2, [this, nNext, j](size_t begin, size_t end) {
+            SHA256D64(vMerkleTree[nNext + begin].begin(), vMerkleTree[j + 2 * begin].begin(), end - begin);
+        });
+        if (nSize % 2) {
+            const uint256& last = vMerkleTree[j+nSize-1];
+            vMerkleTree.back() = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
         }
         j += nSize;
     }
@@ -97,6 +291,26 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
 }
 
+uint256 CBlock::UpdateMerkleTree(size_t nIndex) const
+{
+    assert(nIndex < vtx.size());
+    if (vMerkleTree.size() != MerkleTreeSize(vtx.size()))
+        return BuildMerkleTree();
+
+    vMerkleTree[nIndex] = vtx[nIndex].GetScriptSigHash();
+    size_t j = 0;
+    for (size_t nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
+    {
+        size_t i = nIndex & ~(size_t)1;
+        size_t i2 = std::min(i + 1, nSize - 1);
+        vMerkleTree[j + nSize + nIndex / 2] = Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
+                                                   BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2]));
+        nIndex /= 2;
+        j += nSize;
+    }
+    return vMerkleTree.back();
+}
+
 std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const
 {
     if (vMerkleTree.empty())
@@ -9,7 +9,6 @@
 #include "primitives/transaction.h"
 #include "serialize.h"
 #include "uint256.h"
-#include "yespower.h"
 #include "utilstrencodings.h"
 #include "streams.h"
 #include "sync.h"
@@ -86,26 +85,7 @@ public:
         return (int64_t)nTime;
     }
 
-    uint256 GetPoWHash() const
-    {
-        uint256 thash;
-        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-        ss << *this;
-        yespower_params_t params = {
-                .version = YESPOWER_0_5,
-                .N = 20480,    // Fast mining: 2048 (original value)
-                .r = 32,       // Fast mining: 8 (original value)
-                // Fast configuration for quick genesis block mining
-                // Memory requirement: 128 × 8 × 2048 = ~2 MB per thread
-                // Speed: ~100x faster than N=131072, r=32
-                .pers = (const uint8_t *)&ss[0],
-                .perslen = ss.size()
-        };
-        if (yespower_tls((unsigned char *)&ss[0], ss.size(), &params, (yespower_binary_t *)&thash)) {
-            abort();
-        }
-        return thash;
-    }
+    uint256 GetPoWHash() const;
 };
 
 
@@ -163,6 +143,14 @@ public:
     // merkle root).
     uint256 BuildMerkleTree(bool* mutated = NULL) const;
 
+    // Update the in-memory merkle tree after vtx[nIndex] has been replaced,
+    // rehashing only the nodes on its path to the root, and return the new
+    // merkle root. If the tree is empty or sized for a different number of
+    // transactions, this builds the whole tree instead. Otherwise the caller
+    // must guarantee that vtx[nIndex] is the only transaction changed since
+    // the tree was last built or updated.
+    uint256 UpdateMerkleTree(size_t nIndex) const;
+
     std::vector<uint256> GetMerkleBranch(int nIndex) const;
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
 
@@ -201,6 +189,48 @@ public:
 };
 
 
+/**
+ * A block header serialized once into a fixed-size buffer, for the miner's
+ * nonce search. Only the nonce (and the time and bits, if they change) are
+ * patched in place between hashes, so computing the PoW hash of the next
+ * candidate does no serialization or allocation.
+ */
+class CPoWHeader
+{
+private:
+    enum : size_t {
+        TIME_OFFSET = 4+32+32,
+        BITS_OFFSET = TIME_OFFSET+4,
+        NONCE_OFFSET = BITS_OFFSET+4,
+    };
+
+    unsigned char data[CBlockHeader::HEADER_SIZE];
+    size_t nSize;
+
+public:
+    explicit CPoWHeader(const CBlockHeader& header);
+
+    void SetTime(uint32_t nTime);
+    void SetBits(uint32_t nBits);
+    void SetNonce(uint32_t nNonce);
+
+    uint256 GetPoWHash() const;
+
+    //! The serialized header that GetPoWHash() hashes.
+    const unsigned char* begin() const { return data; }
+    const unsigned char* end() const { return data + nSize; }
+
+    //! Compute the PoW hashes of this header with nonces nNonce to
+    //! nNonce + nLanes - 1 into phashes, interleaving up to
+    //! YESPOWER_MAX_LANES independent hashes on this thread.
+    void GetPoWHashes(uint32_t nNonce, uint256* phashes, size_t nLanes) const;
+
+    //! Bytes of memory GetPoWHashes() needs per thread for nLanes hashes:
+    //! 83906560 (about 84 MB) per lane with the consensus N and r.
+    static size_t GetPoWMemoryUsage(size_t nLanes);
+};
+
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
@@ -241,4 +271,7 @@ struct CBlockLocator
     }
 };
 
+/** Run an instance of the merkle tree hashing thread */
+void ThreadMerkleCheck();
+
 #endif // BITCOIN_PRIMITIVES_BLOCK_H
@@ -50,6 +50,19 @@ public:
     }
 };
 
+ProofVerifier::ProofVerifier(ProofVerifier&& verifier) :
+    perform_verification(verifier.perform_verification),
+    sapling_batch(std::move(verifier.sapling_batch)) {}
+
+ProofVerifier& ProofVerifier::operator=(ProofVerifier&& verifier)
+{
+    if (this != &verifier) {
+        perform_verification = verifier.perform_verification;
+        sapling_batch = std::move(verifier.sapling_batch);
+    }
+    return *this;
+}
+
 ProofVerifier ProofVerifier::Strict() {
     return ProofVerifier(true);
 }
@@ -58,6 +71,23 @@ ProofVerifier ProofVerifier::Disabled() {
     return ProofVerifier(false);
 }
 
+ProofVerifier ProofVerifier::Batch() {
+    auto verifier = ProofVerifier(true);
+    verifier.sapling_batch.reset(librustzcash_sapling_proof_batch_init());
+    return verifier;
+}
+
+void* ProofVerifier::SaplingVerificationContext(bool zip216Enabled) {
+    if (sapling_batch) {
+        return librustzcash_sapling_batch_verification_ctx_init(zip216Enabled, sapling_batch.get());
+    }
+    return librustzcash_sapling_verification_ctx_init(zip216Enabled);
+}
+
+bool ProofVerifier::ValidateSaplingBatch() {
+    return librustzcash_sapling_proof_batch_validate(sapling_batch.get());
+}
+
 bool ProofVerifier::VerifySprout(
     const JSDescription& jsdesc,
     const Ed25519VerificationKey& joinSplitPubKey
@@ -69,3 +99,13 @@ bool ProofVerifier::VerifySprout(
     auto pv = SproutProofVerifier(*this, joinSplitPubKey, jsdesc);
     return std::visit(pv, jsdesc.proof);
 }
+
+bool ProofVerifier::VerifyOrchard(const OrchardBundle& bundle) {
+    if (!perform_verification) {
+        return true;
+    }
+
+    // Since we check encoding consensus rules at parse time, and signature
+    // validation is batched, all the bundle-specific rules check is the proof.
+    return bundle.CheckBundleSpecificConsensusRules();
+}
@@ -8,13 +8,23 @@
 #include <primitives/transaction.h>
 #include <uint256.h>
 
+#include <librustzcash.h>
 #include <rust/ed25519/types.h>
 
+#include <memory>
+
 class ProofVerifier {
 private:
     bool perform_verification;
 
-    ProofVerifier(bool perform_verification) : perform_verification(perform_verification) { }
+    /// An optional batch of Sapling proofs (with `nullptr` meaning that
+    /// Sapling proofs are verified as they are checked). Memory is
+    /// allocated by Rust.
+    std::unique_ptr<void, decltype(&librustzcash_sapling_proof_batch_free)> sapling_batch;
+
+    ProofVerifier(bool perform_verification) :
+        perform_verification(perform_verification),
+        sapling_batch(nullptr, librustzcash_sapling_proof_batch_free) { }
 
 public:
     // ProofVerifier should never be copied
@@ -32,11 +42,29 @@ public:
     // such as during reindexing.
     static ProofVerifier Disabled();
 
+    // Creates a verification context that strictly verifies
+    // all proofs, but queues Sapling proofs until
+    // ValidateSaplingBatch() is called, so that a block's
+    // proofs can be verified together.
+    static ProofVerifier Batch();
+
+    // Returns a Sapling verification context for one transaction,
+    // to be freed with librustzcash_sapling_verification_ctx_free()
+    // before this verifier is destroyed.
+    void* SaplingVerificationContext(bool zip216Enabled);
+
+    // Verifies the queued Sapling proofs, returning false if any
+    // of them is invalid. Always true when not batching.
+    bool ValidateSaplingBatch();
+
     // Verifies that the JoinSplit proof is correct.
     bool VerifySprout(
         const JSDescription& jsdesc,
         const Ed25519VerificationKey& joinSplitPubKey
     );
+
+    // Verifies that the Orchard bundle's proof is correct.
+    bool VerifyOrchard(const OrchardBundle& bundle);
 };
 
 #endif // ZCASH_PROOF_VERIFIER_H
@@ -128,6 +128,7 @@ enum GetDataMsg : uint32_t {
     MSG_WTX = 5,             //!< Defined in ZIP 239
     // The following can only occur in getdata. Invs always use TX/WTX or BLOCK.
     MSG_FILTERED_BLOCK = 3,  //!< Defined in BIP37
+    MSG_CMPCT_BLOCK = 4,     //!< Defined in BIP152
 };
 
 /** inv message data */
@@ -160,6 +161,12 @@ public:
         case MSG_BLOCK:
         case MSG_FILTERED_BLOCK:
             break;
+        case MSG_CMPCT_BLOCK:
+            if (nVersion < SHORT_IDS_BLOCKS_VERSION) {
+                throw std::ios_base::failure(
+                    "Negotiated protocol version does not support CInv message type MSG_CMPCT_BLOCK");
+            }
+            break;
         case MSG_WTX:
             if (nVersion < CINV_WTX_VERSION) {
                 throw std::ios_base::failure(
@@ -299,6 +299,14 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"minerthreads\": [           (array) The running mining threads\n"
+            "    {\n"
+            "      \"thread\": n,             (numeric) The thread index\n"
+            "      \"cpu\": n,                (numeric) The CPU the thread is pinned to, or -1 if it is not pinned\n"
+            "      \"numanode\": n,           (numeric) The NUMA node of that CPU, or -1 if unknown\n"
+            "      \"pages\": \"xxxx\"          (string) The pages backing the thread's hashing memory (1G, 2M, THP or 4K, or failed if no memory could be reserved)\n"
+            "    }, ...\n"
+            "  ]\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmininginfo", "")
@@ -325,6 +333,16 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.pushKV("chain",            Params().NetworkIDString());
 #ifdef ENABLE_MINING
     obj.pushKV("generate",         getgenerate(params, false));
+    UniValue threads(UniValue::VARR);
+    for (const MinerThreadInfo& info : GetMinerThreadInfo()) {
+        UniValue thread(UniValue::VOBJ);
+        thread.pushKV("thread", info.nThread);
+        thread.pushKV("cpu", info.nCPU);
+        thread.pushKV("numanode", info.nNode);
+        thread.pushKV("pages", info.strPages);
+        threads.push_back(thread);
+    }
+    obj.pushKV("minerthreads",     threads);
 #endif
     return obj;
 }
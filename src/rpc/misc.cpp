@@ -582,7 +582,10 @@ static bool getAddressesFromParams(
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    // An address given twice is only looked up once, so that it is not
+    // counted twice and a page cursor identifies a single address.
     KeyIO keyIO(Params());
+    std::set<std::pair<uint160, int>> seen;
     for (const auto& it : param_addresses) {
         CTxDestination address = keyIO.DecodeDestination(it);
         uint160 hashBytes;
@@ -590,7 +593,9 @@ static bool getAddressesFromParams(
         if (!getIndexKey(address, hashBytes, type)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
         }
-        addresses.push_back(std::make_pair(hashBytes, type));
+        if (seen.insert(std::make_pair(hashBytes, type)).second) {
+            addresses.push_back(std::make_pair(hashBytes, type));
+        }
     }
     return true;
 }
@@ -813,22 +818,54 @@ static void getHeightRange(const UniValue& params, int& start, int& end)
     }
 }
 
-// Parse an address list then fetch the corresponding addressindex information.
-static void getAddressesInHeightRange(
-    const UniValue& params,
-    int start, int end,
-    std::vector<std::pair<uint160, int>>& addresses,
-    std::vector<std::pair<CAddressIndexKey, CAmount>> &addressIndex)
+// Paginated calls return the address index key of the last entry of a page,
+// hex-encoded, as the cursor to pass as "after" for the next page.
+static std::string encodeAddressIndexCursor(const CAddressIndexKey& key)
 {
-    if (!getAddressesFromParams(params, addresses)) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+// Read the "limit" and "after" options of a paginated call. Returns false
+// if there is no limit, in which case all entries are returned at once.
+static bool getPageParams(const UniValue& params, size_t& limit, std::optional<CAddressIndexKey>& after)
+{
+    limit = std::numeric_limits<size_t>::max();
+    after.reset();
+    if (!params[0].isObject()) {
+        return false;
     }
-    for (const auto& it : addresses) {
-        if (!GetAddressIndex(it.first, it.second, addressIndex, start, end)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
-                "No information available for address");
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue afterValue = find_value(params[0].get_obj(), "after");
+    if (limitValue.isNull()) {
+        if (!afterValue.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "After is only allowed together with limit");
         }
+        return false;
+    }
+    if (limitValue.get_int() <= 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
     }
+    limit = limitValue.get_int();
+    if (!afterValue.isNull()) {
+        const std::string& strAfter = afterValue.get_str();
+        if (!IsHex(strAfter)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid after cursor");
+        }
+        CDataStream ss(ParseHex(strAfter), SER_DISK, CLIENT_VERSION);
+        CAddressIndexKey key;
+        try {
+            ss >> key;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid after cursor");
+        }
+        if (!ss.empty()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid after cursor");
+        }
+        after = key;
+    }
+    return true;
 }
 
 // insightexplorer
@@ -840,7 +877,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() != 1)
         throw runtime_error(
-            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false)}\n"
+            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false), (\"limit\": n), (\"after\": \"cursor\")}\n"
             "\nReturns all changes for an address.\n"
             "\nReturns information about all changes to the given transparent addresses within the given (inclusive)\n"
             "\nblock height range, default is the full blockchain.\n"
@@ -855,6 +892,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\"       (number, optional) The start block height\n"
             "  \"end\"         (number, optional) The end block height\n"
             "  \"chainInfo\"   (boolean, optional, default=false) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\"       (number, optional) Return at most this many deltas, and a cursor for the rest\n"
+            "  \"after\"       (string, optional) The \"next\" cursor returned with the previous page\n"
             "}\n"
             "(or)\n"
             "\"address\"       (string) The base58check encoded address\n"
@@ -890,10 +929,16 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "      \"hash\"          (string)  The end block hash\n"
             "      \"height\"        (numeric) The height of the end block\n"
             "    }\n"
+            "}\n\n"
+            "(if limit is given, the result is an object as above, with \"start\" and \"end\" only if chainInfo\n"
+            "is true, and with):\n\n"
+            "{\n"
+            "  \"next\"          (string)  The cursor to pass as \"after\" for the next page, or null after the last page\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000, \"chainInfo\": true}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000, \"chainInfo\": true}")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"limit\": 1000}'")
         );
 
     if (!(fExperimentalInsightExplorer || fExperimentalLightWalletd)) {
@@ -906,8 +951,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     getHeightRange(params, start, end);
 
     std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
 
     bool includeChainInfo = false;
     if (params[0].isObject()) {
@@ -917,29 +963,81 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         }
     }
 
+    size_t limit;
+    std::optional<CAddressIndexKey> after;
+    bool paginate = getPageParams(params, limit, after);
+
+    // A page continues with the address of the last delta of the previous page.
+    size_t first = 0;
+    if (after) {
+        while (first < addresses.size() &&
+               !(addresses[first].first == after->hashBytes && addresses[first].second == (int)after->type)) {
+            first++;
+        }
+        if (first == addresses.size()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "After cursor does not belong to the given addresses");
+        }
+    }
+
+    // Deltas are read straight from the index into the result, in key
+    // order, which is by height within each address.
     UniValue deltas(UniValue::VARR);
-    for (const auto& it : addressIndex) {
+    CAddressIndexKey last;
+    bool more = false;
+    for (size_t i = first; i < addresses.size() && !more; i++) {
         std::string address;
-        if (!getAddressFromIndex(it.first.type, it.first.hashBytes, address)) {
+        if (!getAddressFromIndex(addresses[i].second, addresses[i].first, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
 
-        UniValue delta(UniValue::VOBJ);
-        delta.pushKV("address", address);
-        delta.pushKV("blockindex", (int)it.first.txindex);
-        delta.pushKV("height", it.first.blockHeight);
-        delta.pushKV("index", (int)it.first.index);
-        delta.pushKV("satoshis", it.second);
-        delta.pushKV("txid", it.first.txhash.GetHex());
-        deltas.push_back(delta);
+        CAddressIndexKey keyStart(addresses[i].second, addresses[i].first, start, 0, uint256(), 0, false);
+        bool skipAfter = after && i == first && after->blockHeight >= start;
+        if (skipAfter) {
+            keyStart = *after;
+        }
+        auto addDelta = [&](const CAddressIndexKey& key, CAmount satoshis) {
+            if (skipAfter) {
+                skipAfter = false;
+                if (key.blockHeight == after->blockHeight && key.txindex == after->txindex &&
+                    key.txhash == after->txhash && key.index == after->index && key.spending == after->spending) {
+                    return true;
+                }
+            }
+            if (deltas.size() == limit) {
+                more = true;
+                return false;
+            }
+            UniValue delta(UniValue::VOBJ);
+            delta.pushKV("address", address);
+            delta.pushKV("blockindex", (int)key.txindex);
+            delta.pushKV("height", key.blockHeight);
+            delta.pushKV("index", (int)key.index);
+            delta.pushKV("satoshis", satoshis);
+            delta.pushKV("txid", key.txhash.GetHex());
+            deltas.push_back(delta);
+            last = key;
+            return true;
+        };
+        if (!ScanAddressIndex(keyStart, end, addDelta)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
+        }
     }
 
     UniValue result(UniValue::VOBJ);
 
-    if (!(includeChainInfo && start > 0 && end > 0)) {
+    if (!paginate && !(includeChainInfo && start > 0 && end > 0)) {
         return deltas;
     }
 
+    result.pushKV("deltas", deltas);
+    if (paginate) {
+        result.pushKV("next", more ? UniValue(encodeAddressIndexCursor(last)) : NullUniValue);
+    }
+    if (!(includeChainInfo && start > 0 && end > 0)) {
+        return result;
+    }
+
     UniValue startInfo(UniValue::VOBJ);
     UniValue endInfo(UniValue::VOBJ);
     {
@@ -953,7 +1051,6 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     startInfo.pushKV("height", start);
     endInfo.pushKV("height", end);
 
-    result.pushKV("deltas", deltas);
     result.pushKV("start", startInfo);
     result.pushKV("end", endInfo);
 
@@ -986,6 +1083,7 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "{\n"
             "  \"balance\"  (string) The current balance in zatoshis\n"
             "  \"received\"  (string) The total number of zatoshis received (including change)\n"
+            "  \"txcount\"  (number) The number of transactions involving each address, summed over the addresses\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"]}'")
@@ -998,22 +1096,29 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    // this method doesn't take start and end block height params, so set
-    // to zero (full range, entire blockchain)
-    getAddressesInHeightRange(params, 0, 0, addresses, addressIndex);
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
 
+    // The address balance index keeps running totals, so this is one
+    // lookup per address, however long its history.
     CAmount balance = 0;
     CAmount received = 0;
-    for (const auto& it : addressIndex) {
-        if (it.second > 0) {
-            received += it.second;
+    int64_t txCount = 0;
+    for (const auto& it : addresses) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance(it.first, it.second, value)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
         }
-        balance += it.second;
+        balance += value.balance;
+        received += value.received;
+        txCount += value.txCount;
     }
     UniValue result(UniValue::VOBJ);
     result.pushKV("balance", balance);
     result.pushKV("received", received);
+    result.pushKV("txcount", txCount);
     return result;
 }
 
@@ -1026,7 +1131,7 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() != 1)
         throw runtime_error(
-            "getaddresstxids {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n)}\n"
+            "getaddresstxids {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"limit\": n), (\"after\": \"cursor\")}\n"
             "\nReturns the txids for given transparent addresses within the given (inclusive)\n"
             "\nblock height range, default is the full blockchain.\n"
             "\nStarting v4.5.0, returned txids are in the order they appear in blocks, which \n"
@@ -1041,6 +1146,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number, optional) The start block height\n"
             "  \"end\" (number, optional) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids, and a cursor for the rest\n"
+            "  \"after\" (string, optional) The \"next\" cursor returned with the previous page\n"
             "}\n"
             "(or)\n"
             "\"address\"  (string) The base58check encoded address\n"
@@ -1048,10 +1155,20 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
-            "]\n"
+            "]\n\n"
+            "(or, if limit is given):\n\n"
+            "{\n"
+            "  \"txids\":\n"
+            "    [\n"
+            "      \"transactionid\"  (string) The transaction id\n"
+            "      ,...\n"
+            "    ],\n"
+            "  \"next\"  (string) The cursor to pass as \"after\" for the next page, or null after the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"limit\": 1000}'")
         );
 
     if (!(fExperimentalInsightExplorer || fExperimentalLightWalletd)) {
@@ -1064,26 +1181,74 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     getHeightRange(params, start, end);
 
     std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    size_t limit;
+    std::optional<CAddressIndexKey> after;
+    bool paginate = getPageParams(params, limit, after);
+
+    // A page starts after the (height, txindex) position of the last txid of
+    // the previous page.
+    int startHeight = start;
+    unsigned int startTxIndex = 0;
+    if (after && after->blockHeight >= start) {
+        startHeight = after->blockHeight;
+        startTxIndex = after->txindex + 1;
+    }
 
     // This is an ordered set, sorted by (height,txindex) so result also sorted by height.
-    std::set<std::tuple<int, int, std::string>> txids;
-
-    for (const auto& it : addressIndex) {
-        const int height = it.first.blockHeight;
-        const int txindex = it.first.txindex;
-        const std::string txid = it.first.txhash.GetHex();
-        // Duplicate entries (two addresses in same tx) are suppressed
-        txids.insert(std::make_tuple(height, txindex, txid));
+    // Only the first limit + 1 transactions of each address can be among the
+    // first limit + 1 overall, so the scan of an address stops there.
+    std::set<std::tuple<int, unsigned int, uint256>> txids;
+    for (const auto& it : addresses) {
+        CAddressIndexKey keyStart(it.second, it.first, startHeight, startTxIndex, uint256(), 0, false);
+        size_t addressTxs = 0;
+        std::tuple<int, unsigned int, uint256> lastTx;
+        auto addTx = [&](const CAddressIndexKey& key, CAmount) {
+            auto tx = std::make_tuple(key.blockHeight, key.txindex, key.txhash);
+            // Entries of one transaction are adjacent within an address; the
+            // set suppresses duplicates across addresses.
+            if (addressTxs > 0 && tx == lastTx) {
+                return true;
+            }
+            if (addressTxs > limit) {
+                return false;
+            }
+            txids.insert(tx);
+            lastTx = tx;
+            addressTxs++;
+            return true;
+        };
+        if (!ScanAddressIndex(keyStart, end, addTx)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
+        }
     }
+
     UniValue result(UniValue::VARR);
     for (const auto& it : txids) {
+        if (result.size() == limit) {
+            break;
+        }
         // only push the txid, not the height
-        result.push_back(std::get<2>(it));
+        result.push_back(std::get<2>(it).GetHex());
+    }
+    if (!paginate) {
+        return result;
     }
 
-    return result;
+    UniValue page(UniValue::VOBJ);
+    page.pushKV("txids", result);
+    if (txids.size() > limit) {
+        const auto& lastTx = *std::next(txids.begin(), limit - 1);
+        CAddressIndexKey last(0, uint160(), std::get<0>(lastTx), std::get<1>(lastTx), std::get<2>(lastTx), 0, false);
+        page.pushKV("next", encodeAddressIndexCursor(last));
+    } else {
+        page.pushKV("next", NullUniValue);
+    }
+    return page;
 }
 
 // insightexplorer
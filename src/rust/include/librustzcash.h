@@ -174,9 +174,31 @@ extern "C" {
     );
 
     /// Frees a Sapling verification context returned from
-    /// `librustzcash_sapling_verification_ctx_init`.
+    /// `librustzcash_sapling_verification_ctx_init` or
+    /// `librustzcash_sapling_batch_verification_ctx_init`.
     void librustzcash_sapling_verification_ctx_free(void *);
 
+    /// Creates an empty batch of Sapling Spend and Output proofs.
+    /// Please free this with `librustzcash_sapling_proof_batch_free`
+    /// when you're done.
+    void * librustzcash_sapling_proof_batch_init();
+
+    /// Frees a batch returned from `librustzcash_sapling_proof_batch_init`.
+    void librustzcash_sapling_proof_batch_free(void *);
+
+    /// Verifies every proof queued into the batch, leaving it empty.
+    /// Returns false if any proof is invalid.
+    bool librustzcash_sapling_proof_batch_validate(void *batch);
+
+    /// Creates a Sapling verification context that checks signatures
+    /// immediately but queues proofs into `batch`, to be verified by
+    /// `librustzcash_sapling_proof_batch_validate`. The context must
+    /// be freed before the batch.
+    void * librustzcash_sapling_batch_verification_ctx_init(
+        bool zip216Enabled,
+        void *batch
+    );
+
     /// Compute a Sapling nullifier.
     ///
     /// The `diversifier` parameter must be 11 bytes in length.
@@ -19,7 +19,8 @@
 // See https://github.com/rust-lang/rfcs/pull/2585 for more background.
 #![allow(clippy::not_unsafe_ptr_arg_deref)]
 
-use bellman::groth16::{Parameters, PreparedVerifyingKey, Proof};
+use bellman::gadgets::multipack;
+use bellman::groth16::{self, Parameters, PreparedVerifyingKey, Proof};
 use blake2s_simd::Params as Blake2sParams;
 use bls12_381::Bls12;
 use group::{cofactor::CofactorGroup, GroupEncoding};
@@ -44,7 +45,10 @@ use std::os::windows::ffi::OsStringExt;
 
 use zcash_primitives::{
     block::equihash,
-    constants::{CRH_IVK_PERSONALIZATION, PROOF_GENERATION_KEY_GENERATOR, SPENDING_KEY_GENERATOR},
+    constants::{
+        CRH_IVK_PERSONALIZATION, PROOF_GENERATION_KEY_GENERATOR, SPENDING_KEY_GENERATOR,
+        VALUE_COMMITMENT_RANDOMNESS_GENERATOR, VALUE_COMMITMENT_VALUE_GENERATOR,
+    },
     merkle_tree::MerklePath,
     sapling::{merkle_hash, spend_sig},
     sapling::{
@@ -536,23 +540,123 @@ pub extern "C" fn librustzcash_eh_isvalid(
     equihash::is_valid_solution(n, k, rs_input, rs_nonce, rs_soln).is_ok()
 }
 
+/// A batch of Sapling Spend and Output proofs, accumulated across the
+/// transactions of a block and verified together.
+pub struct SaplingProofBatch {
+    spends: groth16::batch::Verifier<Bls12>,
+    outputs: groth16::batch::Verifier<Bls12>,
+    queued: usize,
+}
+
+/// A Sapling verification context, which either verifies each proof as it is
+/// checked or queues it into a [`SaplingProofBatch`] owned by the caller.
+pub enum SaplingVerifier {
+    Immediate(SaplingVerificationContext),
+    Batched {
+        cv_sum: jubjub::ExtendedPoint,
+        zip216_enabled: bool,
+        batch: *mut SaplingProofBatch,
+    },
+}
+
 /// Creates a Sapling verification context. Please free this when you're done.
 #[no_mangle]
 pub extern "C" fn librustzcash_sapling_verification_ctx_init(
     zip216_enabled: bool,
-) -> *mut SaplingVerificationContext {
-    let ctx = Box::new(SaplingVerificationContext::new(zip216_enabled));
+) -> *mut SaplingVerifier {
+    let ctx = Box::new(SaplingVerifier::Immediate(SaplingVerificationContext::new(
+        zip216_enabled,
+    )));
+
+    Box::into_raw(ctx)
+}
+
+/// Creates a Sapling verification context that checks signatures and value
+/// commitments immediately, but queues proofs into `batch` instead of
+/// verifying them. The context must be freed before the batch.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_batch_verification_ctx_init(
+    zip216_enabled: bool,
+    batch: *mut SaplingProofBatch,
+) -> *mut SaplingVerifier {
+    assert!(!batch.is_null());
+    let ctx = Box::new(SaplingVerifier::Batched {
+        cv_sum: jubjub::ExtendedPoint::identity(),
+        zip216_enabled,
+        batch,
+    });
 
     Box::into_raw(ctx)
 }
 
 /// Frees a Sapling verification context returned from
-/// [`librustzcash_sapling_verification_ctx_init`].
+/// [`librustzcash_sapling_verification_ctx_init`] or
+/// [`librustzcash_sapling_batch_verification_ctx_init`].
 #[no_mangle]
-pub extern "C" fn librustzcash_sapling_verification_ctx_free(ctx: *mut SaplingVerificationContext) {
+pub extern "C" fn librustzcash_sapling_verification_ctx_free(ctx: *mut SaplingVerifier) {
     drop(unsafe { Box::from_raw(ctx) });
 }
 
+/// Creates an empty batch of Sapling proofs. Please free this with
+/// [`librustzcash_sapling_proof_batch_free`] when you're done.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_proof_batch_init() -> *mut SaplingProofBatch {
+    let batch = Box::new(SaplingProofBatch {
+        spends: groth16::batch::Verifier::new(),
+        outputs: groth16::batch::Verifier::new(),
+        queued: 0,
+    });
+
+    Box::into_raw(batch)
+}
+
+/// Frees a batch returned from [`librustzcash_sapling_proof_batch_init`].
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_proof_batch_free(batch: *mut SaplingProofBatch) {
+    if !batch.is_null() {
+        drop(unsafe { Box::from_raw(batch) });
+    }
+}
+
+/// Verifies every proof queued into the batch, leaving it empty. Returns
+/// false if any proof is invalid; a null batch is always valid.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_proof_batch_validate(batch: *mut SaplingProofBatch) -> bool {
+    let batch = match unsafe { batch.as_mut() } {
+        Some(batch) => batch,
+        None => return true,
+    };
+
+    // An empty batch is always valid, but is not free to run; skip it.
+    if batch.queued == 0 {
+        return true;
+    }
+    batch.queued = 0;
+
+    let spends = std::mem::replace(&mut batch.spends, groth16::batch::Verifier::new());
+    let outputs = std::mem::replace(&mut batch.outputs, groth16::batch::Verifier::new());
+
+    let spend_vk = &unsafe { SAPLING_SPEND_PARAMS.as_ref() }.unwrap().vk;
+    let output_vk = &unsafe { SAPLING_OUTPUT_PARAMS.as_ref() }.unwrap().vk;
+
+    spends.verify_multicore(spend_vk).is_ok() && outputs.verify_multicore(output_vk).is_ok()
+}
+
+/// Returns the value commitment to `value_balance` with zero randomness.
+fn compute_value_balance(value_balance: Amount) -> Option<jubjub::ExtendedPoint> {
+    let abs = match i64::from(value_balance).checked_abs() {
+        Some(a) => a as u64,
+        None => return None,
+    };
+
+    let mut value_balance_point = VALUE_COMMITMENT_VALUE_GENERATOR * jubjub::Fr::from(abs);
+    if value_balance.is_negative() {
+        value_balance_point = -value_balance_point;
+    }
+
+    Some(value_balance_point.into())
+}
+
 const GROTH_PROOF_SIZE: usize = 48 // π_A
     + 96 // π_B
     + 48; // π_C
@@ -561,7 +665,7 @@ const GROTH_PROOF_SIZE: usize = 48 // π_A
 /// commitment into the context.
 #[no_mangle]
 pub extern "C" fn librustzcash_sapling_check_spend(
-    ctx: *mut SaplingVerificationContext,
+    ctx: *mut SaplingVerifier,
     cv: *const [c_uchar; 32],
     anchor: *const [c_uchar; 32],
     nullifier: *const [c_uchar; 32],
@@ -601,23 +705,80 @@ pub extern "C" fn librustzcash_sapling_check_spend(
         Err(_) => return false,
     };
 
-    unsafe { &mut *ctx }.check_spend(
-        cv,
-        anchor,
-        unsafe { &*nullifier },
-        rk,
-        unsafe { &*sighash_value },
-        spend_auth_sig,
-        zkproof,
-        unsafe { SAPLING_SPEND_VK.as_ref() }.unwrap(),
-    )
+    match unsafe { &mut *ctx } {
+        SaplingVerifier::Immediate(ctx) => ctx.check_spend(
+            cv,
+            anchor,
+            unsafe { &*nullifier },
+            rk,
+            unsafe { &*sighash_value },
+            spend_auth_sig,
+            zkproof,
+            unsafe { SAPLING_SPEND_VK.as_ref() }.unwrap(),
+        ),
+        SaplingVerifier::Batched {
+            cv_sum,
+            zip216_enabled,
+            batch,
+        } => {
+            // The same checks as SaplingVerificationContext::check_spend,
+            // except that the proof is queued instead of verified.
+            if (cv.is_small_order() | rk.0.is_small_order()).into() {
+                return false;
+            }
+
+            *cv_sum += cv;
+
+            let mut data_to_be_signed = [0u8; 64];
+            data_to_be_signed[0..32].copy_from_slice(&rk.0.to_bytes());
+            data_to_be_signed[32..64].copy_from_slice(&(unsafe { &*sighash_value })[..]);
+
+            if !rk.verify_with_zip216(
+                &data_to_be_signed,
+                &spend_auth_sig,
+                SPENDING_KEY_GENERATOR,
+                *zip216_enabled,
+            ) {
+                return false;
+            }
+
+            let mut public_input = [bls12_381::Scalar::zero(); 7];
+            {
+                let affine = jubjub::AffinePoint::from(rk.0);
+                public_input[0] = affine.get_u();
+                public_input[1] = affine.get_v();
+            }
+            {
+                let affine = jubjub::AffinePoint::from(cv);
+                public_input[2] = affine.get_u();
+                public_input[3] = affine.get_v();
+            }
+            public_input[4] = anchor;
+
+            // Add the nullifier through multiscalar packing
+            {
+                let nullifier = multipack::bytes_to_bits_le(unsafe { &*nullifier });
+                let nullifier = multipack::compute_multipacking(&nullifier);
+
+                assert_eq!(nullifier.len(), 2);
+
+                public_input[5] = nullifier[0];
+                public_input[6] = nullifier[1];
+            }
+
+            let batch = unsafe { &mut **batch };
+            batch.spends.queue((zkproof, public_input.to_vec()));
+            batch.queued += 1;
+            true
+        }
+    }
 }
 
 /// Check the validity of a Sapling Output description, accumulating the value
 /// commitment into the context.
 #[no_mangle]
 pub extern "C" fn librustzcash_sapling_check_output(
-    ctx: *mut SaplingVerificationContext,
+    ctx: *mut SaplingVerifier,
     cv: *const [c_uchar; 32],
     cm: *const [c_uchar; 32],
     epk: *const [c_uchar; 32],
@@ -648,20 +809,49 @@ pub extern "C" fn librustzcash_sapling_check_output(
         Err(_) => return false,
     };
 
-    unsafe { &mut *ctx }.check_output(
-        cv,
-        cm,
-        epk,
-        zkproof,
-        unsafe { SAPLING_OUTPUT_VK.as_ref() }.unwrap(),
-    )
+    match unsafe { &mut *ctx } {
+        SaplingVerifier::Immediate(ctx) => ctx.check_output(
+            cv,
+            cm,
+            epk,
+            zkproof,
+            unsafe { SAPLING_OUTPUT_VK.as_ref() }.unwrap(),
+        ),
+        SaplingVerifier::Batched { cv_sum, batch, .. } => {
+            // The same checks as SaplingVerificationContext::check_output,
+            // except that the proof is queued instead of verified.
+            if (cv.is_small_order() | epk.is_small_order()).into() {
+                return false;
+            }
+
+            *cv_sum -= cv;
+
+            let mut public_input = [bls12_381::Scalar::zero(); 5];
+            {
+                let affine = jubjub::AffinePoint::from(cv);
+                public_input[0] = affine.get_u();
+                public_input[1] = affine.get_v();
+            }
+            {
+                let affine = jubjub::AffinePoint::from(epk);
+                public_input[2] = affine.get_u();
+                public_input[3] = affine.get_v();
+            }
+            public_input[4] = cm;
+
+            let batch = unsafe { &mut **batch };
+            batch.outputs.queue((zkproof, public_input.to_vec()));
+            batch.queued += 1;
+            true
+        }
+    }
 }
 
 /// Finally checks the validity of the entire Sapling transaction given
 /// valueBalance and the binding signature.
 #[no_mangle]
 pub extern "C" fn librustzcash_sapling_final_check(
-    ctx: *mut SaplingVerificationContext,
+    ctx: *mut SaplingVerifier,
     value_balance: i64,
     binding_sig: *const [c_uchar; 64],
     sighash_value: *const [c_uchar; 32],
@@ -677,7 +867,35 @@ pub extern "C" fn librustzcash_sapling_final_check(
         Err(_) => return false,
     };
 
-    unsafe { &*ctx }.final_check(value_balance, unsafe { &*sighash_value }, binding_sig)
+    match unsafe { &*ctx } {
+        SaplingVerifier::Immediate(ctx) => {
+            ctx.final_check(value_balance, unsafe { &*sighash_value }, binding_sig)
+        }
+        SaplingVerifier::Batched {
+            cv_sum,
+            zip216_enabled,
+            ..
+        } => {
+            // Obtain current cv_sum from the context, and subtract the value
+            // balance to get the binding verification key.
+            let value_balance = match compute_value_balance(value_balance) {
+                Some(a) => a,
+                None => return false,
+            };
+            let bvk = redjubjub::PublicKey(cv_sum - value_balance);
+
+            let mut data_to_be_signed = [0u8; 64];
+            data_to_be_signed[0..32].copy_from_slice(&bvk.0.to_bytes());
+            data_to_be_signed[32..64].copy_from_slice(&(unsafe { &*sighash_value })[..]);
+
+            bvk.verify_with_zip216(
+                &data_to_be_signed,
+                &binding_sig,
+                VALUE_COMMITMENT_RANDOMNESS_GENERATOR,
+                *zip216_enabled,
+            )
+        }
+    }
 }
 
 /// Sprout JoinSplit proof generation.
@@ -0,0 +1,310 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_SLABMAP_H
+#define BITCOIN_SLABMAP_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * A hash map that stores its entries in fixed-size slabs, and finds them
+ * through an open-addressing index of (slot, hash) pairs using linear
+ * probing.
+ *
+ * Entries are allocated SLAB_SIZE at a time instead of one heap node each,
+ * so there is no per-entry allocator overhead and neighbouring entries share
+ * cache lines. An entry never moves once inserted: pointers, references and
+ * iterators to it stay valid until it is erased, even across rehashes.
+ * Erased slots are reused by later inserts, and clear() releases all slabs
+ * at once.
+ *
+ * Only the subset of the unordered_map interface that the coins cache needs
+ * is provided. Iteration is in slot order, which is unrelated to the keys.
+ */
+template <typename K, typename T, typename Hash>
+class slabmap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+private:
+    //! Number of entries allocated together
+    static const uint32_t SLAB_SIZE = 256;
+    //! Slot number of an empty bucket, and of the end() iterator
+    static const uint32_t NO_SLOT = 0xffffffff;
+
+    struct Bucket
+    {
+        uint32_t slot;
+        uint32_t hash; // low bits of the key's hash, to skip most mismatches without touching the entry
+    };
+
+    struct Slab
+    {
+        alignas(value_type) unsigned char data[SLAB_SIZE * sizeof(value_type)];
+    };
+
+    Hash hasher;
+    std::vector<std::unique_ptr<Slab>> slabs;
+    std::vector<bool> live; // whether each slot holds an entry
+    std::vector<uint32_t> freeSlots;
+    std::vector<Bucket> buckets; // empty, or a power of two in size
+    size_t count;
+
+    value_type* value_at(uint32_t slot) const
+    {
+        return reinterpret_cast<value_type*>(slabs[slot / SLAB_SIZE]->data) + slot % SLAB_SIZE;
+    }
+
+    uint32_t next_live(uint32_t slot) const
+    {
+        while (slot < live.size() && !live[slot])
+            slot++;
+        return slot < live.size() ? slot : NO_SLOT;
+    }
+
+    uint32_t find_slot(const K& key, size_t hash) const
+    {
+        if (count == 0)
+            return NO_SLOT;
+        size_t mask = buckets.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            const Bucket& bucket = buckets[i];
+            if (bucket.slot == NO_SLOT)
+                return NO_SLOT;
+            if (bucket.hash == (uint32_t)hash && value_at(bucket.slot)->first == key)
+                return bucket.slot;
+        }
+    }
+
+    void place(uint32_t slot, uint32_t hash)
+    {
+        size_t mask = buckets.size() - 1;
+        size_t i = hash & mask;
+        while (buckets[i].slot != NO_SLOT)
+            i = (i + 1) & mask;
+        buckets[i].slot = slot;
+        buckets[i].hash = hash;
+    }
+
+    void unplace(uint32_t slot, uint32_t hash)
+    {
+        size_t mask = buckets.size() - 1;
+        size_t i = hash & mask;
+        while (buckets[i].slot != slot)
+            i = (i + 1) & mask;
+        // Move later buckets of the same probe run back into the hole, so
+        // that lookups can stop at the first empty bucket without needing
+        // tombstones.
+        for (size_t j = (i + 1) & mask; buckets[j].slot != NO_SLOT; j = (j + 1) & mask) {
+            size_t home = buckets[j].hash & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                buckets[i] = buckets[j];
+                i = j;
+            }
+        }
+        buckets[i].slot = NO_SLOT;
+    }
+
+    void rehash(size_t nBuckets)
+    {
+        std::vector<Bucket> old(nBuckets, Bucket{NO_SLOT, 0});
+        old.swap(buckets);
+        for (const Bucket& bucket : old) {
+            if (bucket.slot != NO_SLOT)
+                place(bucket.slot, bucket.hash);
+        }
+    }
+
+    uint32_t alloc_slot()
+    {
+        if (freeSlots.empty()) {
+            assert(live.size() + SLAB_SIZE < NO_SLOT);
+            slabs.emplace_back(new Slab);
+            uint32_t first = live.size();
+            live.resize(live.size() + SLAB_SIZE, false);
+            // Hand out the new slots in ascending order.
+            for (uint32_t slot = first + SLAB_SIZE; slot > first; slot--)
+                freeSlots.push_back(slot - 1);
+        }
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    template <bool Const>
+    class iterator_base
+    {
+        template <bool> friend class iterator_base;
+        friend class slabmap;
+
+        typedef typename std::conditional<Const, const slabmap, slabmap>::type map_type;
+        map_type* map;
+        uint32_t slot;
+
+        iterator_base(map_type* mapIn, uint32_t slotIn) : map(mapIn), slot(slotIn) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename slabmap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<Const, const value_type&, value_type&>::type reference;
+
+        iterator_base() : map(nullptr), slot(NO_SLOT) {}
+
+        //! An iterator converts to a const_iterator
+        template <bool C = Const, typename = typename std::enable_if<C>::type>
+        iterator_base(const iterator_base<false>& it) : map(it.map), slot(it.slot) {}
+
+        reference operator*() const { return *map->value_at(slot); }
+        pointer operator->() const { return map->value_at(slot); }
+
+        iterator_base& operator++()
+        {
+            slot = map->next_live(slot + 1);
+            return *this;
+        }
+        iterator_base operator++(int)
+        {
+            iterator_base ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        friend bool operator==(const iterator_base& a, const iterator_base& b) { return a.slot == b.slot; }
+        friend bool operator!=(const iterator_base& a, const iterator_base& b) { return a.slot != b.slot; }
+    };
+
+public:
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true> const_iterator;
+
+    slabmap() : count(0) {}
+    slabmap(const slabmap&) = delete;
+    slabmap& operator=(const slabmap&) = delete;
+    ~slabmap() { clear(); }
+
+    iterator begin() { return iterator(this, next_live(0)); }
+    const_iterator begin() const { return const_iterator(this, next_live(0)); }
+    iterator end() { return iterator(this, NO_SLOT); }
+    const_iterator end() const { return const_iterator(this, NO_SLOT); }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    iterator find(const K& key) { return iterator(this, find_slot(key, hasher(key))); }
+    const_iterator find(const K& key) const { return const_iterator(this, find_slot(key, hasher(key))); }
+
+    /** Insert an entry constructed from args, unless key is already present */
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+    {
+        size_t hash = hasher(key);
+        uint32_t slot = find_slot(key, hash);
+        if (slot != NO_SLOT)
+            return std::make_pair(iterator(this, slot), false);
+
+        // Keep the load factor at most 3/4.
+        if (4 * (count + 1) > 3 * buckets.size())
+            rehash(buckets.empty() ? 16 : 2 * buckets.size());
+        slot = alloc_slot();
+        try {
+            new (value_at(slot)) value_type(std::piecewise_construct,
+                std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            freeSlots.push_back(slot);
+            throw;
+        }
+        live[slot] = true;
+        place(slot, hash);
+        count++;
+        return std::make_pair(iterator(this, slot), true);
+    }
+
+    template <typename P>
+    std::pair<iterator, bool> insert(P&& value)
+    {
+        return try_emplace(value.first, std::forward<P>(value).second);
+    }
+
+    T& operator[](const K& key)
+    {
+        return try_emplace(key).first->second;
+    }
+
+    /** Erase an entry, returning an iterator to the one after it */
+    iterator erase(const_iterator it)
+    {
+        uint32_t slot = it.slot;
+        value_type* value = value_at(slot);
+        unplace(slot, hasher(value->first));
+        value->~value_type();
+        live[slot] = false;
+        freeSlots.push_back(slot);
+        count--;
+        return iterator(this, next_live(slot + 1));
+    }
+
+    /** Erase all entries and release all memory */
+    void clear()
+    {
+        for (uint32_t slot = 0; slot < live.size(); slot++) {
+            if (live[slot])
+                value_at(slot)->~value_type();
+        }
+        std::vector<std::unique_ptr<Slab>>().swap(slabs);
+        std::vector<bool>().swap(live);
+        std::vector<uint32_t>().swap(freeSlots);
+        std::vector<Bucket>().swap(buckets);
+        count = 0;
+    }
+
+    /** Exchange contents with another map, without touching the entries */
+    void swap(slabmap& other)
+    {
+        std::swap(hasher, other.hasher);
+        slabs.swap(other.slabs);
+        live.swap(other.live);
+        freeSlots.swap(other.freeSlots);
+        buckets.swap(other.buckets);
+        std::swap(count, other.count);
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::MallocUsage(sizeof(Slab)) * slabs.size() +
+               memusage::DynamicUsage(slabs) +
+               memusage::MallocUsage(live.capacity() / 8) +
+               memusage::DynamicUsage(freeSlots) +
+               memusage::DynamicUsage(buckets);
+    }
+};
+
+namespace memusage
+{
+
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const slabmap<X, Y, Z>& m)
+{
+    return m.DynamicMemoryUsage();
+}
+
+}
+
+#endif // BITCOIN_SLABMAP_H
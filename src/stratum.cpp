@@ -0,0 +1,657 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "stratum.h"
+
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "chainparamsbase.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "miner.h"
+#include "netbase.h"
+#include "pow.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "sync.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validationinterface.h"
+#include "version.h"
+
+#include <bitset>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+
+#include <boost/signals2/connection.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+#include <univalue.h>
+
+/**
+ * The work server speaks line-delimited JSON in the style of Stratum v1, with
+ * one difference: the coinbase cannot be modified by miners. Since NU5 the
+ * coinbase is a v5 transaction, whose txid is not a SHA256d of its
+ * serialization, and its scriptSig is committed to a second time through the
+ * auth data root in hashBlockCommitments, so a miner cannot rebuild the header
+ * from coinbase1 + extranonce + coinbase2. Instead each connection is handed a
+ * one-byte prefix of the 32-bit header nonce (extranonce1), and searches the
+ * remaining three bytes (extranonce2_size) and nTime.
+ *
+ * mining.notify params are
+ *   [job_id, header, coinbase, merkle_branch, ntime, clean_jobs]
+ * where header is the serialized block header with a zero nonce: nTime is the
+ * little-endian word at byte offset 68 and nNonce the one at byte offset 76.
+ * coinbase and merkle_branch are provided for pools that want to audit the
+ * payout; they are already committed to by the header.
+ *
+ * mining.submit params are [worker, job_id, ntime, nonce], with ntime and
+ * nonce as big-endian hex words.
+ */
+
+/** Longest request line accepted from a miner */
+static const size_t MAX_STRATUM_LINE = 16 * 1024;
+/** Disconnect miners that stop reading once this much output is queued */
+static const size_t MAX_STRATUM_OUTPUT = 1024 * 1024;
+/** Number of jobs kept around so that late shares are not reported as stale */
+static const size_t MAX_STRATUM_JOBS = 8;
+/** Minimum time between jobs that only pick up new mempool transactions */
+static const int64_t STRATUM_MEMPOOL_REFRESH_SECONDS = 5;
+/** How far into the future miners may roll nTime */
+static const int64_t STRATUM_MAX_NTIME_ROLL = 10 * 60;
+/** Shares remembered per job for duplicate detection; a new job is sent once a job has this many */
+static const size_t MAX_STRATUM_SHARES_PER_JOB = 16384;
+/** Shares a miner may have hashed per second on average, and in a burst */
+static const int64_t STRATUM_SHARES_PER_SECOND = 10;
+static const int64_t STRATUM_SHARE_BURST = 100;
+
+enum StratumError {
+    STRATUM_ERR_OTHER = 20,
+    STRATUM_ERR_STALE = 21,
+    STRATUM_ERR_DUPLICATE = 22,
+    STRATUM_ERR_LOW_DIFFICULTY = 23,
+    STRATUM_ERR_UNAUTHORIZED = 24,
+    STRATUM_ERR_NOT_SUBSCRIBED = 25,
+};
+
+struct StratumJob
+{
+    std::string id;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    /** (nTime, nNonce) pairs already submitted for this job */
+    std::set<std::pair<uint32_t, uint32_t>> setSubmitted;
+};
+
+struct StratumClient
+{
+    std::string strAddr;
+    uint8_t nNoncePrefix; //!< only valid once subscribed
+    bool fSubscribed;
+    bool fAuthorized;
+    //! Shares this miner may still have hashed before it is throttled, as of nShareTokensTime
+    int64_t nShareTokens;
+    int64_t nShareTokensTime;
+};
+
+//! libevent event loop
+static struct event_base* eventBase = NULL;
+//! Thread running the event loop; everything below is only touched from it
+static std::thread threadStratum;
+static std::vector<evconnlistener*> vListeners;
+static std::map<bufferevent*, StratumClient> mapClients;
+static std::deque<std::unique_ptr<StratumJob>> dequeJobs;
+static struct event* evNewTip = NULL;
+static struct event* evMempool = NULL;
+static struct event* evRefresh = NULL;
+static arith_uint256 shareTarget;
+static std::string strPassword;
+static uint64_t nJobCounter = 0;
+static unsigned int nExtraNonce = 0;
+//! Nonce prefixes held by subscribed clients, and where to look for the next free one
+static std::bitset<256> setNoncePrefixesInUse;
+static unsigned int nNextNoncePrefix = 0;
+static int64_t nLastJobTime = 0;
+
+static boost::signals2::connection connNotifyBlockTip;
+static boost::signals2::connection connSyncTransaction;
+
+static void SendLine(bufferevent* bev, const UniValue& msg)
+{
+    std::string strLine = msg.write() + "\n";
+    evbuffer_add(bufferevent_get_output(bev), strLine.data(), strLine.size());
+}
+
+static void SendReply(bufferevent* bev, const UniValue& id, const UniValue& result)
+{
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", result);
+    reply.pushKV("error", NullUniValue);
+    SendLine(bev, reply);
+}
+
+static void SendError(bufferevent* bev, const UniValue& id, int code, const std::string& message)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(code);
+    error.push_back(message);
+    error.push_back(NullUniValue);
+
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", NullUniValue);
+    reply.pushKV("error", error);
+    SendLine(bev, reply);
+}
+
+static void SendNotification(bufferevent* bev, const std::string& method, const UniValue& params)
+{
+    UniValue notification(UniValue::VOBJ);
+    notification.pushKV("id", NullUniValue);
+    notification.pushKV("method", method);
+    notification.pushKV("params", params);
+    SendLine(bev, notification);
+}
+
+static UniValue JobParams(const StratumJob& job, bool fClean)
+{
+    const CBlock& block = job.pblocktemplate->block;
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << block.GetBlockHeader();
+    CDataStream ssCoinbase(SER_NETWORK, PROTOCOL_VERSION);
+    ssCoinbase << block.vtx[0];
+
+    UniValue branch(UniValue::VARR);
+    for (const uint256& hash : block.GetMerkleBranch(0)) {
+        branch.push_back(hash.GetHex());
+    }
+
+    UniValue params(UniValue::VARR);
+    params.push_back(job.id);
+    params.push_back(HexStr(ssHeader.begin(), ssHeader.end()));
+    params.push_back(HexStr(ssCoinbase.begin(), ssCoinbase.end()));
+    params.push_back(branch);
+    params.push_back(strprintf("%08x", block.nTime));
+    params.push_back(fClean);
+    return params;
+}
+
+static void DisconnectClient(bufferevent* bev)
+{
+    auto it = mapClients.find(bev);
+    if (it != mapClients.end()) {
+        LogPrint("stratum", "stratum: %s disconnected\n", it->second.strAddr);
+        if (it->second.fSubscribed) {
+            setNoncePrefixesInUse.reset(it->second.nNoncePrefix);
+        }
+        mapClients.erase(it);
+    }
+    bufferevent_free(bev);
+}
+
+/** Build a new job from the current tip and mempool, and push it to all subscribed miners. */
+static void UpdateJob(bool fClean)
+{
+    const CChainParams& chainparams = Params();
+    if (IsInitialBlockDownload(chainparams.GetConsensus())) {
+        return;
+    }
+
+    MinerAddress minerAddress;
+    GetMainSignals().AddressForMining(minerAddress);
+    if (!std::visit(IsValidMinerAddress(), minerAddress)) {
+        LogPrintf("stratum: No miner address available (mining requires a wallet or -mineraddress)\n");
+        return;
+    }
+
+    std::unique_ptr<StratumJob> job(new StratumJob());
+    try {
+        job->pblocktemplate.reset(CreateNewBlock(chainparams, minerAddress));
+    } catch (const std::exception& e) {
+        LogPrintf("stratum: CreateNewBlock failed: %s\n", e.what());
+        return;
+    }
+    if (!job->pblocktemplate) {
+        return;
+    }
+    int nHeight;
+    {
+        LOCK(cs_main);
+        // If the tip moved while the template was built, the pending new-tip
+        // event will replace it.
+        if (job->pblocktemplate->block.hashPrevBlock != chainActive.Tip()->GetBlockHash()) {
+            return;
+        }
+        IncrementExtraNonce(job->pblocktemplate.get(), chainActive.Tip(), nExtraNonce, chainparams.GetConsensus());
+        nHeight = chainActive.Height() + 1;
+    }
+    job->id = strprintf("%x", ++nJobCounter);
+    nLastJobTime = GetTime();
+
+    // Jobs built on an older tip can never produce a block.
+    if (fClean) {
+        dequeJobs.clear();
+    }
+    dequeJobs.push_back(std::move(job));
+    while (dequeJobs.size() > MAX_STRATUM_JOBS) {
+        dequeJobs.pop_front();
+    }
+
+    const StratumJob& current = *dequeJobs.back();
+    LogPrint("stratum", "stratum: New job %s at height %d with %u transactions\n",
+        current.id, nHeight, current.pblocktemplate->block.vtx.size());
+
+    UniValue params = JobParams(current, fClean);
+    for (auto& client : mapClients) {
+        if (client.second.fSubscribed) {
+            SendNotification(client.first, "mining.notify", params);
+        }
+    }
+}
+
+static void NewTipEvent(evutil_socket_t, short, void*)
+{
+    if (evRefresh) {
+        evtimer_del(evRefresh);
+    }
+    UpdateJob(true);
+}
+
+static void RefreshEvent(evutil_socket_t, short, void*)
+{
+    UpdateJob(false);
+}
+
+static void MempoolEvent(evutil_socket_t, short, void*)
+{
+    if (evtimer_pending(evRefresh, NULL)) {
+        return;
+    }
+    int64_t nWait = nLastJobTime + STRATUM_MEMPOOL_REFRESH_SECONDS - GetTime();
+    if (nWait <= 0) {
+        UpdateJob(false);
+    } else {
+        struct timeval tv = {(time_t)nWait, 0};
+        evtimer_add(evRefresh, &tv);
+    }
+}
+
+static void NotifyBlockTip(bool fInitialDownload, const CBlockIndex* pindexNew)
+{
+    if (!fInitialDownload) {
+        event_active(evNewTip, 0, 0);
+    }
+}
+
+static void SyncTransaction(const CTransaction& tx, const CBlock* pblock, const int nHeight)
+{
+    // Only transactions entering the mempool change the template.
+    if (pblock == NULL) {
+        event_active(evMempool, 0, 0);
+    }
+}
+
+static void HandleSubmit(bufferevent* bev, StratumClient& client, const UniValue& id, const UniValue& params)
+{
+    if (!client.fSubscribed) {
+        SendError(bev, id, STRATUM_ERR_NOT_SUBSCRIBED, "Not subscribed");
+        return;
+    }
+    if (!client.fAuthorized) {
+        SendError(bev, id, STRATUM_ERR_UNAUTHORIZED, "Unauthorized worker");
+        return;
+    }
+    if (params.size() < 4 || !params[1].isStr() || !params[2].isStr() || !params[3].isStr()) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Expected [worker, job_id, ntime, nonce]");
+        return;
+    }
+    const std::string& strTime = params[2].get_str();
+    const std::string& strNonce = params[3].get_str();
+    if (strTime.size() != 8 || !IsHex(strTime) || strNonce.size() != 8 || !IsHex(strNonce)) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "ntime and nonce must be 8 hex digits");
+        return;
+    }
+    uint32_t nTime = ParseHexToUInt32(strTime);
+    uint32_t nNonce = ParseHexToUInt32(strNonce);
+    if ((nNonce >> 24) != client.nNoncePrefix) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Nonce outside the assigned range");
+        return;
+    }
+
+    StratumJob* job = NULL;
+    for (const auto& candidate : dequeJobs) {
+        if (candidate->id == params[1].get_str()) {
+            job = candidate.get();
+            break;
+        }
+    }
+    if (job == NULL) {
+        SendError(bev, id, STRATUM_ERR_STALE, "Job not found");
+        return;
+    }
+
+    const CBlock& block = job->pblocktemplate->block;
+    if (nTime < block.nTime || nTime > GetTime() + STRATUM_MAX_NTIME_ROLL) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "ntime out of range");
+        return;
+    }
+    if (job->setSubmitted.count(std::make_pair(nTime, nNonce))) {
+        SendError(bev, id, STRATUM_ERR_DUPLICATE, "Duplicate share");
+        return;
+    }
+    if (job->setSubmitted.size() >= MAX_STRATUM_SHARES_PER_JOB) {
+        SendError(bev, id, STRATUM_ERR_STALE, "Too many shares for this job");
+        if (job == dequeJobs.back().get()) {
+            UpdateJob(false);
+        }
+        return;
+    }
+
+    // Every share is hashed on the event loop thread, so a miner that
+    // submits faster than it could find shares is throttled.
+    int64_t nNow = GetTime();
+    client.nShareTokens = std::min(STRATUM_SHARE_BURST,
+        client.nShareTokens + (nNow - client.nShareTokensTime) * STRATUM_SHARES_PER_SECOND);
+    client.nShareTokensTime = nNow;
+    if (client.nShareTokens <= 0) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Too many shares, slow down");
+        return;
+    }
+    client.nShareTokens--;
+
+    // Only the header is needed to check the share; the transactions are
+    // copied only for the rare share that also meets the block target.
+    CBlockHeader header = block.GetBlockHeader();
+    header.nTime = nTime;
+    header.nNonce = nNonce;
+    uint256 hash = header.GetPoWHash();
+
+    arith_uint256 blockTarget;
+    blockTarget.SetCompact(header.nBits);
+    if (UintToArith256(hash) > std::max(shareTarget, blockTarget)) {
+        SendError(bev, id, STRATUM_ERR_LOW_DIFFICULTY, "Low difficulty share");
+        return;
+    }
+    // Only shares that were checked are remembered, so that the set cannot
+    // be filled with nonces that were never valid.
+    job->setSubmitted.insert(std::make_pair(nTime, nNonce));
+
+    if (UintToArith256(hash) <= blockTarget) {
+        CBlock solved(block);
+        solved.nTime = nTime;
+        solved.nNonce = nNonce;
+        CValidationState state;
+        if (!ProcessNewBlock(state, Params(), NULL, &solved, true, NULL)) {
+            LogPrintf("stratum: Block %s from %s was not accepted: %s\n", solved.GetHash().GetHex(), client.strAddr, state.GetRejectReason());
+            SendError(bev, id, STRATUM_ERR_OTHER, "Block rejected: " + state.GetRejectReason());
+            return;
+        }
+        LogPrintf("stratum: Block %s found by %s (%s)\n", solved.GetHash().GetHex(), client.strAddr, params[0].getValStr());
+    }
+    SendReply(bev, id, true);
+}
+
+static void HandleRequest(bufferevent* bev, StratumClient& client, const std::string& strLine)
+{
+    UniValue request;
+    if (!request.read(strLine) || !request.isObject()) {
+        SendError(bev, NullUniValue, STRATUM_ERR_OTHER, "Parse error");
+        return;
+    }
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+    if (!method.isStr() || !(params.isArray() || params.isNull())) {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Invalid request");
+        return;
+    }
+    const std::string& strMethod = method.get_str();
+
+    if (strMethod == "mining.subscribe") {
+        if (!client.fSubscribed) {
+            // Each subscribed client needs a prefix of its own, or two miners
+            // would search the same nonces. Start after the last one handed
+            // out, so that a prefix is not reused right after it is released.
+            if (setNoncePrefixesInUse.all()) {
+                SendError(bev, id, STRATUM_ERR_OTHER, "All nonce prefixes are in use");
+                return;
+            }
+            while (setNoncePrefixesInUse.test(nNextNoncePrefix % 256)) {
+                nNextNoncePrefix++;
+            }
+            client.nNoncePrefix = nNextNoncePrefix++ % 256;
+            setNoncePrefixesInUse.set(client.nNoncePrefix);
+            client.fSubscribed = true;
+            LogPrint("stratum", "stratum: %s subscribed, nonce prefix %02x\n", client.strAddr, client.nNoncePrefix);
+        }
+
+        UniValue subscription(UniValue::VARR);
+        subscription.push_back("mining.notify");
+        subscription.push_back(strprintf("%02x", client.nNoncePrefix));
+        UniValue subscriptions(UniValue::VARR);
+        subscriptions.push_back(subscription);
+
+        UniValue result(UniValue::VARR);
+        result.push_back(subscriptions);
+        result.push_back(strprintf("%02x", client.nNoncePrefix));
+        result.push_back(3);
+        SendReply(bev, id, result);
+
+        UniValue target(UniValue::VARR);
+        target.push_back(ArithToUint256(shareTarget).GetHex());
+        SendNotification(bev, "mining.set_target", target);
+        if (!dequeJobs.empty()) {
+            SendNotification(bev, "mining.notify", JobParams(*dequeJobs.back(), true));
+        }
+    } else if (strMethod == "mining.authorize") {
+        // The node pays its own miner address, so workers are only names;
+        // the password is only checked if -stratumpassword is set.
+        if (!strPassword.empty()) {
+            if (params.size() < 2 || !params[1].isStr() ||
+                !TimingResistantEqual(params[1].get_str(), strPassword)) {
+                LogPrint("stratum", "stratum: %s failed to authorize\n", client.strAddr);
+                SendError(bev, id, STRATUM_ERR_UNAUTHORIZED, "Unauthorized worker");
+                return;
+            }
+        }
+        client.fAuthorized = true;
+        SendReply(bev, id, true);
+    } else if (strMethod == "mining.extranonce.subscribe") {
+        SendReply(bev, id, false);
+    } else if (strMethod == "mining.submit") {
+        HandleSubmit(bev, client, id, params);
+    } else {
+        SendError(bev, id, STRATUM_ERR_OTHER, "Method not found");
+    }
+}
+
+static void ReadCallback(bufferevent* bev, void*)
+{
+    auto it = mapClients.find(bev);
+    assert(it != mapClients.end());
+    evbuffer* input = bufferevent_get_input(bev);
+
+    char* line;
+    size_t len;
+    while ((line = evbuffer_readln(input, &len, EVBUFFER_EOL_CRLF)) != NULL) {
+        std::string strLine(line, len);
+        free(line);
+        if (len > MAX_STRATUM_LINE) {
+            LogPrint("stratum", "stratum: %s sent an oversized request\n", it->second.strAddr);
+            DisconnectClient(bev);
+            return;
+        }
+        if (!strLine.empty()) {
+            HandleRequest(bev, it->second, strLine);
+        }
+    }
+    if (evbuffer_get_length(input) > MAX_STRATUM_LINE ||
+        evbuffer_get_length(bufferevent_get_output(bev)) > MAX_STRATUM_OUTPUT) {
+        LogPrint("stratum", "stratum: %s exceeded the buffer limits\n", it->second.strAddr);
+        DisconnectClient(bev);
+    }
+}
+
+static void EventCallback(bufferevent* bev, short what, void*)
+{
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+        DisconnectClient(bev);
+    }
+}
+
+static void AcceptCallback(evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void*)
+{
+    CService service;
+    service.SetSockAddr(addr);
+
+    bufferevent* bev = bufferevent_socket_new(eventBase, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    StratumClient& client = mapClients[bev];
+    client.strAddr = service.ToString();
+    client.nNoncePrefix = 0;
+    client.fSubscribed = false;
+    client.fAuthorized = false;
+    client.nShareTokens = STRATUM_SHARE_BURST;
+    client.nShareTokensTime = GetTime();
+    LogPrint("stratum", "stratum: %s connected\n", client.strAddr);
+
+    bufferevent_setcb(bev, ReadCallback, NULL, EventCallback, NULL);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+}
+
+static bool StratumBindAddresses()
+{
+    int defaultPort = GetArg("-stratumport",
+        Params().NetworkIDString() == CBaseChainParams::MAIN ? DEFAULT_STRATUM_PORT : DEFAULT_TESTNET_STRATUM_PORT);
+    std::vector<std::pair<std::string, int>> endpoints;
+
+    if (mapArgs.count("-stratumbind")) {
+        for (const std::string& strBind : mapMultiArgs["-stratumbind"]) {
+            int port = defaultPort;
+            std::string host;
+            SplitHostPort(strBind, port, host);
+            endpoints.push_back(std::make_pair(host, port));
+        }
+    } else { // Default to loopback, pool software usually runs on the same host
+        endpoints.push_back(std::make_pair("::1", defaultPort));
+        endpoints.push_back(std::make_pair("127.0.0.1", defaultPort));
+    }
+
+    for (const auto& endpoint : endpoints) {
+        CService addrBind;
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!Lookup(endpoint.first.c_str(), addrBind, endpoint.second, false) ||
+            !addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len)) {
+            LogPrintf("stratum: Invalid bind address %s\n", endpoint.first);
+            continue;
+        }
+        evconnlistener* listener = evconnlistener_new_bind(eventBase, AcceptCallback, NULL,
+            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&sockaddr, len);
+        if (listener) {
+            LogPrintf("stratum: Listening on %s\n", addrBind.ToString());
+            vListeners.push_back(listener);
+        } else {
+            LogPrintf("stratum: Binding on %s failed\n", addrBind.ToString());
+        }
+    }
+    return !vListeners.empty();
+}
+
+static void ThreadStratum()
+{
+    RenameThread("koto-stratum");
+    LogPrint("stratum", "stratum: Entering event loop\n");
+    // Pick up the current tip right away instead of waiting for the next block.
+    event_active(evNewTip, 0, 0);
+    event_base_dispatch(eventBase);
+    LogPrint("stratum", "stratum: Exited event loop\n");
+}
+
+bool StartStratumServer()
+{
+    assert(!eventBase);
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    eventBase = event_base_new();
+    if (!eventBase) {
+        LogPrintf("stratum: Unable to create event_base\n");
+        return false;
+    }
+
+    int64_t nDifficulty = std::max<int64_t>(1, GetArg("-stratumdifficulty", DEFAULT_STRATUM_DIFFICULTY));
+    shareTarget = UintToArith256(Params().GetConsensus().powLimit) / arith_uint256(nDifficulty);
+    strPassword = GetArg("-stratumpassword", "");
+
+    if (!StratumBindAddresses()) {
+        LogPrintf("stratum: Unable to bind any endpoint for the Stratum server\n");
+        event_base_free(eventBase);
+        eventBase = NULL;
+        return false;
+    }
+
+    evNewTip = event_new(eventBase, -1, 0, NewTipEvent, NULL);
+    evMempool = event_new(eventBase, -1, 0, MempoolEvent, NULL);
+    evRefresh = evtimer_new(eventBase, RefreshEvent, NULL);
+    connNotifyBlockTip = uiInterface.NotifyBlockTip.connect(NotifyBlockTip);
+    connSyncTransaction = GetMainSignals().SyncTransaction.connect(SyncTransaction);
+
+    threadStratum = std::thread(&TraceThread<void (*)()>, "stratum", &ThreadStratum);
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (eventBase) {
+        LogPrint("stratum", "stratum: Interrupting event loop\n");
+        event_base_loopbreak(eventBase);
+    }
+}
+
+void StopStratumServer()
+{
+    if (!eventBase) {
+        return;
+    }
+    connNotifyBlockTip.disconnect();
+    connSyncTransaction.disconnect();
+    if (threadStratum.joinable()) {
+        threadStratum.join();
+    }
+
+    for (auto& client : mapClients) {
+        bufferevent_free(client.first);
+    }
+    mapClients.clear();
+    setNoncePrefixesInUse.reset();
+    for (evconnlistener* listener : vListeners) {
+        evconnlistener_free(listener);
+    }
+    vListeners.clear();
+    dequeJobs.clear();
+
+    event_free(evNewTip);
+    event_free(evMempool);
+    event_free(evRefresh);
+    evNewTip = evMempool = evRefresh = NULL;
+    event_base_free(eventBase);
+    eventBase = NULL;
+}
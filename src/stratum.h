@@ -0,0 +1,26 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+/**
+ * Stratum work server for pool operators and external miners.
+ */
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+#include <stdint.h>
+
+static const bool DEFAULT_STRATUM_ENABLE = false;
+/** Share difficulty, as a divisor of the proof-of-work limit */
+static const int64_t DEFAULT_STRATUM_DIFFICULTY = 1;
+static const unsigned int DEFAULT_STRATUM_PORT = 8434;
+static const unsigned int DEFAULT_TESTNET_STRATUM_PORT = 18434;
+
+/** Start the Stratum work server. Returns false if no address could be bound. */
+bool StartStratumServer();
+/** Interrupt the Stratum work server's event loop */
+void InterruptStratumServer();
+/** Stop the Stratum work server and close all miner connections */
+void StopStratumServer();
+
+#endif // BITCOIN_STRATUM_H
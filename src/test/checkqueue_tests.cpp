@@ -124,6 +124,22 @@ struct FrozenCleanupCheck {
     void swap(FrozenCleanupCheck& x){std::swap(should_freeze, x.should_freeze);};
 };
 
+struct SlowCheck {
+    static std::atomic<size_t> n_calls;
+    bool slow {false};
+    bool operator()()
+    {
+        if (slow) {
+            // Only finishes once every other check has been done
+            while (n_calls < 99)
+                MilliSleep(1);
+        }
+        ++n_calls;
+        return true;
+    }
+    void swap(SlowCheck& x) { std::swap(slow, x.slow); };
+};
+
 // Static Allocations
 std::mutex FrozenCleanupCheck::m{};
 std::atomic<uint64_t> FrozenCleanupCheck::nFrozen{0};
@@ -132,6 +148,7 @@ std::mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
+std::atomic<size_t> SlowCheck::n_calls{0};
 
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
@@ -140,16 +157,17 @@ typedef CCheckQueue<FailingCheck> Failing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
+typedef CCheckQueue<SlowCheck> Slow_Queue;
 
 
 /** This test case checks that the CCheckQueue works properly
  * with each specified size_t Checks pushed.
  */
-void Correct_Queue_range(std::vector<size_t> range)
+void Correct_Queue_range(std::vector<size_t> range, int nThreads = nScriptCheckThreads)
 {
     auto small_queue = std::unique_ptr<Correct_Queue>(new Correct_Queue {QUEUE_BATCH_SIZE});
     boost::thread_group tg;
-    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+    for (auto x = 0; x < nThreads; ++x) {
        tg.create_thread([&]{small_queue->Thread();});
     }
     // Make vChecks here to save on malloc (this test can be slow...)
@@ -207,6 +225,38 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
         range.push_back(i);
     Correct_Queue_range(range);
 }
+/** Test that checks are correct with no workers, where the master does
+ * everything, and with more workers than checks in most batches
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Workers)
+{
+    std::vector<size_t> range;
+    for (size_t i = 0; i < 100000; i += std::max((size_t)1, (size_t)GetRand(10000)))
+        range.push_back(i);
+    Correct_Queue_range(range, 0);
+    Correct_Queue_range(range, 64);
+}
+
+/** Test that checks queued behind a slow one are stolen by other workers */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Steals)
+{
+    SlowCheck::n_calls = 0;
+    auto queue = std::unique_ptr<Slow_Queue>(new Slow_Queue {1});
+    boost::thread_group tg;
+    for (auto x = 0; x < 2; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+    {
+        CCheckQueueControl<SlowCheck> control(queue.get());
+        std::vector<SlowCheck> vChecks(100);
+        vChecks[99].slow = true;
+        control.Add(vChecks);
+        BOOST_REQUIRE(control.Wait());
+    }
+    BOOST_REQUIRE_EQUAL(SlowCheck::n_calls, 100);
+    tg.interrupt_all();
+    tg.join_all();
+}
 
 
 /** Test that failing checks are caught */
@@ -793,6 +793,55 @@ template<typename Tree> void anchorsTestImpl(ShieldedType type)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(coins_db_background_flush, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    uint256 txid = GetRandHash();
+    uint256 hashBlock = GetRandHash();
+    TxWithNullifiers txWithNullifiers;
+
+    {
+        CCoinsViewCacheTest cache(&db);
+        {
+            CCoinsModifier coins = cache.ModifyCoins(txid);
+            coins->vout.resize(1);
+            coins->vout[0].nValue = 42;
+        }
+        cache.SetNullifiers(txWithNullifiers.tx, true);
+        cache.SetBestBlock(hashBlock);
+        db.FlushInBackground();
+        BOOST_CHECK(cache.Flush());
+
+        // Whether or not the background write has finished, lookups see
+        // the flushed state.
+        CCoinsViewCacheTest cache2(&db);
+        CCoins coins;
+        BOOST_CHECK(cache2.GetCoins(txid, coins));
+        BOOST_CHECK_EQUAL(coins.vout[0].nValue, 42);
+        BOOST_CHECK(cache2.GetBestBlock() == hashBlock);
+        checkNullifierCache(cache2, txWithNullifiers, true);
+    }
+
+    BOOST_CHECK(db.WaitForFlush());
+    BOOST_CHECK(!db.BackgroundFlushFailed());
+    {
+        CCoinsViewCacheTest cache(&db);
+        BOOST_CHECK(cache.HaveCoins(txid));
+        BOOST_CHECK(cache.GetBestBlock() == hashBlock);
+        checkNullifierCache(cache, txWithNullifiers, true);
+
+        // Spending the coins in a background flush hides them at once.
+        cache.ModifyCoins(txid)->Clear();
+        db.FlushInBackground();
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(!db.HaveCoins(txid));
+        CCoins coins;
+        BOOST_CHECK(!db.GetCoins(txid, coins));
+    }
+    BOOST_CHECK(db.WaitForFlush());
+    BOOST_CHECK(!db.HaveCoins(txid));
+}
+
 BOOST_AUTO_TEST_CASE(anchors_test)
 {
     BOOST_TEST_CONTEXT("Sprout") {
@@ -0,0 +1,141 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "cuckoocache.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+// All tests use deterministic insecure_rand seeds; the hit rate bounds are
+// regression checks and may need adjusting if the eviction policy changes.
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+/** Hash eight 32-bit slices out of the (random) entry, as the signature cache does */
+struct SliceHasher {
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, SliceHasher> Cache;
+
+static void insecure_GetRandHash(uint256& t)
+{
+    uint32_t* ptr = (uint32_t*)t.begin();
+    for (uint8_t j = 0; j < 8; ++j)
+        *(ptr++) = insecure_rand();
+}
+
+/** Test that no values not inserted into the cache are read out of it.
+ *
+ * There are no repeats in the first 200000 insecure_GetRandHash calls
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
+{
+    seed_insecure_rand(true);
+    Cache cc{};
+    size_t megabytes = 4;
+    cc.setup_bytes(megabytes << 20);
+    uint256 v;
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        cc.insert(v);
+    }
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        BOOST_CHECK(!cc.contains(v, false));
+    }
+}
+
+/** Test that setup_bytes fixes the table size, however many entries are
+ * inserted: the cache has to evict rather than grow.
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_fixed_size)
+{
+    seed_insecure_rand(true);
+    Cache cc{};
+    uint32_t n = cc.setup_bytes(1 << 20);
+    BOOST_CHECK_EQUAL(n, (1 << 20) / sizeof(uint256));
+
+    std::vector<uint256> hashes(4 * n);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    size_t nFound = 0;
+    for (const uint256& h : hashes)
+        nFound += cc.contains(h, false);
+    BOOST_CHECK(nFound <= n);
+    // The most recent entries are still there.
+    size_t nRecent = 0;
+    for (size_t i = hashes.size() - n / 4; i < hashes.size(); ++i)
+        nRecent += cc.contains(hashes[i], false);
+    BOOST_CHECK(nRecent >= n / 4 * 95 / 100);
+}
+
+/** Test that a cache filled to its capacity keeps most of it */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_hit_rate_ok)
+{
+    seed_insecure_rand(true);
+    Cache cc{};
+    uint32_t n = cc.setup_bytes(1 << 20);
+
+    std::vector<uint256> hashes(n);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    size_t nFound = 0;
+    for (const uint256& h : hashes)
+        nFound += cc.contains(h, false);
+    BOOST_CHECK(nFound >= n * 90 / 100);
+}
+
+/** Test that entries looked up with erase set are overwritten by later
+ * inserts before entries that are still wanted, as when a block is connected.
+ */
+BOOST_AUTO_TEST_CASE(test_cuckoocache_erase_ok)
+{
+    seed_insecure_rand(true);
+    Cache cc{};
+    uint32_t n = cc.setup_bytes(1 << 20);
+
+    // Half fill the cache, then erase the first half of what went in.
+    std::vector<uint256> hashes(n / 2);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    for (uint32_t i = 0; i < n / 4; ++i)
+        BOOST_CHECK(cc.contains(hashes[i], true));
+    // Erased entries are still found until they are overwritten.
+    for (uint32_t i = 0; i < n / 4; ++i)
+        BOOST_CHECK(cc.contains(hashes[i], false));
+
+    std::vector<uint256> hashesNew(n / 2);
+    for (uint256& h : hashesNew) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    size_t nErased = 0, nKept = 0, nNew = 0;
+    for (uint32_t i = 0; i < n / 4; ++i)
+        nErased += cc.contains(hashes[i], false);
+    for (uint32_t i = n / 4; i < n / 2; ++i)
+        nKept += cc.contains(hashes[i], false);
+    for (const uint256& h : hashesNew)
+        nNew += cc.contains(h, false);
+    BOOST_CHECK(nErased < nKept * 2 / 3);
+    BOOST_CHECK(nKept >= (n / 4) * 80 / 100);
+    BOOST_CHECK(nNew >= hashesNew.size() * 95 / 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
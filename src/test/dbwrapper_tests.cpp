@@ -43,6 +43,33 @@ BOOST_AUTO_TEST_CASE(dbwrapper)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profile)
+{
+    CDBProfile profile;
+    profile.nWriteBufferPercent = 10;
+    profile.nMaxFileSize = 1 << 20;
+    profile.nMaxOpenFiles = 100;
+    profile.fCompression = true;
+
+    // On disk, so that the writes go through table files of the profile's
+    // size rather than only the write buffer.
+    path ph = temp_directory_path() / unique_path();
+    {
+        CDBWrapper dbw(ph, (1 << 20), false, false, profile);
+        for (int i = 0; i < 4000; i++)
+            BOOST_CHECK(dbw.Write(std::make_pair('k', i), std::vector<unsigned char>(1000, i)));
+    }
+    {
+        CDBWrapper dbw(ph, (1 << 20), false, false, profile);
+        for (int i = 0; i < 4000; i++) {
+            std::vector<unsigned char> res;
+            BOOST_CHECK(dbw.Read(std::make_pair('k', i), res));
+            BOOST_CHECK(res == std::vector<unsigned char>(1000, i));
+        }
+    }
+    remove_all(ph);
+}
+
 // Test batch operations
 BOOST_AUTO_TEST_CASE(dbwrapper_batch)
 {
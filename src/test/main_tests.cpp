@@ -3,6 +3,7 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "chainparams.h"
+#include "consensus/validation.h"
 #include "main.h"
 
 #include "test/test_bitcoin.h"
@@ -106,6 +107,95 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, 2099999981520000LL);
 }
 
+BOOST_AUTO_TEST_CASE(read_raw_block_from_disk)
+{
+    const CChainParams& chainparams = Params();
+    CBlockIndex* pindexGenesis;
+    {
+        LOCK(cs_main);
+        pindexGenesis = chainActive.Genesis();
+    }
+    BOOST_REQUIRE(pindexGenesis != NULL);
+
+    // The raw bytes are the block as it would be serialized for the network.
+    std::vector<unsigned char> vchBlock;
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pindexGenesis, chainparams.MessageStart()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << chainparams.GenesisBlock();
+    BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == vchBlock);
+
+    // A block index entry that doesn't match what is on disk is rejected.
+    CBlockIndex indexWrong = *pindexGenesis;
+    uint256 hashWrong = GetRandHash();
+    indexWrong.phashBlock = &hashWrong;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, &indexWrong, chainparams.MessageStart()));
+
+    // So is a block file with the wrong network magic.
+    CMessageHeader::MessageStartChars wrongStart = {0, 0, 0, 0};
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pindexGenesis, wrongStart));
+}
+
+BOOST_AUTO_TEST_CASE(connect_block_skips_checked_context_free)
+{
+    LOCK(cs_main);
+    const CChainParams& chainparams = Params();
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    BOOST_REQUIRE(pindexPrev != NULL);
+
+    // A block with two coinbases fails CheckBlock(), but nothing after it
+    // in ConnectBlock() looks for that. The same block with only its first
+    // coinbase passes CheckBlock(), so it shows what ConnectBlock() says
+    // about the rest of the block.
+    auto makeBlock = [&](int nCoinbases) {
+        CBlock block;
+        block.nVersion = CBlockHeader::CURRENT_VERSION;
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nTime = pindexPrev->nTime + 1;
+        for (int i = 0; i < nCoinbases; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            mtx.vin[0].prevout.SetNull();
+            mtx.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << i;
+            mtx.vout.resize(1);
+            mtx.vout[0].nValue = 0;
+            block.vtx.push_back(CTransaction(mtx));
+        }
+        block.hashMerkleRoot = block.BuildMerkleTree();
+        return block;
+    };
+    auto connect = [&](const CBlock& block, bool fCheckedContextFree, std::string& strReason) {
+        uint256 hashBlock = block.GetHash();
+        CBlockIndex index(block);
+        index.phashBlock = &hashBlock;
+        index.pprev = pindexPrev;
+        index.nHeight = pindexPrev->nHeight + 1;
+
+        CValidationState state;
+        CCoinsViewCache view(pcoinsTip);
+        bool fValid = ConnectBlock(block, state, &index, view, chainparams, true, true, fCheckedContextFree);
+        strReason = state.GetRejectReason();
+        return fValid;
+    };
+
+    CBlock blockBad = makeBlock(2);
+    CBlock blockGood = makeBlock(1);
+    std::string strReason, strReasonGood, strReasonGoodChecked, strReasonChecked;
+
+    BOOST_CHECK(!connect(blockBad, false, strReason));
+    BOOST_CHECK_EQUAL(strReason, "bad-cb-multiple");
+
+    // Skipping CheckBlock() changes nothing for a block that passes it...
+    bool fGood = connect(blockGood, false, strReasonGood);
+    BOOST_CHECK_EQUAL(connect(blockGood, true, strReasonGoodChecked), fGood);
+    BOOST_CHECK_EQUAL(strReasonGoodChecked, strReasonGood);
+
+    // ...and when a prefetch thread has already run CheckBlock() on the
+    // block, ConnectBlock() does not run it again: the block with two
+    // coinbases gets exactly the outcome of the one that passes.
+    BOOST_CHECK_EQUAL(connect(blockBad, true, strReasonChecked), fGood);
+    BOOST_CHECK_EQUAL(strReasonChecked, strReasonGood);
+}
+
 bool ReturnFalse() { return false; }
 bool ReturnTrue() { return true; }
 
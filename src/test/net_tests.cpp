@@ -142,4 +142,30 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+BOOST_AUTO_TEST_CASE(shared_message)
+{
+    CAddress addr1(CService("10.0.0.1", 8333));
+    CAddress addr2(CService("10.0.0.2", 8333));
+    CNode node1(INVALID_SOCKET, addr1, "", true);
+    CNode node2(INVALID_SOCKET, addr2, "", true);
+
+    std::vector<unsigned char> vch(1000, 0x42);
+    node1.PushMessage("block", vch);
+
+    // A shared message is encoded exactly as PushMessage would encode it.
+    CSharedNetMessage msg = CNode::MakeSharedMessage("block", vch);
+    node1.PushSharedMessage("block", msg);
+    node2.PushSharedMessage("block", msg);
+
+    // With no socket nothing is sent, so both stay queued.
+    BOOST_CHECK_EQUAL(node1.vSendMsg.size(), 2);
+    BOOST_CHECK_EQUAL(node2.vSendMsg.size(), 1);
+    BOOST_CHECK(*node1.vSendMsg[0] == *msg);
+    BOOST_CHECK_EQUAL(node1.nSendSize, 2 * msg->size());
+
+    // Both peers queue the same buffer rather than a copy of it.
+    BOOST_CHECK(node1.vSendMsg[1] == msg);
+    BOOST_CHECK(node2.vSendMsg[0] == msg);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,115 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "coins.h"
+#include "slabmap.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(slabmap_tests, BasicTestingSetup)
+
+typedef slabmap<uint256, int, SaltedTxidHasher> Map;
+
+static uint256 Key(uint32_t n)
+{
+    uint256 key;
+    *(uint32_t*)key.begin() = n;
+    return key;
+}
+
+static void CheckEqual(const Map& map, const std::map<uint256, int>& ref)
+{
+    BOOST_CHECK_EQUAL(map.size(), ref.size());
+    size_t count = 0;
+    for (Map::const_iterator it = map.begin(); it != map.end(); ++it) {
+        auto itRef = ref.find(it->first);
+        BOOST_REQUIRE(itRef != ref.end());
+        BOOST_CHECK_EQUAL(it->second, itRef->second);
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, ref.size());
+}
+
+BOOST_AUTO_TEST_CASE(slabmap_random_ops)
+{
+    seed_insecure_rand(true);
+    Map map;
+    std::map<uint256, int> ref;
+
+    // Keys are drawn from a small range, so that inserts, lookups and
+    // erases of present and absent keys are all common, and the map grows
+    // through several rehashes.
+    for (int i = 0; i < 100000; i++) {
+        uint256 key = Key(insecure_rand() % 5000);
+        switch (insecure_rand() % 4) {
+        case 0: {
+            auto ret = map.insert(std::make_pair(key, i));
+            auto retRef = ref.insert(std::make_pair(key, i));
+            BOOST_CHECK_EQUAL(ret.second, retRef.second);
+            BOOST_CHECK_EQUAL(ret.first->second, retRef.first->second);
+            break;
+        }
+        case 1: {
+            Map::iterator it = map.find(key);
+            BOOST_CHECK_EQUAL(it == map.end(), ref.count(key) == 0);
+            if (it != map.end()) {
+                map.erase(it);
+                ref.erase(key);
+            }
+            break;
+        }
+        case 2:
+            map[key] += i;
+            ref[key] += i;
+            break;
+        case 3: {
+            Map::const_iterator it = map.find(key);
+            BOOST_CHECK_EQUAL(it == map.end(), ref.count(key) == 0);
+            if (it != map.end())
+                BOOST_CHECK_EQUAL(it->second, ref[key]);
+            break;
+        }
+        }
+    }
+    CheckEqual(map, ref);
+
+    // Erasing while iterating, as BatchWrite does, visits every entry once.
+    size_t count = 0;
+    for (Map::iterator it = map.begin(); it != map.end(); count++)
+        it = map.erase(it);
+    BOOST_CHECK_EQUAL(count, ref.size());
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(slabmap_stable_entries)
+{
+    Map map;
+    int* p = &map[Key(0)];
+    *p = 42;
+
+    // Entries never move, however much the map grows.
+    for (uint32_t n = 1; n < 10000; n++)
+        map[Key(n)] = n;
+    BOOST_CHECK_EQUAL(p, &map.find(Key(0))->second);
+    BOOST_CHECK_EQUAL(*p, 42);
+
+    // Erased slots are reused.
+    map.erase(map.find(Key(5000)));
+    size_t usage = map.DynamicMemoryUsage();
+    map[Key(10000)] = 10000;
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), usage);
+
+    // clear() releases everything.
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), 0);
+    BOOST_CHECK(map.find(Key(0)) == map.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,246 @@
+// Copyright (c) 2026 The Koto developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "addressindex.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txdb_tests, TestingSetup)
+
+static const unsigned int ADDRESS_TYPE = 1;
+
+static uint160 AddressHash(unsigned char n)
+{
+    uint160 hash;
+    *hash.begin() = n;
+    return hash;
+}
+
+static uint256 TxHash(int n)
+{
+    uint256 hash;
+    *(int*)hash.begin() = n;
+    return hash;
+}
+
+static CAddressIndexDbEntry Entry(unsigned char nAddress, int nHeight, int nTx, size_t nIndex, bool fSpending, CAmount nValue)
+{
+    return std::make_pair(
+        CAddressIndexKey(ADDRESS_TYPE, AddressHash(nAddress), nHeight, nTx, TxHash(nHeight * 100 + nTx), nIndex, fSpending),
+        nValue);
+}
+
+static std::vector<CAddressIndexDbEntry> Scan(CBlockTreeDB& db, const CAddressIndexKey& keyStart, int end, size_t nLimit = SIZE_MAX)
+{
+    std::vector<CAddressIndexDbEntry> entries;
+    BOOST_CHECK(db.ScanAddressIndex(keyStart, end, [&](const CAddressIndexKey& key, CAmount nValue) {
+        if (entries.size() == nLimit)
+            return false;
+        entries.push_back(std::make_pair(key, nValue));
+        return true;
+    }));
+    return entries;
+}
+
+static bool SameKey(const CAddressIndexKey& a, const CAddressIndexKey& b)
+{
+    CDataStream ssA(SER_DISK, CLIENT_VERSION), ssB(SER_DISK, CLIENT_VERSION);
+    ssA << a;
+    ssB << b;
+    return ssA.str() == ssB.str();
+}
+
+static void CheckSameEntries(const std::vector<CAddressIndexDbEntry>& a, const std::vector<CAddressIndexDbEntry>& b)
+{
+    BOOST_REQUIRE_EQUAL(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        BOOST_CHECK(SameKey(a[i].first, b[i].first));
+        BOOST_CHECK_EQUAL(a[i].second, b[i].second);
+    }
+}
+
+// Two addresses with entries at the same heights, written out of key order.
+static std::vector<CAddressIndexDbEntry> TwoAddresses()
+{
+    std::vector<CAddressIndexDbEntry> entries;
+    for (int nHeight = 10; nHeight > 0; nHeight--) {
+        entries.push_back(Entry(2, nHeight, 0, 0, false, 100 * nHeight));
+        entries.push_back(Entry(1, nHeight, 1, 0, false, nHeight));
+        entries.push_back(Entry(1, nHeight, 1, 1, true, -1));
+    }
+    return entries;
+}
+
+BOOST_AUTO_TEST_CASE(address_index_scan)
+{
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_REQUIRE(db.WriteAddressIndex(TwoAddresses()));
+
+    // A scan only returns the entries of the address it starts at, by height.
+    CAddressIndexKey keyStart(ADDRESS_TYPE, AddressHash(1), 0, 0, uint256(), 0, false);
+    std::vector<CAddressIndexDbEntry> entries = Scan(db, keyStart, 0);
+    BOOST_REQUIRE_EQUAL(entries.size(), 20U);
+    for (size_t i = 0; i < entries.size(); i++) {
+        BOOST_CHECK(entries[i].first.hashBytes == AddressHash(1));
+        BOOST_CHECK_EQUAL(entries[i].first.blockHeight, 1 + (int)i / 2);
+        BOOST_CHECK_EQUAL(entries[i].first.spending, i % 2 == 1);
+    }
+
+    // Seeking to a height skips the lower ones, and the end height is inclusive.
+    keyStart.blockHeight = 4;
+    entries = Scan(db, keyStart, 6);
+    BOOST_REQUIRE_EQUAL(entries.size(), 6U);
+    BOOST_CHECK_EQUAL(entries.front().first.blockHeight, 4);
+    BOOST_CHECK_EQUAL(entries.back().first.blockHeight, 6);
+
+    // Resuming at a key that is in the index returns that key first.
+    entries = Scan(db, Entry(1, 7, 1, 1, true, 0).first, 0);
+    BOOST_REQUIRE_EQUAL(entries.size(), 7U);
+    BOOST_CHECK(SameKey(entries.front().first, Entry(1, 7, 1, 1, true, 0).first));
+
+    // An address without entries has nothing to scan, even though the next
+    // address's entries follow its position in the index.
+    entries = Scan(db, CAddressIndexKey(ADDRESS_TYPE, AddressHash(0), 0, 0, uint256(), 0, false), 0);
+    BOOST_CHECK(entries.empty());
+}
+
+BOOST_AUTO_TEST_CASE(address_index_after_cursor)
+{
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_REQUIRE(db.WriteAddressIndex(TwoAddresses()));
+
+    CAddressIndexKey keyStart(ADDRESS_TYPE, AddressHash(1), 0, 0, uint256(), 0, false);
+    std::vector<CAddressIndexDbEntry> all = Scan(db, keyStart, 0);
+
+    // Page through the index the way getaddressdeltas does: each page
+    // resumes at the key its cursor names, without repeating it.
+    for (size_t nLimit : {1, 3, 7, 20, 21}) {
+        std::vector<CAddressIndexDbEntry> paged;
+        std::string strAfter;
+        while (true) {
+            CAddressIndexKey keyPage = keyStart;
+            if (!strAfter.empty()) {
+                CDataStream ss(ParseHex(strAfter), SER_DISK, CLIENT_VERSION);
+                ss >> keyPage;
+                BOOST_CHECK(ss.empty());
+            }
+            // One more than the limit shows whether there is another page.
+            std::vector<CAddressIndexDbEntry> page = Scan(db, keyPage, 0, nLimit + (strAfter.empty() ? 1 : 2));
+            if (!strAfter.empty()) {
+                BOOST_REQUIRE(!page.empty());
+                BOOST_CHECK(SameKey(page.front().first, keyPage));
+                page.erase(page.begin());
+            }
+            bool fMore = page.size() > nLimit;
+            page.resize(std::min(page.size(), nLimit));
+            paged.insert(paged.end(), page.begin(), page.end());
+            if (!fMore)
+                break;
+
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << page.back().first;
+            strAfter = HexStr(ss.begin(), ss.end());
+        }
+        CheckSameEntries(paged, all);
+    }
+}
+
+static CAddressBalanceValue Balance(CBlockTreeDB& db, unsigned char nAddress)
+{
+    CAddressBalanceValue value;
+    BOOST_CHECK(db.ReadAddressBalance(AddressHash(nAddress), ADDRESS_TYPE, value));
+    return value;
+}
+
+static void CheckBalance(const CAddressBalanceValue& value, CAmount balance, CAmount received, int64_t txCount)
+{
+    BOOST_CHECK_EQUAL(value.balance, balance);
+    BOOST_CHECK_EQUAL(value.received, received);
+    BOOST_CHECK_EQUAL(value.txCount, txCount);
+}
+
+// Address 1 receives 50 and 20 in two transactions of one block, then
+// spends the 50 in a transaction that also pays it 30 change; address 2
+// receives 15 in the first transaction.
+static std::vector<CAddressIndexDbEntry> Block1()
+{
+    return {
+        Entry(1, 1, 0, 0, false, 50),
+        Entry(2, 1, 0, 1, false, 15),
+        Entry(1, 1, 1, 0, false, 20),
+    };
+}
+
+static std::vector<CAddressIndexDbEntry> Block2()
+{
+    return {
+        Entry(1, 2, 0, 0, true, -50),
+        Entry(1, 2, 0, 1, false, 30),
+    };
+}
+
+BOOST_AUTO_TEST_CASE(address_balance_write_erase)
+{
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_REQUIRE(db.WriteAddressIndex(Block1()));
+    CheckBalance(Balance(db, 1), 70, 70, 2);
+    CheckBalance(Balance(db, 2), 15, 15, 1);
+
+    // Writing a block again, as when it is reconnected after a crash,
+    // leaves the totals alone.
+    BOOST_REQUIRE(db.WriteAddressIndex(Block1()));
+    CheckBalance(Balance(db, 1), 70, 70, 2);
+    CheckBalance(Balance(db, 2), 15, 15, 1);
+
+    // A spend and the change in one transaction count as one transaction.
+    BOOST_REQUIRE(db.WriteAddressIndex(Block2()));
+    BOOST_REQUIRE(db.WriteAddressIndex(Block2()));
+    CheckBalance(Balance(db, 1), 50, 100, 3);
+
+    // Erasing reverses writing, also when done twice.
+    BOOST_REQUIRE(db.EraseAddressIndex(Block2()));
+    BOOST_REQUIRE(db.EraseAddressIndex(Block2()));
+    CheckBalance(Balance(db, 1), 70, 70, 2);
+    BOOST_REQUIRE(db.EraseAddressIndex(Block1()));
+    CheckBalance(Balance(db, 1), 0, 0, 0);
+    CheckBalance(Balance(db, 2), 0, 0, 0);
+    BOOST_CHECK(Scan(db, CAddressIndexKey(ADDRESS_TYPE, AddressHash(1), 0, 0, uint256(), 0, false), 0).empty());
+
+    // A key listed twice is one entry, and is counted once.
+    std::vector<CAddressIndexDbEntry> vDuplicate = Block1();
+    vDuplicate.push_back(vDuplicate[0]);
+    BOOST_REQUIRE(db.WriteAddressIndex(vDuplicate));
+    CheckBalance(Balance(db, 1), 70, 70, 2);
+    BOOST_REQUIRE(db.EraseAddressIndex(vDuplicate));
+    CheckBalance(Balance(db, 1), 0, 0, 0);
+}
+
+BOOST_AUTO_TEST_CASE(address_balance_rebuild)
+{
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_REQUIRE(db.WriteAddressIndex(Block1()));
+    BOOST_REQUIRE(db.WriteAddressIndex(Block2()));
+    // Address 1 spends its change to address 2, which receives two outputs.
+    BOOST_REQUIRE(db.WriteAddressIndex({
+        Entry(1, 3, 0, 0, true, -30),
+        Entry(2, 3, 0, 0, false, 5),
+        Entry(2, 3, 0, 1, false, 25),
+    }));
+    CAddressBalanceValue value1 = Balance(db, 1);
+    CAddressBalanceValue value2 = Balance(db, 2);
+    CheckBalance(value1, 20, 100, 4);
+    CheckBalance(value2, 45, 45, 2);
+
+    // Recomputing the totals from the index gives the incremental ones.
+    BOOST_REQUIRE(db.RebuildAddressBalanceIndex());
+    CheckBalance(Balance(db, 1), value1.balance, value1.received, value1.txCount);
+    CheckBalance(Balance(db, 2), value2.balance, value2.received, value2.txCount);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -14,6 +14,10 @@
 
 #include <stdint.h>
 
+#include <map>
+#include <set>
+#include <tuple>
+
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -49,12 +53,57 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_TIMESTAMPINDEX = 'T';
 static const char DB_BLOCKHASHINDEX = 'h';
+static const char DB_ADDRESSBALANCEINDEX = 'e';
+
+/** Read the -<prefix>* LevelDB settings */
+static CDBProfile GetDBProfile(const std::string& strPrefix, int64_t nDefaultFileSize, bool fDefaultCompression)
+{
+    CDBProfile profile;
+    profile.nWriteBufferPercent = std::max(1, std::min((int)GetArg(strPrefix + "writebuffer", DEFAULT_DB_WRITE_BUFFER), 40));
+    profile.nMaxFileSize = std::max((int64_t)1, std::min(GetArg(strPrefix + "filesize", nDefaultFileSize), (int64_t)1024)) << 20;
+    profile.nMaxOpenFiles = std::max((int)GetArg(strPrefix + "openfiles", DEFAULT_DB_OPEN_FILES), DEFAULT_DB_OPEN_FILES);
+    profile.fCompression = GetBoolArg(strPrefix + "compression", fDefaultCompression);
+    return profile;
+}
+
+CDBProfile GetChainstateDBProfile()
+{
+    return GetDBProfile("-chainstatedb", DEFAULT_CHAINSTATE_DB_FILE_SIZE, DEFAULT_CHAINSTATE_DB_COMPRESSION);
+}
+
+CDBProfile GetBlockIndexDBProfile()
+{
+    return GetDBProfile("-blockindexdb", DEFAULT_BLOCKINDEX_DB_FILE_SIZE, DEFAULT_BLOCKINDEX_DB_COMPRESSION);
+}
+
+CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe, GetChainstateDBProfile()) {
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, GetChainstateDBProfile())
+{
+}
+
+CCoinsViewDB::~CCoinsViewDB() {
+    if (threadFlush.joinable())
+        threadFlush.join();
+}
 
-CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+std::shared_ptr<const CCoinsViewDB::Snapshot> CCoinsViewDB::GetSnapshot() const {
+    LOCK(cs_snapshot);
+    return snapshot;
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+/** Look up an anchor in a snapshot. Returns false if the snapshot doesn't have it. */
+template<typename Map, typename Tree>
+static bool FindSnapshotAnchor(const Map& map, const uint256 &rt, Tree &tree, bool &fEntered)
 {
+    typename Map::const_iterator it = map.find(rt);
+    if (it == map.end())
+        return false;
+    fEntered = it->second.entered;
+    if (fEntered)
+        tree = it->second.tree;
+    return true;
 }
 
 bool CCoinsViewDB::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const {
@@ -64,6 +113,11 @@ bool CCoinsViewDB::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree)
         return true;
     }
 
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    bool fEntered;
+    if (s && FindSnapshotAnchor(s->mapSproutAnchors, rt, tree, fEntered))
+        return fEntered;
+
     bool read = db.Read(make_pair(DB_SPROUT_ANCHOR, rt), tree);
 
     return read;
@@ -76,6 +130,11 @@ bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree
         return true;
     }
 
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    bool fEntered;
+    if (s && FindSnapshotAnchor(s->mapSaplingAnchors, rt, tree, fEntered))
+        return fEntered;
+
     bool read = db.Read(make_pair(DB_SAPLING_ANCHOR, rt), tree);
 
     return read;
@@ -88,6 +147,11 @@ bool CCoinsViewDB::GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleTree &tree
         return true;
     }
 
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    bool fEntered;
+    if (s && FindSnapshotAnchor(s->mapOrchardAnchors, rt, tree, fEntered))
+        return fEntered;
+
     bool read = db.Read(make_pair(DB_ORCHARD_ANCHOR, rt), tree);
 
     return read;
@@ -109,18 +173,48 @@ bool CCoinsViewDB::GetNullifier(const uint256 &nf, ShieldedType type) const {
         default:
             throw runtime_error("Unknown shielded type");
     }
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s) {
+        const CNullifiersMap& mapNullifiers = type == SPROUT ? s->mapSproutNullifiers :
+                                              type == SAPLING ? s->mapSaplingNullifiers :
+                                              s->mapOrchardNullifiers;
+        CNullifiersMap::const_iterator it = mapNullifiers.find(nf);
+        if (it != mapNullifiers.end())
+            return it->second.entered;
+    }
     return db.Read(make_pair(dbChar, nf), spent);
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s) {
+        CCoinsMap::const_iterator it = s->mapCoins.find(txid);
+        if (it != s->mapCoins.end()) {
+            // Like the database, don't return pruned entries.
+            if (it->second.coins.IsPruned())
+                return false;
+            coins = it->second.coins;
+            return true;
+        }
+    }
     return db.Read(make_pair(DB_COINS, txid), coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s) {
+        CCoinsMap::const_iterator it = s->mapCoins.find(txid);
+        if (it != s->mapCoins.end())
+            return !it->second.coins.IsPruned();
+    }
     return db.Exists(make_pair(DB_COINS, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s && !s->hashBlock.IsNull())
+        return s->hashBlock;
+
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -128,6 +222,26 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 uint256 CCoinsViewDB::GetBestAnchor(ShieldedType type) const {
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s) {
+        uint256 hashSnapshotAnchor;
+        switch (type) {
+            case SPROUT:
+                hashSnapshotAnchor = s->hashSproutAnchor;
+                break;
+            case SAPLING:
+                hashSnapshotAnchor = s->hashSaplingAnchor;
+                break;
+            case ORCHARD:
+                hashSnapshotAnchor = s->hashOrchardAnchor;
+                break;
+            default:
+                throw runtime_error("Unknown shielded type");
+        }
+        if (!hashSnapshotAnchor.IsNull())
+            return hashSnapshotAnchor;
+    }
+
     uint256 hashBestAnchor;
 
     switch (type) {
@@ -151,6 +265,13 @@ uint256 CCoinsViewDB::GetBestAnchor(ShieldedType type) const {
 }
 
 HistoryIndex CCoinsViewDB::GetHistoryLength(uint32_t epochId) const {
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s) {
+        CHistoryCacheMap::const_iterator it = s->historyCacheMap.find(epochId);
+        if (it != s->historyCacheMap.end())
+            return it->second.length;
+    }
+
     HistoryIndex historyLength;
     if (!db.Read(make_pair(DB_MMR_LENGTH, epochId), historyLength)) {
         // Starting new history
@@ -167,6 +288,15 @@ HistoryNode CCoinsViewDB::GetHistoryAt(uint32_t epochId, HistoryIndex index) con
         throw runtime_error("History data inconsistent - reindex?");
     }
 
+    // Nodes from updateDepth on were replaced by the snapshot; the ones
+    // before it are unchanged in the database.
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s) {
+        CHistoryCacheMap::const_iterator it = s->historyCacheMap.find(epochId);
+        if (it != s->historyCacheMap.end() && index >= it->second.updateDepth)
+            return it->second.appends.at(index);
+    }
+
     if (libzcash::IsV1HistoryTree(epochId)) {
         // History nodes serialized by `zcashd` versions that were unaware of NU5, used
         // the previous shorter maximum serialized length. Because we stored this as an
@@ -196,6 +326,13 @@ HistoryNode CCoinsViewDB::GetHistoryAt(uint32_t epochId, HistoryIndex index) con
 }
 
 uint256 CCoinsViewDB::GetHistoryRoot(uint32_t epochId) const {
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    if (s) {
+        CHistoryCacheMap::const_iterator it = s->historyCacheMap.find(epochId);
+        if (it != s->historyCacheMap.end())
+            return it->second.root;
+    }
+
     uint256 root;
     if (!db.Read(make_pair(DB_MMR_ROOT, epochId), root))
     {
@@ -204,9 +341,9 @@ uint256 CCoinsViewDB::GetHistoryRoot(uint32_t epochId) const {
     return root;
 }
 
-void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar)
+void BatchWriteNullifiers(CDBBatch& batch, const CNullifiersMap& mapToUse, const char& dbChar)
 {
-    for (CNullifiersMap::iterator it = mapToUse.begin(); it != mapToUse.end();) {
+    for (CNullifiersMap::const_iterator it = mapToUse.begin(); it != mapToUse.end(); it++) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
             if (!it->second.entered)
                 batch.Erase(make_pair(dbChar, it->first));
@@ -214,14 +351,13 @@ void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char&
                 batch.Write(make_pair(dbChar, it->first), true);
             // TODO: changed++? ... See comment in CCoinsViewDB::BatchWrite. If this is needed we could return an int
         }
-        it = mapToUse.erase(it);
     }
 }
 
 template<typename Map, typename MapIterator, typename MapEntry, typename Tree>
-void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
+void BatchWriteAnchors(CDBBatch& batch, const Map& mapToUse, const char& dbChar)
 {
-    for (MapIterator it = mapToUse.begin(); it != mapToUse.end();) {
+    for (MapIterator it = mapToUse.begin(); it != mapToUse.end(); it++) {
         if (it->second.flags & MapEntry::DIRTY) {
             if (!it->second.entered)
                 batch.Erase(make_pair(dbChar, it->first));
@@ -232,11 +368,10 @@ void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
             }
             // TODO: changed++?
         }
-        it = mapToUse.erase(it);
     }
 }
 
-void BatchWriteHistory(CDBBatch& batch, CHistoryCacheMap& historyCacheMap) {
+void BatchWriteHistory(CDBBatch& batch, const CHistoryCacheMap& historyCacheMap) {
     for (auto nextHistoryCache = historyCacheMap.begin(); nextHistoryCache != historyCacheMap.end(); nextHistoryCache++) {
         auto historyCache = nextHistoryCache->second;
         auto epochId = nextHistoryCache->first;
@@ -262,22 +397,22 @@ void BatchWriteHistory(CDBBatch& batch, CHistoryCacheMap& historyCacheMap) {
     }
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
-                              const uint256 &hashBlock,
-                              const uint256 &hashSproutAnchor,
-                              const uint256 &hashSaplingAnchor,
-                              const uint256 &hashOrchardAnchor,
-                              CAnchorsSproutMap &mapSproutAnchors,
-                              CAnchorsSaplingMap &mapSaplingAnchors,
-                              CAnchorsOrchardMap &mapOrchardAnchors,
-                              CNullifiersMap &mapSproutNullifiers,
-                              CNullifiersMap &mapSaplingNullifiers,
-                              CNullifiersMap &mapOrchardNullifiers,
-                              CHistoryCacheMap &historyCacheMap) {
+bool CCoinsViewDB::WriteChanges(const CCoinsMap &mapCoins,
+                                const uint256 &hashBlock,
+                                const uint256 &hashSproutAnchor,
+                                const uint256 &hashSaplingAnchor,
+                                const uint256 &hashOrchardAnchor,
+                                const CAnchorsSproutMap &mapSproutAnchors,
+                                const CAnchorsSaplingMap &mapSaplingAnchors,
+                                const CAnchorsOrchardMap &mapOrchardAnchors,
+                                const CNullifiersMap &mapSproutNullifiers,
+                                const CNullifiersMap &mapSaplingNullifiers,
+                                const CNullifiersMap &mapOrchardNullifiers,
+                                const CHistoryCacheMap &historyCacheMap) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             if (it->second.coins.IsPruned())
                 batch.Erase(make_pair(DB_COINS, it->first));
@@ -286,12 +421,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
             changed++;
         }
         count++;
-        it = mapCoins.erase(it);
     }
 
-    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR);
-    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
-    ::BatchWriteAnchors<CAnchorsOrchardMap, CAnchorsOrchardMap::iterator, CAnchorsOrchardCacheEntry, OrchardMerkleTree>(batch, mapOrchardAnchors, DB_ORCHARD_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::const_iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::const_iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsOrchardMap, CAnchorsOrchardMap::const_iterator, CAnchorsOrchardCacheEntry, OrchardMerkleTree>(batch, mapOrchardAnchors, DB_ORCHARD_ANCHOR);
 
     ::BatchWriteNullifiers(batch, mapSproutNullifiers, DB_NULLIFIER);
     ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER);
@@ -312,7 +446,100 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
+                              const uint256 &hashBlock,
+                              const uint256 &hashSproutAnchor,
+                              const uint256 &hashSaplingAnchor,
+                              const uint256 &hashOrchardAnchor,
+                              CAnchorsSproutMap &mapSproutAnchors,
+                              CAnchorsSaplingMap &mapSaplingAnchors,
+                              CAnchorsOrchardMap &mapOrchardAnchors,
+                              CNullifiersMap &mapSproutNullifiers,
+                              CNullifiersMap &mapSaplingNullifiers,
+                              CNullifiersMap &mapOrchardNullifiers,
+                              CHistoryCacheMap &historyCacheMap) {
+    // Lookups only ever have to check a single snapshot, and changes reach
+    // the database in order.
+    if (!WaitForFlush())
+        return false;
+
+    if (!fFlushInBackground) {
+        bool fOk = WriteChanges(mapCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor, hashOrchardAnchor,
+                                mapSproutAnchors, mapSaplingAnchors, mapOrchardAnchors,
+                                mapSproutNullifiers, mapSaplingNullifiers, mapOrchardNullifiers,
+                                historyCacheMap);
+        mapCoins.clear();
+        mapSproutAnchors.clear();
+        mapSaplingAnchors.clear();
+        mapOrchardAnchors.clear();
+        mapSproutNullifiers.clear();
+        mapSaplingNullifiers.clear();
+        mapOrchardNullifiers.clear();
+        return fOk;
+    }
+    fFlushInBackground = false;
+
+    // Take over the caller's maps rather than copying them.
+    std::shared_ptr<Snapshot> s = std::make_shared<Snapshot>();
+    s->mapCoins.swap(mapCoins);
+    s->hashBlock = hashBlock;
+    s->hashSproutAnchor = hashSproutAnchor;
+    s->hashSaplingAnchor = hashSaplingAnchor;
+    s->hashOrchardAnchor = hashOrchardAnchor;
+    s->mapSproutAnchors.swap(mapSproutAnchors);
+    s->mapSaplingAnchors.swap(mapSaplingAnchors);
+    s->mapOrchardAnchors.swap(mapOrchardAnchors);
+    s->mapSproutNullifiers.swap(mapSproutNullifiers);
+    s->mapSaplingNullifiers.swap(mapSaplingNullifiers);
+    s->mapOrchardNullifiers.swap(mapOrchardNullifiers);
+    s->historyCacheMap.swap(historyCacheMap);
+    {
+        LOCK(cs_snapshot);
+        snapshot = s;
+    }
+    LogPrint("coindb", "Committing %u cached transactions to coin database in the background\n", (unsigned int)s->mapCoins.size());
+    threadFlush = std::thread(&TraceThread<std::function<void()>>, "coinsflush", [this] { ThreadCommitSnapshot(); });
+    return true;
+}
+
+void CCoinsViewDB::ThreadCommitSnapshot() {
+    std::shared_ptr<const Snapshot> s = GetSnapshot();
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        fOk = WriteChanges(s->mapCoins, s->hashBlock, s->hashSproutAnchor, s->hashSaplingAnchor, s->hashOrchardAnchor,
+                           s->mapSproutAnchors, s->mapSaplingAnchors, s->mapOrchardAnchors,
+                           s->mapSproutNullifiers, s->mapSaplingNullifiers, s->mapOrchardNullifiers,
+                           s->historyCacheMap);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+
+    LOCK(cs_snapshot);
+    if (fOk) {
+        LogPrint("bench", "Background coins flush: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+        // Everything is in the database now, so lookups can go straight there.
+        snapshot.reset();
+    } else {
+        // Keep the snapshot, so that lookups stay correct until shutdown.
+        LogPrintf("%s: failed to write coins for block %s to the database\n", __func__, s->hashBlock.ToString());
+        fSnapshotFailed = true;
+    }
+}
+
+bool CCoinsViewDB::WaitForFlush() {
+    if (threadFlush.joinable())
+        threadFlush.join();
+    LOCK(cs_snapshot);
+    return !fSnapshotFailed;
+}
+
+bool CCoinsViewDB::BackgroundFlushFailed() const {
+    LOCK(cs_snapshot);
+    return fSnapshotFailed;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, GetBlockIndexDBProfile()) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -447,8 +674,55 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type, std::v
     return true;
 }
 
+/**
+ * Add the entries of vect to the running totals of their addresses (or
+ * subtract them, if fErase), in the same batch that writes or erases the
+ * entries. Only entries that are being added or removed count, so that
+ * writing the index of a block again, as happens when blocks are
+ * reconnected after a crash, leaves the totals unchanged. The entries of a
+ * block are written and erased in one batch, so either all of them are in
+ * the index or none are, and looking up the first one is enough to tell.
+ */
+static void BatchUpdateAddressBalances(CBlockTreeDB& db, CDBBatch& batch, const std::vector<CAddressIndexDbEntry> &vect, bool fErase)
+{
+    if (vect.empty() || db.Exists(make_pair(DB_ADDRESSINDEX, vect[0].first)) != fErase)
+        return;
+
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> mapDeltas;
+    std::set<std::tuple<unsigned int, uint160, uint256>> setTxs;
+    // A key listed twice is still one entry in the index.
+    std::set<std::tuple<unsigned int, uint160, int, unsigned int, uint256, size_t, bool>> setKeys;
+    for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        const CAddressIndexKey& key = it->first;
+        if (!setKeys.insert(std::make_tuple(key.type, key.hashBytes, key.blockHeight, key.txindex,
+                                            key.txhash, key.index, key.spending)).second)
+            continue;
+        CAddressBalanceValue& delta = mapDeltas[make_pair(key.type, key.hashBytes)];
+        delta.balance += it->second;
+        if (it->second > 0)
+            delta.received += it->second;
+        if (setTxs.insert(std::make_tuple(key.type, key.hashBytes, key.txhash)).second)
+            delta.txCount++;
+    }
+
+    for (const auto& it : mapDeltas) {
+        CAddressIndexIteratorKey key(it.first.first, it.first.second);
+        CAddressBalanceValue value;
+        db.Read(make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+        int sign = fErase ? -1 : 1;
+        value.balance += sign * it.second.balance;
+        value.received += sign * it.second.received;
+        value.txCount += sign * it.second.txCount;
+        if (value.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, key));
+        else
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+    }
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
     CDBBatch batch(*this);
+    BatchUpdateAddressBalances(*this, batch, vect, false);
     for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
     return WriteBatch(batch);
@@ -456,35 +730,91 @@ bool CBlockTreeDB::WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &ve
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
     CDBBatch batch(*this);
+    BatchUpdateAddressBalances(*this, batch, vect, true);
     for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(
-        uint160 addressHash, int type,
-        std::vector<CAddressIndexDbEntry> &addressIndex,
-        int start, int end)
-{
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) {
+    if (!Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value))
+        value.SetNull();
+    return true;
+}
+
+bool CBlockTreeDB::RebuildAddressBalanceIndex() {
+    CDBBatch batch(*this);
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    // Clear out the old totals first.
+    pcursor->Seek(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexIteratorKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSBALANCEINDEX))
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    // The entries of an address are adjacent, and so are those of a
+    // transaction within an address.
+    CAddressIndexKey last;
+    CAddressBalanceValue value;
+    size_t nAddresses = 0;
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey()));
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+        bool fSameAddress = fValid && !value.IsNull() &&
+            key.second.type == last.type && key.second.hashBytes == last.hashBytes;
+        if (!fSameAddress && !value.IsNull()) {
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(last.type, last.hashBytes)), value);
+            value.SetNull();
+            if (++nAddresses % 100000 == 0) {
+                if (!WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
+        }
+        if (!fValid)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        value.balance += nValue;
+        if (nValue > 0)
+            value.received += nValue;
+        if (!fSameAddress || key.second.txhash != last.txhash)
+            value.txCount++;
+        last = key.second;
+        pcursor->Next();
     }
+    LogPrintf("%s: computed the totals of %u addresses\n", __func__, nAddresses);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ScanAddressIndex(const CAddressIndexKey &keyStart, int end,
+        const std::function<bool(const CAddressIndexKey&, CAmount)> &fn)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, keyStart));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash))
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+              key.second.type == keyStart.type && key.second.hashBytes == keyStart.hashBytes))
             break;
         if (end > 0 && key.second.blockHeight > end)
             break;
         CAmount nValue;
         if (!pcursor->GetValue(nValue))
             return error("failed to get address index value");
-        addressIndex.push_back(make_pair(key.second, nValue));
+        if (!fn(key.second, nValue))
+            break;
         pcursor->Next();
     }
     return true;
@@ -608,6 +938,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts(
                 pindexNew->hashFinalOrchardRoot = diskindex.hashFinalOrchardRoot;
                 pindexNew->hashChainHistoryRoot = diskindex.hashChainHistoryRoot;
                 pindexNew->hashAuthDataRoot = diskindex.hashAuthDataRoot;
+                pindexNew->hashPoW        = diskindex.hashPoW;
 
                 // Consistency checks
                 auto header = pindexNew->GetBlockHeader();
@@ -9,10 +9,14 @@
 #include "chainparams.h"
 #include "coins.h"
 #include "dbwrapper.h"
+#include "sync.h"
 #include "chain.h"
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -27,6 +31,7 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
 struct CTimestampIndexKey;
@@ -47,6 +52,32 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -chainstatedbfilesize default (MiB)
+static const int DEFAULT_CHAINSTATE_DB_FILE_SIZE = 2;
+//! -blockindexdbfilesize default (MiB)
+static const int DEFAULT_BLOCKINDEX_DB_FILE_SIZE = 8;
+//! -chainstatedbcompression default
+static const bool DEFAULT_CHAINSTATE_DB_COMPRESSION = false;
+//! -blockindexdbcompression default
+static const bool DEFAULT_BLOCKINDEX_DB_COMPRESSION = false;
+//! -chainstatedbopenfiles and -blockindexdbopenfiles default
+static const int DEFAULT_DB_OPEN_FILES = 64;
+//! -chainstatedbwritebuffer and -blockindexdbwritebuffer default (percent of the database cache)
+static const int DEFAULT_DB_WRITE_BUFFER = 25;
+
+/**
+ * LevelDB settings of the chain state database, as configured. Lookups are
+ * random point reads of small values that barely compress.
+ */
+CDBProfile GetChainstateDBProfile();
+
+/**
+ * LevelDB settings of the block index database, as configured. With
+ * -insightexplorer it also holds the address, spent and timestamp indexes,
+ * which grow much larger than the chain state and are mostly read as range
+ * scans, so larger compressed table files suit it better.
+ */
+CDBProfile GetBlockIndexDBProfile();
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -73,14 +104,63 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** CCoinsView backed by the coin database (chainstate/)
+ *
+ * A flush can also be committed in the background: BatchWrite then takes over
+ * the flushed maps as a snapshot and returns at once, and a separate thread
+ * writes the snapshot to the database. Until that write is done, lookups see
+ * the snapshot on top of the database. The snapshot is written in one batch
+ * together with the best block marker, so after a crash the database is at
+ * either the old or the new best block.
+ */
 class CCoinsViewDB : public CCoinsView
 {
+private:
+    /** The changes of a flush that is being committed in the background */
+    struct Snapshot
+    {
+        CCoinsMap mapCoins;
+        uint256 hashBlock;
+        uint256 hashSproutAnchor;
+        uint256 hashSaplingAnchor;
+        uint256 hashOrchardAnchor;
+        CAnchorsSproutMap mapSproutAnchors;
+        CAnchorsSaplingMap mapSaplingAnchors;
+        CAnchorsOrchardMap mapOrchardAnchors;
+        CNullifiersMap mapSproutNullifiers;
+        CNullifiersMap mapSaplingNullifiers;
+        CNullifiersMap mapOrchardNullifiers;
+        CHistoryCacheMap historyCacheMap;
+    };
+
+    mutable CCriticalSection cs_snapshot;
+    std::shared_ptr<const Snapshot> snapshot; // Only replaced under cs_snapshot
+    bool fSnapshotFailed = false; // Protected by cs_snapshot
+    bool fFlushInBackground = false;
+    std::thread threadFlush;
+
+    std::shared_ptr<const Snapshot> GetSnapshot() const;
+    void ThreadCommitSnapshot();
+
+    bool WriteChanges(const CCoinsMap &mapCoins,
+                      const uint256 &hashBlock,
+                      const uint256 &hashSproutAnchor,
+                      const uint256 &hashSaplingAnchor,
+                      const uint256 &hashOrchardAnchor,
+                      const CAnchorsSproutMap &mapSproutAnchors,
+                      const CAnchorsSaplingMap &mapSaplingAnchors,
+                      const CAnchorsOrchardMap &mapOrchardAnchors,
+                      const CNullifiersMap &mapSproutNullifiers,
+                      const CNullifiersMap &mapSaplingNullifiers,
+                      const CNullifiersMap &mapOrchardNullifiers,
+                      const CHistoryCacheMap &historyCacheMap);
+
 protected:
     CDBWrapper db;
     CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const;
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
@@ -106,6 +186,15 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap);
     bool GetStats(CCoinsStats &stats) const;
+
+    /** Commit the next BatchWrite in the background */
+    void FlushInBackground() { fFlushInBackground = true; }
+
+    /** Wait for a background commit to finish. Returns false if it failed. */
+    bool WaitForFlush();
+
+    /** Whether a background commit has failed, without waiting */
+    bool BackgroundFlushFailed() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -131,7 +220,17 @@ public:
     bool ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<CAddressUnspentDbEntry> &vect);
     bool WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
     bool EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
-    bool ReadAddressIndex(uint160 addressHash, int type, std::vector<CAddressIndexDbEntry> &addressIndex, int start = 0, int end = 0);
+    /**
+     * Pass the address index entries of the address in keyStart to fn, in key
+     * order, starting at keyStart and ending at height end (if positive) or
+     * when fn returns false.
+     */
+    bool ScanAddressIndex(const CAddressIndexKey &keyStart, int end,
+            const std::function<bool(const CAddressIndexKey&, CAmount)> &fn);
+    /** Read the running totals of an address, which are zero if it has no entries */
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+    /** Recompute the running totals of all addresses from the address index */
+    bool RebuildAddressBalanceIndex();
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<CSpentIndexDbEntry> &vect);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
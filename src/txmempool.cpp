@@ -148,6 +148,12 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         }
     }
 
+    if (nPriorityIndexHeight >= 0) {
+        double dPriority = GetMiningPriority(*newit, nPriorityIndexHeight);
+        if (AllowFree(dPriority))
+            setPriorityIndex.insert(std::make_pair(dPriority, hash));
+    }
+
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
@@ -311,6 +317,8 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
                 mapOrchardNullifiers.erase(orchardNullifier);
             }
             removed.push_back(tx);
+            if (nPriorityIndexHeight >= 0)
+                setPriorityIndex.erase(std::make_pair(GetMiningPriority(*mapTx.find(hash), nPriorityIndexHeight), hash));
             totalTxSize -= mapTx.find(hash)->GetTxSize();
             cachedInnerUsage -= mapTx.find(hash)->DynamicMemoryUsage();
             mapTx.erase(hash);
@@ -521,6 +529,8 @@ void CTxMemPool::_clear()
 {
     mapTx.clear();
     mapNextTx.clear();
+    setPriorityIndex.clear();
+    nPriorityIndexHeight = -1;
     totalTxSize = 0;
     cachedInnerUsage = 0;
     ++nTransactionsUpdated;
@@ -647,6 +657,14 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+
+    if (nPriorityIndexHeight >= 0) {
+        for (const std::pair<double, uint256>& item : setPriorityIndex) {
+            indexed_transaction_set::const_iterator it = mapTx.find(item.second);
+            assert(it != mapTx.end());
+            assert(GetMiningPriority(*it, nPriorityIndexHeight) == item.first);
+        }
+    }
 }
 
 void CTxMemPool::checkNullifiers(ShieldedType type) const
@@ -813,12 +831,19 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
 {
     {
         LOCK(cs);
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end() && nPriorityIndexHeight >= 0)
+            setPriorityIndex.erase(std::make_pair(GetMiningPriority(*it, nPriorityIndexHeight), hash));
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
-        txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(deltas.second));
+            if (nPriorityIndexHeight >= 0) {
+                double dPriority = GetMiningPriority(*it, nPriorityIndexHeight);
+                if (AllowFree(dPriority))
+                    setPriorityIndex.insert(std::make_pair(dPriority, hash));
+            }
         }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
@@ -838,7 +863,42 @@ void CTxMemPool::ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount
 void CTxMemPool::ClearPrioritisation(const uint256 hash)
 {
     LOCK(cs);
+    txiter it = mapTx.find(hash);
+    bool fReindex = it != mapTx.end() && nPriorityIndexHeight >= 0;
+    if (fReindex)
+        setPriorityIndex.erase(std::make_pair(GetMiningPriority(*it, nPriorityIndexHeight), hash));
     mapDeltas.erase(hash);
+    if (fReindex) {
+        double dPriority = GetMiningPriority(*it, nPriorityIndexHeight);
+        if (AllowFree(dPriority))
+            setPriorityIndex.insert(std::make_pair(dPriority, hash));
+    }
+}
+
+double CTxMemPool::GetMiningPriority(const CTxMemPoolEntry& entry, unsigned int nHeight) const
+{
+    double dPriority = entry.GetPriority(nHeight);
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator pos = mapDeltas.find(entry.GetTx().GetHash());
+    if (pos != mapDeltas.end())
+        dPriority += pos->second.first;
+    return dPriority;
+}
+
+const CTxMemPool::priority_index& CTxMemPool::GetPriorityIndex(unsigned int nHeight)
+{
+    AssertLockHeld(cs);
+    if (nPriorityIndexHeight != (int)nHeight) {
+        // Priorities grow with height at different rates, so the order has to
+        // be recomputed once per height.
+        setPriorityIndex.clear();
+        for (const CTxMemPoolEntry& entry : mapTx) {
+            double dPriority = GetMiningPriority(entry, nHeight);
+            if (AllowFree(dPriority))
+                setPriorityIndex.insert(std::make_pair(dPriority, entry.GetTx().GetHash()));
+        }
+        nPriorityIndexHeight = nHeight;
+    }
+    return setPriorityIndex;
 }
 
 bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
@@ -6,8 +6,10 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <functional>
 #include <list>
 #include <memory>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -207,7 +209,11 @@ private:
     RecentlyEvictedList* recentlyEvicted = new RecentlyEvictedList(DEFAULT_MEMPOOL_EVICTION_MEMORY_MINUTES * 60);
     WeightedTxTree* weightedTxTree = new WeightedTxTree(DEFAULT_MEMPOOL_TOTAL_COST_LIMIT);
 
+    //! Height setPriorityIndex was built for, or -1 if it must be rebuilt
+    int nPriorityIndexHeight = -1;
+
     void checkNullifiers(ShieldedType type) const;
+    double GetMiningPriority(const CTxMemPoolEntry& entry, unsigned int nHeight) const;
 
     CFeeRate minReasonableRelayFee;
 
@@ -234,6 +240,12 @@ public:
     indexed_transaction_set mapTx;
     typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
 
+    //! (priority, txid) pairs, highest priority first
+    typedef std::set<std::pair<double, uint256>, std::greater<std::pair<double, uint256>>> priority_index;
+
+private:
+    priority_index setPriorityIndex;
+
 private:
     // insightexplorer
     std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> mapAddress;
@@ -300,6 +312,14 @@ public:
 
     /** Affect CreateNewBlock prioritisation of transactions */
     void PrioritiseTransaction(const uint256 hash, const std::string strHash, double dPriorityDelta, const CAmount& nFeeDelta);
+    /**
+     * Transactions whose priority at nHeight, including any PrioritiseTransaction
+     * delta, is high enough for AllowFree. This lets block assembly fill the
+     * priority area without sorting the whole pool. The index follows
+     * transactions entering and leaving the pool, and is only rebuilt when it is
+     * requested for a different height. The caller must hold cs while using it.
+     */
+    const priority_index& GetPriorityIndex(unsigned int nHeight);
     void ApplyDeltas(const uint256 hash, double &dPriorityDelta, CAmount &nFeeDelta) const;
     void ClearPrioritisation(const uint256 hash);
 
@@ -834,6 +834,24 @@ static inline uint32_t integerify(const salsa20_blk_t *B, size_t r)
  */
 	return (uint32_t)B[2 * r - 1].d[0];
 }
+
+/**
+ * prefetch_block(B, r):
+ * Hint that the 128r-byte block B is about to be read.  Used by the
+ * multi-lane code to fetch one lane's next V_j while the other lanes compute.
+ */
+static inline void prefetch_block(const salsa20_blk_t *B, size_t r)
+{
+#ifdef PREFETCH
+	size_t i;
+	for (i = 0; i < 2 * r; i++) {
+		PREFETCH(&B[i], _MM_HINT_T0)
+	}
+#else
+	(void)B;
+	(void)r;
+#endif
+}
 #endif
 
 /**
@@ -1001,6 +1019,195 @@ static void smix(uint8_t *B, size_t r, uint32_t N,
 #endif
 }
 
+/**
+ * smix1_multi(B, r, N, V, XY, ctx, lanes):
+ * Compute smix1() for each of lanes independent inputs B[0 .. lanes - 1],
+ * using per-lane V, XY and ctx.  The lanes are processed in lockstep, one
+ * BlockMix at a time, so that memory accesses of one lane overlap with the
+ * computation of the others.
+ */
+static void smix1_multi(uint8_t **B, size_t r, uint32_t N,
+    salsa20_blk_t **V, salsa20_blk_t **XY, pwxform_ctx_t **ctx, size_t lanes)
+{
+	size_t s = 2 * r;
+	size_t X, Y, l;
+	uint32_t i, n, j[YESPOWER_MAX_LANES];
+
+	for (l = 0; l < lanes; l++) {
+#if _YESPOWER_OPT_C_PASS_ == 1
+		for (i = 0; i < 2 * r; i++) {
+#else
+		for (i = 0; i < 2; i++) {
+#endif
+			const salsa20_blk_t *src = (salsa20_blk_t *)&B[l][i * 64];
+			salsa20_blk_t *tmp = &V[l][s];
+			salsa20_blk_t *dst = &V[l][i];
+			size_t k;
+			for (k = 0; k < 16; k++)
+				tmp->w[k] = le32dec(&src->w[k]);
+			salsa20_simd_shuffle(tmp, dst);
+		}
+
+#if _YESPOWER_OPT_C_PASS_ > 1
+		for (i = 1; i < r; i++)
+			blockmix(&V[l][(i - 1) * 2], &V[l][i * 2], 1, ctx[l]);
+#endif
+
+		blockmix(V[l], &V[l][s], r, ctx[l]);
+		blockmix(&V[l][s], &V[l][2 * s], r, ctx[l]);
+		j[l] = integerify(&V[l][2 * s], r);
+	}
+	X = 2 * s;
+
+	for (n = 2; n < N; n <<= 1) {
+		uint32_t m = (n < N / 2) ? n : (N - 1 - n);
+		for (i = 1; i < m; i += 2) {
+			Y = X + s;
+			for (l = 0; l < lanes; l++) {
+				j[l] &= n - 1;
+				j[l] += i - 1;
+				j[l] = blockmix_xor(&V[l][X], &V[l][j[l] * s],
+				    &V[l][Y], r, ctx[l]);
+				prefetch_block(&V[l][((j[l] & (n - 1)) + i) * s], r);
+			}
+			X = Y + s;
+			for (l = 0; l < lanes; l++) {
+				j[l] &= n - 1;
+				j[l] += i;
+				j[l] = blockmix_xor(&V[l][Y], &V[l][j[l] * s],
+				    &V[l][X], r, ctx[l]);
+				if (i + 2 < m)
+					prefetch_block(
+					    &V[l][((j[l] & (n - 1)) + i + 1) * s], r);
+			}
+		}
+	}
+	n >>= 1;
+
+	Y = X + s;
+	for (l = 0; l < lanes; l++) {
+		j[l] &= n - 1;
+		j[l] += N - 2 - n;
+		j[l] = blockmix_xor(&V[l][X], &V[l][j[l] * s], &V[l][Y], r, ctx[l]);
+		prefetch_block(&V[l][((j[l] & (n - 1)) + N - 1 - n) * s], r);
+	}
+	for (l = 0; l < lanes; l++) {
+		j[l] &= n - 1;
+		j[l] += N - 1 - n;
+		blockmix_xor(&V[l][Y], &V[l][j[l] * s], XY[l], r, ctx[l]);
+	}
+
+	for (l = 0; l < lanes; l++) {
+		for (i = 0; i < 2 * r; i++) {
+			const salsa20_blk_t *src = &XY[l][i];
+			salsa20_blk_t *tmp = &XY[l][s];
+			salsa20_blk_t *dst = (salsa20_blk_t *)&B[l][i * 64];
+			size_t k;
+			for (k = 0; k < 16; k++)
+				le32enc(&tmp->w[k], src->w[k]);
+			salsa20_simd_unshuffle(tmp, dst);
+		}
+	}
+}
+
+/**
+ * smix2_multi(B, r, N, Nloop, V, XY, ctx, lanes):
+ * Compute smix2() for each of lanes independent inputs, in lockstep like
+ * smix1_multi().  Each lane's next V_j is prefetched as soon as it is known,
+ * while the remaining lanes compute.
+ */
+static void smix2_multi(uint8_t **B, size_t r, uint32_t N, uint32_t Nloop,
+    salsa20_blk_t **V, salsa20_blk_t **XY, pwxform_ctx_t **ctx, size_t lanes)
+{
+	size_t s = 2 * r;
+	size_t l;
+	uint32_t i, j[YESPOWER_MAX_LANES];
+
+	for (l = 0; l < lanes; l++) {
+		for (i = 0; i < 2 * r; i++) {
+			const salsa20_blk_t *src = (salsa20_blk_t *)&B[l][i * 64];
+			salsa20_blk_t *tmp = &XY[l][s];
+			salsa20_blk_t *dst = &XY[l][i];
+			size_t k;
+			for (k = 0; k < 16; k++)
+				tmp->w[k] = le32dec(&src->w[k]);
+			salsa20_simd_shuffle(tmp, dst);
+		}
+
+		j[l] = integerify(XY[l], r) & (N - 1);
+	}
+
+#if _YESPOWER_OPT_C_PASS_ == 1
+	if (Nloop > 2) {
+#endif
+		do {
+			for (l = 0; l < lanes; l++) {
+				j[l] = blockmix_xor_save(XY[l], &V[l][j[l] * s],
+				    r, ctx[l]) & (N - 1);
+				prefetch_block(&V[l][j[l] * s], r);
+			}
+			for (l = 0; l < lanes; l++) {
+				j[l] = blockmix_xor_save(XY[l], &V[l][j[l] * s],
+				    r, ctx[l]) & (N - 1);
+				prefetch_block(&V[l][j[l] * s], r);
+			}
+		} while (Nloop -= 2);
+#if _YESPOWER_OPT_C_PASS_ == 1
+	} else {
+		for (l = 0; l < lanes; l++) {
+			j[l] = blockmix_xor(XY[l], &V[l][j[l] * s], &XY[l][s],
+			    r, ctx[l]) & (N - 1);
+			prefetch_block(&V[l][j[l] * s], r);
+		}
+		for (l = 0; l < lanes; l++)
+			blockmix_xor(&XY[l][s], &V[l][j[l] * s], XY[l], r, ctx[l]);
+	}
+#endif
+
+	for (l = 0; l < lanes; l++) {
+		for (i = 0; i < 2 * r; i++) {
+			const salsa20_blk_t *src = &XY[l][i];
+			salsa20_blk_t *tmp = &XY[l][s];
+			salsa20_blk_t *dst = (salsa20_blk_t *)&B[l][i * 64];
+			size_t k;
+			for (k = 0; k < 16; k++)
+				le32enc(&tmp->w[k], src->w[k]);
+			salsa20_simd_unshuffle(tmp, dst);
+		}
+	}
+}
+
+/**
+ * smix_multi(B, r, N, V, XY, ctx, lanes):
+ * Compute smix() for each of lanes independent inputs B[0 .. lanes - 1].
+ * The results are identical to calling smix() on each lane separately.
+ */
+static void smix_multi(uint8_t **B, size_t r, uint32_t N,
+    salsa20_blk_t **V, salsa20_blk_t **XY, pwxform_ctx_t **ctx, size_t lanes)
+{
+#if _YESPOWER_OPT_C_PASS_ == 1
+	uint32_t Nloop_all = (N + 2) / 3; /* 1/3, round up */
+	uint32_t Nloop_rw = Nloop_all;
+
+	Nloop_all++; Nloop_all &= ~(uint32_t)1; /* round up to even */
+	Nloop_rw &= ~(uint32_t)1; /* round down to even */
+#else
+	uint32_t Nloop_rw = (N + 2) / 3; /* 1/3, round up */
+	Nloop_rw++; Nloop_rw &= ~(uint32_t)1; /* round up to even */
+#endif
+	size_t l;
+
+	for (l = 0; l < lanes; l++)
+		smix1(B[l], 1, ctx[l]->Sbytes / 128,
+		    (salsa20_blk_t *)ctx[l]->S0, XY[l], NULL);
+	smix1_multi(B, r, N, V, XY, ctx, lanes);
+	smix2_multi(B, r, N, Nloop_rw /* must be > 2 */, V, XY, ctx, lanes);
+#if _YESPOWER_OPT_C_PASS_ == 1
+	if (Nloop_all > Nloop_rw)
+		smix2_multi(B, r, N, 2, V, XY, ctx, lanes);
+#endif
+}
+
 #if _YESPOWER_OPT_C_PASS_ == 1
 #undef _YESPOWER_OPT_C_PASS_
 #define _YESPOWER_OPT_C_PASS_ 2
@@ -1012,8 +1219,12 @@ static void smix(uint8_t *B, size_t r, uint32_t N,
 #define smix1 smix1_1_0
 #define smix2 smix2_1_0
 #define smix smix_1_0
+#define smix1_multi smix1_multi_1_0
+#define smix2_multi smix2_multi_1_0
+#define smix_multi smix_multi_1_0
 #include "yespower-opt.c"
 #undef smix
+#undef smix_multi
 
 /**
  * yespower(local, src, srclen, params, dst):
@@ -1112,6 +1323,127 @@ int yespower(yespower_local_t *local,
 	return 0;
 }
 
+/**
+ * yespower_multi(local, src, srclen, params, lanes, dst):
+ * Compute yespower(src[l][0 .. srclen - 1], params[l]) into dst[l] for each
+ * of lanes (1 to YESPOWER_MAX_LANES) independent inputs, interleaving their
+ * computation.  All params[l] must have the same version, N and r, but may
+ * have different personalization strings.  local needs lanes times the memory
+ * of yespower().
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int yespower_multi(yespower_local_t *local,
+    const uint8_t *const *src, size_t srclen,
+    const yespower_params_t *params, size_t lanes,
+    yespower_binary_t *dst)
+{
+	yespower_version_t version = params[0].version;
+	uint32_t N = params[0].N;
+	uint32_t r = params[0].r;
+	uint32_t Swidth;
+	size_t B_size, V_size, XY_size, need, l;
+	uint8_t *B[YESPOWER_MAX_LANES], *S;
+	salsa20_blk_t *V[YESPOWER_MAX_LANES], *XY[YESPOWER_MAX_LANES];
+	pwxform_ctx_t ctx[YESPOWER_MAX_LANES], *pctx[YESPOWER_MAX_LANES];
+	uint8_t sha256[YESPOWER_MAX_LANES][32];
+
+	/* Sanity-check parameters */
+	if (lanes < 1 || lanes > YESPOWER_MAX_LANES ||
+	    (version != YESPOWER_0_5 && version != YESPOWER_1_0) ||
+	    N < 1024 || N > 512 * 1024 || r < 8 || r > 32 ||
+	    (N & (N - 1)) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (l = 0; l < lanes; l++) {
+		if (params[l].version != version || params[l].N != N ||
+		    params[l].r != r ||
+		    (!params[l].pers && params[l].perslen)) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	/* Allocate memory, laid out as in yespower() once per lane */
+	B_size = (size_t)128 * r;
+	V_size = B_size * N;
+	if (version == YESPOWER_0_5) {
+		XY_size = B_size * 2;
+		Swidth = Swidth_0_5;
+		ctx[0].Sbytes = 2 * Swidth_to_Sbytes1(Swidth);
+	} else {
+		XY_size = B_size + 64;
+		Swidth = Swidth_1_0;
+		ctx[0].Sbytes = 3 * Swidth_to_Sbytes1(Swidth);
+	}
+	need = B_size + V_size + XY_size + ctx[0].Sbytes;
+	if (local->aligned_size < need * lanes) {
+		if (free_region(local))
+			return -1;
+		if (!alloc_region(local, need * lanes))
+			return -1;
+	}
+	for (l = 0; l < lanes; l++) {
+		B[l] = (uint8_t *)local->aligned + l * need;
+		V[l] = (salsa20_blk_t *)((uint8_t *)B[l] + B_size);
+		XY[l] = (salsa20_blk_t *)((uint8_t *)V[l] + V_size);
+		S = (uint8_t *)XY[l] + XY_size;
+		ctx[l].Sbytes = ctx[0].Sbytes;
+		ctx[l].S0 = S;
+		ctx[l].S1 = S + Swidth_to_Sbytes1(Swidth);
+		pctx[l] = &ctx[l];
+
+		SHA256_Buf(src[l], srclen, sha256[l]);
+	}
+
+	if (version == YESPOWER_0_5) {
+		for (l = 0; l < lanes; l++) {
+			PBKDF2_SHA256(sha256[l], sizeof(sha256[l]), src[l], srclen,
+			    1, B[l], B_size);
+			memcpy(sha256[l], B[l], sizeof(sha256[l]));
+		}
+		smix_multi(B, r, N, V, XY, pctx, lanes);
+		for (l = 0; l < lanes; l++) {
+			PBKDF2_SHA256(sha256[l], sizeof(sha256[l]), B[l], B_size,
+			    1, (uint8_t *)&dst[l], sizeof(dst[l]));
+
+			if (params[l].pers) {
+				HMAC_SHA256_Buf(&dst[l], sizeof(dst[l]),
+				    params[l].pers, params[l].perslen, sha256[l]);
+				SHA256_Buf(sha256[l], sizeof(sha256[l]),
+				    (uint8_t *)&dst[l]);
+			}
+		}
+	} else {
+		for (l = 0; l < lanes; l++) {
+			const uint8_t *p = params[l].pers;
+			size_t plen = p ? params[l].perslen : 0;
+
+			ctx[l].S2 = ctx[l].S0 + 2 * Swidth_to_Sbytes1(Swidth);
+			ctx[l].w = 0;
+
+			PBKDF2_SHA256(sha256[l], sizeof(sha256[l]), p, plen, 1,
+			    B[l], 128);
+			memcpy(sha256[l], B[l], sizeof(sha256[l]));
+		}
+		smix_multi_1_0(B, r, N, V, XY, pctx, lanes);
+		for (l = 0; l < lanes; l++)
+			HMAC_SHA256_Buf(B[l] + B_size - 64, 64,
+			    sha256[l], sizeof(sha256[l]), (uint8_t *)&dst[l]);
+	}
+
+	/* Success! */
+	return 0;
+}
+
+/*
+ * Thread-local memory shared by yespower_tls() and yespower_multi_tls(), so
+ * that a thread using both only keeps one allocation.
+ */
+static __thread int tls_initialized = 0;
+static __thread yespower_local_t tls_local;
+
 /**
  * yespower_tls(src, srclen, params, dst):
  * Compute yespower(src[0 .. srclen - 1], N, r), to be checked for "< target".
@@ -1122,16 +1454,81 @@ int yespower(yespower_local_t *local,
 int yespower_tls(const uint8_t *src, size_t srclen,
     const yespower_params_t *params, yespower_binary_t *dst)
 {
-	static __thread int initialized = 0;
-	static __thread yespower_local_t local;
+	if (!tls_initialized) {
+		if (yespower_init_local(&tls_local))
+			return -1;
+		tls_initialized = 1;
+	}
+
+	return yespower(&tls_local, src, srclen, params, dst);
+}
 
-	if (!initialized) {
-		if (yespower_init_local(&local))
+/**
+ * yespower_multi_tls(src, srclen, params, lanes, dst):
+ * Compute yespower_multi() using thread-local storage.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+int yespower_multi_tls(const uint8_t *const *src, size_t srclen,
+    const yespower_params_t *params, size_t lanes, yespower_binary_t *dst)
+{
+	if (!tls_initialized) {
+		if (yespower_init_local(&tls_local))
 			return -1;
-		initialized = 1;
+		tls_initialized = 1;
 	}
 
-	return yespower(&local, src, srclen, params, dst);
+	return yespower_multi(&tls_local, src, srclen, params, lanes, dst);
+}
+
+size_t yespower_local_size(const yespower_params_t *params, size_t lanes)
+{
+	uint32_t N = params->N;
+	uint32_t r = params->r;
+	size_t B_size, V_size, XY_size, Sbytes;
+
+	if (lanes < 1 || lanes > YESPOWER_MAX_LANES ||
+	    (params->version != YESPOWER_0_5 &&
+	    params->version != YESPOWER_1_0) ||
+	    N < 1024 || N > 512 * 1024 || r < 8 || r > 32)
+		return 0;
+
+	/* N need not be a power of two here: the layout only depends on N */
+	B_size = (size_t)128 * r;
+	V_size = B_size * N;
+	if (params->version == YESPOWER_0_5) {
+		XY_size = B_size * 2;
+		Sbytes = 2 * Swidth_to_Sbytes1(Swidth_0_5);
+	} else {
+		XY_size = B_size + 64;
+		Sbytes = 3 * Swidth_to_Sbytes1(Swidth_1_0);
+	}
+	return (B_size + V_size + XY_size + Sbytes) * lanes;
+}
+
+int yespower_tls_reserve(size_t size, yespower_pages_t max_pages)
+{
+	if (!tls_initialized) {
+		if (yespower_init_local(&tls_local))
+			return -1;
+		tls_initialized = 1;
+	}
+
+	if (free_region(&tls_local))
+		return -1;
+	if (!alloc_region_pages(&tls_local, size, max_pages))
+		return -1;
+
+	/* Fault the pages in from this thread's NUMA node */
+	memset(tls_local.aligned, 0, tls_local.aligned_size);
+	return tls_local.pages;
+}
+
+int yespower_tls_free(void)
+{
+	if (!tls_initialized)
+		return 0;
+	return free_region(&tls_local);
 }
 
 int yespower_init_local(yespower_local_t *local)
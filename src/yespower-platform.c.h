@@ -34,6 +34,7 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 {
 	size_t base_size = size;
 	uint8_t *base, *aligned;
+	int pages = YESPOWER_PAGES_SMALL;
 #ifdef MAP_ANON
 	int flags =
 #ifdef MAP_NOCORE
@@ -55,6 +56,8 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 	base = mmap(NULL, new_size, PROT_READ | PROT_WRITE, flags, -1, 0);
 	if (base != MAP_FAILED) {
 		base_size = new_size;
+		if (flags & MAP_HUGETLB)
+			pages = YESPOWER_PAGES_2M;
 	} else if (flags & MAP_HUGETLB) {
 		flags &= ~MAP_HUGETLB;
 		base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
@@ -83,13 +86,101 @@ static void *alloc_region(yespower_region_t *region, size_t size)
 	region->aligned = aligned;
 	region->base_size = base ? base_size : 0;
 	region->aligned_size = base ? size : 0;
+	region->pages = pages;
 	return aligned;
 }
 
+#if defined(__linux__) && defined(MAP_ANON) && defined(MAP_HUGETLB)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT			26
+#endif
+
+static const struct {
+	yespower_pages_t pages;
+	unsigned int shift;
+} hugepage_sizes[] = {
+	{YESPOWER_PAGES_1G, 30},
+	{YESPOWER_PAGES_2M, 21}
+};
+#endif
+
+/*
+ * Like alloc_region(), but with the caller choosing the largest kind of pages
+ * to try.  Explicit huge pages must have been reserved by the administrator
+ * (vm.nr_hugepages or hugepagesz=1G hugepages=N on the kernel command line);
+ * transparent huge pages only need to be enabled in "madvise" or "always"
+ * mode.  Anything else falls back to regular pages.
+ */
+static void *alloc_region_pages(yespower_region_t *region, size_t size,
+    yespower_pages_t max_pages)
+{
+#if defined(__linux__) && defined(MAP_ANON) && defined(MAP_HUGETLB)
+	const int flags = MAP_ANON | MAP_PRIVATE;
+	uint8_t *base;
+	size_t i;
+
+	for (i = 0; i < sizeof(hugepage_sizes) / sizeof(hugepage_sizes[0]); i++) {
+		const size_t mask = ((size_t)1 << hugepage_sizes[i].shift) - 1;
+		size_t new_size;
+
+		if (hugepage_sizes[i].pages > max_pages || size + mask < size)
+			continue;
+		new_size = (size + mask) & ~mask;
+		base = mmap(NULL, new_size, PROT_READ | PROT_WRITE,
+		    flags | MAP_HUGETLB |
+		    (hugepage_sizes[i].shift << MAP_HUGE_SHIFT), -1, 0);
+		if (base != MAP_FAILED) {
+			region->base = region->aligned = base;
+			region->base_size = new_size;
+			region->aligned_size = size;
+			region->pages = hugepage_sizes[i].pages;
+			return base;
+		}
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (max_pages >= YESPOWER_PAGES_THP) {
+		/* Over-allocate so that the region starts on a 2 MiB boundary */
+		const size_t mask = ((size_t)1 << 21) - 1;
+
+		if (size + mask >= size) {
+			base = mmap(NULL, size + mask, PROT_READ | PROT_WRITE,
+			    flags, -1, 0);
+			if (base != MAP_FAILED) {
+				uint8_t *aligned =
+				    base + ((-(uintptr_t)base) & mask);
+				region->base = base;
+				region->aligned = aligned;
+				region->base_size = size + mask;
+				region->aligned_size = size;
+				region->pages =
+				    madvise(aligned, size, MADV_HUGEPAGE) ?
+				    YESPOWER_PAGES_SMALL : YESPOWER_PAGES_THP;
+				return aligned;
+			}
+		}
+	}
+#endif
+	if (max_pages == YESPOWER_PAGES_SMALL) {
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (base != MAP_FAILED) {
+			region->base = region->aligned = base;
+			region->base_size = region->aligned_size = size;
+			region->pages = YESPOWER_PAGES_SMALL;
+			return base;
+		}
+	}
+#else
+	(void)max_pages;
+#endif
+	return alloc_region(region, size);
+}
+
 static inline void init_region(yespower_region_t *region)
 {
 	region->base = region->aligned = NULL;
 	region->base_size = region->aligned_size = 0;
+	region->pages = YESPOWER_PAGES_SMALL;
 }
 
 static int free_region(yespower_region_t *region)
@@ -46,6 +46,7 @@ extern void yespower_hash(const char *input, size_t inputlen, char *output);
 typedef struct {
 	void *base, *aligned;
 	size_t base_size, aligned_size;
+	int pages; /* yespower_pages_t backing the region */
 } yespower_region_t;
 
 /**
@@ -125,6 +126,87 @@ extern int yespower(yespower_local_t *local,
 extern int yespower_tls(const uint8_t *src, size_t srclen,
     const yespower_params_t *params, yespower_binary_t *dst);
 
+/**
+ * Maximum number of independent hashes that yespower_multi() can interleave.
+ */
+#define YESPOWER_MAX_LANES 4
+
+/**
+ * yespower_multi(local, src, srclen, params, lanes, dst):
+ * Compute yespower(src[l][0 .. srclen - 1], params[l]) into dst[l] for each
+ * of lanes independent inputs (1 to YESPOWER_MAX_LANES), interleaving their
+ * computation to hide memory latency.  The results are bit-identical to
+ * calling yespower() on each input.  All params[l] must have the same
+ * version, N and r.  local must be initialized with yespower_init_local(),
+ * and needs lanes times the memory of yespower().
+ *
+ * Return 0 on success; or -1 on error.
+ *
+ * MT-safe as long as local and dst are local to the thread.
+ */
+extern int yespower_multi(yespower_local_t *local,
+    const uint8_t *const *src, size_t srclen,
+    const yespower_params_t *params, size_t lanes,
+    yespower_binary_t *dst);
+
+/**
+ * yespower_multi_tls(src, srclen, params, lanes, dst):
+ * Compute yespower_multi() with the memory allocation maintained internally
+ * using thread-local storage, shared with yespower_tls().
+ *
+ * Return 0 on success; or -1 on error.
+ *
+ * MT-safe as long as dst is local to the thread.
+ */
+extern int yespower_multi_tls(const uint8_t *const *src, size_t srclen,
+    const yespower_params_t *params, size_t lanes, yespower_binary_t *dst);
+
+/**
+ * Kinds of memory pages a region can be backed by, from smallest to largest.
+ */
+typedef enum {
+	YESPOWER_PAGES_SMALL = 0,	/* regular pages */
+	YESPOWER_PAGES_THP = 1,		/* regular pages, advised for transparent
+					   huge pages */
+	YESPOWER_PAGES_2M = 2,		/* explicit 2 MiB huge pages */
+	YESPOWER_PAGES_1G = 3		/* explicit 1 GiB huge pages */
+} yespower_pages_t;
+
+/**
+ * yespower_local_size(params, lanes):
+ * Return the number of bytes of memory that yespower_multi() needs to hash
+ * lanes inputs with params (yespower() needs the amount for one lane); or 0
+ * if params or lanes are out of range.  N is not required to be a power of
+ * two, so that callers can size memory for any N and r in range.
+ */
+extern size_t yespower_local_size(const yespower_params_t *params,
+    size_t lanes);
+
+/**
+ * yespower_tls_reserve(size, max_pages):
+ * Replace the memory used by yespower_tls() and yespower_multi_tls() in the
+ * calling thread with a region of at least size bytes.  Explicit huge pages
+ * no larger than max_pages are tried first, largest first, then regular
+ * pages advised for transparent huge pages (unless max_pages is
+ * YESPOWER_PAGES_SMALL), then regular pages.  The region is written to
+ * before returning, so that its pages come from the NUMA node the thread is
+ * running on.
+ *
+ * Return the yespower_pages_t obtained; or -1 on error.
+ *
+ * MT-safe.
+ */
+extern int yespower_tls_reserve(size_t size, yespower_pages_t max_pages);
+
+/**
+ * yespower_tls_free():
+ * Free the memory used by yespower_tls() in the calling thread.  Threads that
+ * reserved a large region should call this before they exit.
+ *
+ * Return 0 on success; or -1 on error.
+ */
+extern int yespower_tls_free(void);
+
 #ifdef __cplusplus
 }
 #endif